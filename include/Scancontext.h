@@ -12,10 +12,8 @@
 #include <ctime>
 #include <iostream>
 #include <memory>
-#include <pcl/filters/voxel_grid.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
-#include <pcl_conversions/pcl_conversions.h>
 #include <utility>
 #include <vector>
 
@@ -39,6 +37,7 @@ using InvKeyTree = KDTreeVectorOfVectorsAdaptor<KeyMat, float>;
 void coreImportTest(void);
 
 // sc param-independent helper functions
+float deg2rad(float degrees);
 float xy2theta(const float& _x, const float& _y);
 Eigen::MatrixXd circshift(const Eigen::MatrixXd& _mat, int _num_shift);
 std::vector<float> eig2stdvec(Eigen::MatrixXd _eigmat);
@@ -61,8 +60,12 @@ public:
 
     // User-side API
     void makeAndSaveScancontextAndKeys(const pcl::PointCloud<SCPointType>& _scan_down);
+    void saveScancontextAndKeys(const Eigen::MatrixXd& _sc); // a descriptor made earlier
     std::pair<int, float> detectLoopClosureID(void); // int: nearest node index, float: relative yaw
 
+    // bytes held by the descriptors, ring keys and the key tree
+    size_t memory_footprint() const;
+
     void pop_back() {
         polarcontexts_.pop_back();
         polarcontext_invkeys_.pop_back();
@@ -80,11 +83,12 @@ public:
                                      // in the lidar local coord (not robot base coord) / if you use
                                      // robot-coord-transformed lidar scans, just set this as 0.
 
-    const int PC_NUM_RING = 20;        // 20 in the original paper (IROS 18)
-    const int PC_NUM_SECTOR = 60;      // 60 in the original paper (IROS 18)
-    const double PC_MAX_RADIUS = 80.0; // 80 meter max in the original paper (IROS 18)
-    const double PC_UNIT_SECTORANGLE = 360.0 / double(PC_NUM_SECTOR);
-    const double PC_UNIT_RINGGAP = PC_MAX_RADIUS / double(PC_NUM_RING);
+    // constexpr: the ring and sector tables of makeScancontext are built from them
+    static constexpr int PC_NUM_RING = 20;        // 20 in the original paper (IROS 18)
+    static constexpr int PC_NUM_SECTOR = 60;      // 60 in the original paper (IROS 18)
+    static constexpr double PC_MAX_RADIUS = 80.0; // 80 meter max in the original paper (IROS 18)
+    static constexpr double PC_UNIT_SECTORANGLE = 360.0 / double(PC_NUM_SECTOR);
+    static constexpr double PC_UNIT_RINGGAP = PC_MAX_RADIUS / double(PC_NUM_RING);
 
     // tree
     const int NUM_EXCLUDE_RECENT =
@@ -0,0 +1,112 @@
+#ifndef __ALLOC_TRACKER_H__
+#define __ALLOC_TRACKER_H__
+
+// Heap allocation accounting per pipeline stage, to find and hold down per-frame allocations.
+//
+// Built with HLOAM_ENABLE_ALLOC_TRACKING, src/alloc_tracker.cpp wraps the glibc allocator
+// (malloc, calloc, realloc, the memalign family and free). That covers operator new/delete,
+// Eigen's aligned allocator and PCL's, which all end up there. Each allocation is charged to the
+// stage of the innermost TRACE_SCOPE on the calling thread: the name up to the first '.', so
+// "registration.lm2_iteration" counts as registration. Allocations outside any scope count as
+// "other". Without the option every function here is a no-op returning zeros.
+
+#include <cstdint>
+#include <cstring>
+
+enum alloc_stage {
+    ALLOC_STAGE_OTHER,
+    ALLOC_STAGE_DECODE,
+    ALLOC_STAGE_SYNC,
+    ALLOC_STAGE_FEATURE,
+    ALLOC_STAGE_REGISTRATION,
+    ALLOC_STAGE_LOCAL_MAP,
+    ALLOC_STAGE_LOOP,
+    ALLOC_STAGE_COUNT
+};
+
+inline const char* alloc_stage_name(int stage) {
+    static const char* names[ALLOC_STAGE_COUNT] = { "other",        "decode",    "sync", "feature",
+                                                    "registration", "local_map", "loop" };
+    return names[stage];
+}
+
+// stage of a trace scope name
+inline alloc_stage alloc_stage_of(const char* trace_name) {
+    for(int stage = 1; stage < ALLOC_STAGE_COUNT; stage++) {
+        const char* name = alloc_stage_name(stage);
+        size_t length = strlen(name);
+        if(strncmp(trace_name, name, length) == 0 && trace_name[length] == '.')
+            return alloc_stage(stage);
+    }
+    return ALLOC_STAGE_OTHER;
+}
+
+struct alloc_counts {
+    uint64_t allocations = 0;
+    uint64_t frees = 0; // charged to the stage doing the free
+    uint64_t bytes = 0; // requested by the allocations
+};
+
+struct alloc_snapshot {
+    alloc_counts stages[ALLOC_STAGE_COUNT];
+
+    alloc_snapshot operator-(const alloc_snapshot& since) const {
+        alloc_snapshot delta;
+        for(int i = 0; i < ALLOC_STAGE_COUNT; i++) {
+            delta.stages[i].allocations = stages[i].allocations - since.stages[i].allocations;
+            delta.stages[i].frees = stages[i].frees - since.stages[i].frees;
+            delta.stages[i].bytes = stages[i].bytes - since.stages[i].bytes;
+        }
+        return delta;
+    }
+};
+
+#ifdef HLOAM_ENABLE_ALLOC_TRACKING
+
+constexpr bool alloc_tracking_available = true;
+
+// process-wide totals since start
+alloc_snapshot alloc_totals();
+
+// allocations made by the calling thread since it started, whatever the stage
+uint64_t alloc_thread_allocations();
+
+// sets the calling thread's stage and returns the previous one, for alloc_leave_stage
+int alloc_enter_stage(alloc_stage stage);
+void alloc_leave_stage(int previous);
+
+#else
+
+constexpr bool alloc_tracking_available = false;
+
+inline alloc_snapshot alloc_totals() {
+    return {};
+}
+
+inline uint64_t alloc_thread_allocations() {
+    return 0;
+}
+
+inline int alloc_enter_stage(alloc_stage) {
+    return 0;
+}
+
+inline void alloc_leave_stage(int) {
+}
+
+#endif
+
+// Allocation budget for a block of code on one thread; test/alloc_test.cpp checks it with
+//   alloc_budget budget;
+//   kernel();
+//   assert(budget.used() == 0);
+// always 0 without HLOAM_ENABLE_ALLOC_TRACKING.
+struct alloc_budget {
+    uint64_t start = alloc_thread_allocations();
+
+    uint64_t used() const {
+        return alloc_thread_allocations() - start;
+    }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+// Periodic on-disk checkpoints of the mapping state, so a restarted sync_node resumes the map
+// instead of starting over from identity.
+//
+// A checkpoint directory holds two files:
+//   keyframes  append-only log, one record per loop keyframe: its scan context descriptor
+//              (rows x cols doubles) then its quantized_cloud scan (keyframe_scan and the int16
+//              points), each record on a 64-byte boundary. Keyframes never change once confirmed, so each checkpoint
+//              only appends the ones added since the previous.
+//   state      everything else, rewritten whole (state.tmp, then rename) each time:
+//              checkpoint_header, final_path, keyframe poses and log index, loop constraints,
+//              then the local map window with its feature clouds as raw PointType records.
+// Both carry the same run id; a state whose log belongs to another run, or is shorter than it
+// expects, is rejected.
+//
+// update() runs on the mapping thread and only copies poses and cloud pointers; a background
+// thread does the writing. restore() maps both files and rebuilds visual_odom_v2 from them.
+//
+// Keyframe scans are stored exactly as loop closure keeps them, so a restore reloads the same
+// points without re-quantizing. Like the scan archive, the files are native endianness and only readable by a
+// build with the same PointType.
+
+#include "comm.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <result_of>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct visual_odom_v2;
+
+// the files' records; restore() checks every count and offset in them against the file sizes
+struct checkpoint_header {
+    char magic[8]; // "HLCKPT1"
+    std::uint32_t version;
+    std::uint32_t record_size; // sizeof(PointType) of the writer
+    std::uint64_t run_id;
+    std::uint64_t log_length; // bytes of the keyframe log this state refers to
+    double stamp;             // sensor time of the last frame before the checkpoint
+    std::uint32_t sc_rows, sc_cols;
+    std::uint64_t path;
+    std::uint64_t keyframes;
+    std::uint64_t constraints;
+    std::uint64_t window_head, window_size;
+    std::int64_t loop_counter;
+    std::uint64_t min_constraint_node;
+    double prev_transform[16];
+    double next_initial_guess[6]; // x y z roll pitch yaw
+};
+
+struct keyframe_log_header {
+    char magic[8]; // "HLKEYF1"
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t run_id;
+};
+
+// one final_path entry, as a TUM line
+struct checkpoint_pose {
+    double stamp;
+    double x, y, z, qx, qy, qz, qw;
+};
+
+struct checkpoint_keyframe {
+    double pose[16]; // column-major
+    std::uint64_t offset;
+    std::uint64_t count;
+};
+
+struct checkpoint_constraint {
+    std::uint64_t source, target;
+    double pose[16];
+};
+
+// a keyframe's scan in the log, after its descriptor: the quantized_cloud's origin and
+// resolution, then its count quantized_points as they are held in memory
+struct keyframe_scan {
+    float origin[3];
+    float resolution;
+};
+
+struct checkpoint_config {
+    std::string path;       // directory, empty: off
+    double interval = 10.0; // s of sensor time between checkpoints
+    bool restore = false;   // resume from path on start
+};
+
+struct checkpoint_snapshot;
+
+struct checkpointer {
+    explicit checkpointer(const checkpoint_config& config);
+    // waits for the checkpoint being written, if any
+    ~checkpointer();
+
+    checkpointer(const checkpointer&) = delete;
+    checkpointer& operator=(const checkpointer&) = delete;
+
+    bool enabled() const {
+        return !config.path.empty();
+    }
+
+    // loads the checkpoint in config.path into a freshly constructed odom; later checkpoints
+    // extend its keyframe log. The value is the number of keyframes restored; on failure odom is
+    // left untouched.
+    result_of<size_t, std::string> restore(visual_odom_v2& odom);
+
+    // called after each mapped frame; once interval has passed since the last checkpoint hands a
+    // copy of the state to the writer, skipped while one is still written. force waits for the
+    // writer instead, and ignores the interval.
+    void update(ros::Time time, const visual_odom_v2& odom, bool force = false);
+
+    // checkpoints written so far
+    size_t written() const;
+
+private:
+    void __writer_thread();
+    bool __write(checkpoint_snapshot& snapshot);
+    bool __append_keyframes(checkpoint_snapshot& snapshot);
+
+    checkpoint_config config;
+
+    // mapping thread only
+    double last_checkpoint = -1e9;
+    size_t captured = 0; // keyframes already handed to the writer
+
+    // writer thread only
+    struct log_entry {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+    std::vector<log_entry> log_index;
+    std::uint64_t log_length = 0;
+    std::uint64_t run_id = 0;
+    FILE* log = nullptr;
+
+    mutable std::mutex lock;
+    std::condition_variable cv;
+    std::unique_ptr<checkpoint_snapshot> pending;
+    bool busy = false;
+    size_t count = 0;
+
+    bool should_stop = false;
+    std::thread writer;
+};
+
+#endif
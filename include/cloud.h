@@ -0,0 +1,84 @@
+#ifndef __CLOUD_H__
+#define __CLOUD_H__
+
+// Point type, cloud pool and feature containers shared by the extractors, odometry and loop
+// closure. Free of ROS headers, so hloam.h can expose them.
+
+#include <Eigen/Core>
+#include <array>
+#include <cstdint>
+#include <object_pool>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+struct XYZIRT {
+    PCL_ADD_POINT4D;
+    PCL_ADD_INTENSITY;
+    std::uint16_t ring;
+    double time;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+} EIGEN_ALIGN16;
+
+POINT_CLOUD_REGISTER_POINT_STRUCT(
+    XYZIRT,
+    (float, x, x)(float, y, y)(float, z, z)(float, intensity, intensity)(std::uint16_t, ring,
+                                                                         ring)(double, time, time));
+template<typename T>
+static inline auto p2(T x) -> decltype(x * x) {
+    return x * x;
+}
+
+template<typename T>
+static inline auto distance2(const T& v1, const T& v2) {
+    return p2(v1.x - v2.x) + p2(v1.y - v2.y) + p2(v1.z - v2.z);
+}
+
+using PointType = XYZIRT;
+
+// process-wide pool of cloud buffers; every per-frame cloud should come from here so that its
+// capacity is reused once the frame has been consumed.
+inline object_pool<pcl::PointCloud<PointType>>& cloud_pool() {
+    static object_pool<pcl::PointCloud<PointType>> pool;
+    return pool;
+}
+
+inline pcl::PointCloud<PointType>::Ptr acquire_cloud() {
+    return cloud_pool().acquire<pcl::PointCloud<PointType>::Ptr>();
+}
+
+struct feature_objects {
+    pcl::PointCloud<PointType>::Ptr line_features;
+    pcl::PointCloud<PointType>::Ptr plane_features;
+    pcl::PointCloud<PointType>::Ptr non_features;
+};
+
+struct feature_frame {
+    feature_objects livox_feature;
+    feature_objects velodyne_feature;
+};
+
+// the six feature clouds of a frame, velodyne first, as checkpoints and flight records store them
+template<typename Frame>
+inline auto clouds_of(Frame& frame) -> std::array<decltype(&frame.livox_feature.line_features), 6> {
+    return { &frame.velodyne_feature.line_features, &frame.velodyne_feature.plane_features,
+             &frame.velodyne_feature.non_features,  &frame.livox_feature.line_features,
+             &frame.livox_feature.plane_features,   &frame.livox_feature.non_features };
+}
+
+// heap held by a cloud: capacity rather than size, since that is what stays allocated
+inline size_t cloud_bytes(const pcl::PointCloud<PointType>::Ptr& cloud) {
+    if(cloud == nullptr)
+        return 0;
+    return sizeof(*cloud) + cloud->points.capacity() * sizeof(PointType);
+}
+
+inline size_t feature_bytes(const feature_objects& f) {
+    return cloud_bytes(f.line_features) + cloud_bytes(f.plane_features) +
+           cloud_bytes(f.non_features);
+}
+
+inline size_t feature_bytes(const feature_frame& f) {
+    return feature_bytes(f.livox_feature) + feature_bytes(f.velodyne_feature);
+}
+
+#endif
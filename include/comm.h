@@ -1,56 +1,56 @@
 #ifndef __COMM_H__
 #define __COMM_H__
 
+#include "cloud.h"
+#include "config.h"
+#include "kernels.h"
+#include "log.h"
+
 #include <condition_variable>
 #include <mutex>
 #include <nanoflann.hpp>
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
 #include <queue>
-#include <ros/ros.h>
+#include <result_of>
+#include <ros/time.h>
 #include <thread>
-struct XYZIRT {
-    PCL_ADD_POINT4D;
-    PCL_ADD_INTENSITY;
-    std::uint16_t ring;
-    double time;
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-} EIGEN_ALIGN16;
-
-POINT_CLOUD_REGISTER_POINT_STRUCT(
-    XYZIRT,
-    (float, x, x)(float, y, y)(float, z, z)(float, intensity, intensity)(std::uint16_t, ring,
-                                                                         ring)(double, time, time));
-template<typename T>
-static inline auto p2(T x) -> decltype(x * x) {
-    return x * x;
-}
-
-template<typename T>
-static inline auto distance2(const T& v1, const T& v2) {
-    return p2(v1.x - v2.x) + p2(v1.y - v2.y) + p2(v1.z - v2.z);
-}
-
-using PointType = XYZIRT;
 
 struct synced_message {
     pcl::PointCloud<PointType>::Ptr velodyne;
     pcl::PointCloud<PointType>::Ptr livox;
     ros::Time time;
+    // velodyne features already extracted while the sweep streamed in (velodyne_stream.h);
+    // null line_features: extract_features runs the extractor on velodyne
+    feature_objects velodyne_features;
+    // a livox micro-sweep between velodyne sweeps: velodyne is empty, and mapping only tracks
+    // the pose (visual_odom_v2::track)
+    bool livox_only = false;
 };
 
-struct feature_objects {
-    pcl::PointCloud<PointType>::Ptr line_features;
-    pcl::PointCloud<PointType>::Ptr plane_features;
-    pcl::PointCloud<PointType>::Ptr non_features;
-};
+// xyz of count points transformed in place, by the kernel variant for this CPU (kernels.h)
+static inline void transform_points(PointType* points, size_t count,
+                                    const Eigen::Matrix4d& matrix) {
+    double m[12];
+    for(int r = 0; r < 3; r++) {
+        for(int c = 0; c < 4; c++) {
+            m[r * 4 + c] = matrix(r, c);
+        }
+    }
+    kernels().transform_points(reinterpret_cast<kernel_point*>(points), count, m);
+}
 
-struct feature_frame {
-    feature_objects livox_feature;
-    feature_objects velodyne_feature;
-};
+// ATA = A^T A and ATb = A^T b over the first rows rows of the LM system
+static inline void normal_equations(const Eigen::MatrixXd& A, const Eigen::VectorXd& b,
+                                    size_t rows, Eigen::Matrix<double, 6, 6>& ATA,
+                                    Eigen::Matrix<double, 6, 1>& ATb) {
+    kernels().normal_equations(A.data(), A.rows(), b.data(), rows, ATA.data(), ATb.data());
+}
+
+// pcl::VoxelGrid replacement: one point per leaf-sized voxel at the mean of its points, in
+// VoxelGrid's output order. in and out may be the same cloud. (odometry.cpp)
+void voxel_downsample(const pcl::PointCloud<PointType>& in, float leaf,
+                      pcl::PointCloud<PointType>& out);
 
 static inline void transform_cloud(const pcl::PointCloud<PointType>::Ptr& cloud,
                                    pcl::PointCloud<PointType>::Ptr& out,
@@ -61,10 +61,11 @@ static inline void transform_cloud(const pcl::PointCloud<PointType>::Ptr& cloud,
     }
 
     if(out == nullptr)
-        out.reset(new pcl::PointCloud<PointType>);
+        out = acquire_cloud();
 
-    out->resize(cloud->size());
-    pcl::transformPointCloud(*cloud, *out, matrix);
+    if(out != cloud)
+        *out = *cloud;
+    transform_points(out->points.data(), out->size(), matrix);
 }
 
 static inline void transform_cloud(const feature_objects& cloud, feature_objects& out,
@@ -80,7 +81,7 @@ static inline void concat(PointTypePtr& out, const PointTypePtr& cloud) {
         return;
 
     if(out == nullptr) {
-        out.reset(new pcl::PointCloud<PointType>());
+        out = acquire_cloud();
     }
 
     *out += *cloud;
@@ -92,8 +93,22 @@ static inline void concat(feature_objects& out, const feature_objects& feature)
     concat(out.non_features, feature.non_features);
 }
 
+// line_features are the edge points, null when a scan has too few of them to count
 void feature_livox(const pcl::PointCloud<PointType>::Ptr& cloud, feature_objects& feature);
-void feature_velodyne(const pcl::PointCloud<PointType>::Ptr& cloud, feature_objects& feature);
+// pointsLessSharp: where edge points go, null drops them like before
+void detectFeaturePoint2(const pcl::PointCloud<PointType>::Ptr& cloud,
+                         pcl::PointCloud<PointType>::Ptr& pointsLessFlat,
+                         pcl::PointCloud<PointType>::Ptr& pointsNonFeature,
+                         pcl::PointCloud<PointType>::Ptr* pointsLessSharp = nullptr);
+// sections: per ring, the number of equal slices edge and plane points are picked from. A whole
+// sweep uses 6; a part of it covering 1/n of the turn, 6/n.
+void feature_velodyne(const pcl::PointCloud<PointType>::Ptr& cloud, feature_objects& feature,
+                      int sections = 6);
+
+// Runs both extractors the way the feature thread does: livox features are moved into the
+// velodyne frame, and a frame with too few features of either sensor fails.
+result_of<feature_frame, std::string> extract_features(const synced_message& msg,
+                                                       const feature_config& config);
 
 struct Transform {
     double x = 0.0f, y = 0.0f, z = 0.0f;
@@ -268,7 +283,7 @@ struct synced_queue {
         std::unique_lock<std::mutex> lock(mutex);
         bool pred = false;
         cond.wait(lock, [this, &pr, &pred] {
-            pred = pr() || !ros::ok();
+            pred = pr();
             return pred || !queue.empty();
         });
 
@@ -282,6 +297,11 @@ struct synced_queue {
     }
 };
 
+// the ROS side: node threads around the core, created by sync_node
+namespace ros {
+class NodeHandle;
+}
+
 struct feature_thread;
 
 std::shared_ptr<feature_thread> create_feature_thread(ros::NodeHandle* nh);
@@ -290,6 +310,10 @@ struct mapping_thread;
 
 std::shared_ptr<mapping_thread> create_mapping_thread(ros::NodeHandle* nh);
 
+struct metrics_thread;
+
+std::shared_ptr<metrics_thread> create_metrics_thread(ros::NodeHandle* nh);
+
 #include <delegate>
 
 extern delegate<void(const synced_message&)> sync_frame_delegate;
@@ -0,0 +1,43 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+// Tunables of the headless core. Plain structs without ROS types: sync_node fills them from
+// /hloam/* parameters, hloam_offline from its command line, embedders directly (hloam.h).
+
+#include <Eigen/Core>
+
+struct feature_config {
+    bool use_velodyne = true;
+    bool use_livox = true;
+    Eigen::Matrix4d livox_transform = Eigen::Matrix4d::Identity(); // livox -> velodyne frame
+};
+
+struct visual_odom_v2_config {
+    int method = 0;
+    float degenerate_threshold = 10.0f;
+
+    double key_frame_distance_x = 0.5;
+    double key_frame_distance_y = 0.5;
+    double key_frame_distance_z = 0.1;
+
+    double key_frame_distance_roll = 0.02;
+    double key_frame_distance_pitch = 0.02;
+    double key_frame_distance_yaw = 0.02;
+
+    double loop_loss = 0.05f;
+
+    int loop_reset = 5;
+    int loop_initial_load = 100;
+
+    bool enable_loop = true;
+};
+
+// per-frame registration effort; lowered by the load governor (load_governor.h) when mapping
+// falls behind the sensors
+struct registration_quality {
+    int lm_iterations = 30;
+    float downsample_leaf = 0.2f; // m, voxel size the frame is downsampled to before LM
+    bool loop_search = true;      // off: keyframes are still stored, candidates not searched
+};
+
+#endif
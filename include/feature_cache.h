@@ -0,0 +1,92 @@
+#ifndef __FEATURE_CACHE_H__
+#define __FEATURE_CACHE_H__
+
+// Per-frame extract_features output on disk, so registration and keyframe tuning can rerun
+// visual_odom_v2::mapping without redoing feature extraction.
+//
+// A cache is a header followed by one record per frame in sensor order:
+//   double stamp, uint32 flags
+//   unless FEATURE_CACHE_DROPPED: livox line/plane/non, velodyne line/plane/non clouds
+//   if FEATURE_CACHE_SCAN: the velodyne scan, which loop detection builds scan contexts from
+// A cloud is uint32 count (UINT32_MAX for none), double time base, then count packed points
+// whose time is stored as a float offset from the base.
+//
+// Like the scan archive, the writer fills <filename>.tmp and renames it over filename only in
+// close(), so a run that stops early leaves no cache that loads as complete.
+
+#include "comm.h"
+
+#include <cstdint>
+#include <result_of>
+#include <string>
+
+enum feature_cache_flags : std::uint32_t {
+    FEATURE_CACHE_DROPPED = 1, // extraction rejected the frame, it carries no clouds
+    FEATURE_CACHE_SCAN = 2,
+};
+
+struct cached_frame {
+    ros::Time time;
+    bool dropped = false;
+    feature_frame features;
+    pcl::PointCloud<PointType>::Ptr scan; // null if the cache was written without scans
+};
+
+struct feature_cache_writer {
+    feature_cache_writer() = default;
+    // abort() unless close() was called
+    ~feature_cache_writer();
+
+    feature_cache_writer(const feature_cache_writer&) = delete;
+    feature_cache_writer& operator=(const feature_cache_writer&) = delete;
+
+    // without scans the cache is about a third of the size, but replay cannot close loops
+    bool open(const std::string& filename, bool with_scans = true);
+    bool append(ros::Time time, const feature_frame& features,
+                const pcl::PointCloud<PointType>::Ptr& scan);
+    bool append_dropped(ros::Time time);
+    bool close();
+    // discards what was appended, filename is left as it was
+    void abort();
+
+    size_t size() const {
+        return frames;
+    }
+
+private:
+    bool write_cloud(const pcl::PointCloud<PointType>::Ptr& cloud);
+
+    std::string filename;
+    FILE* fp = nullptr;
+    bool with_scans = true;
+    size_t frames = 0;
+    std::vector<char> buffer;
+};
+
+struct feature_cache_reader {
+    feature_cache_reader() = default;
+    ~feature_cache_reader();
+
+    feature_cache_reader(const feature_cache_reader&) = delete;
+    feature_cache_reader& operator=(const feature_cache_reader&) = delete;
+
+    // the value is the number of frames in the cache
+    result_of<size_t, std::string> open(const std::string& filename);
+    void close();
+
+    bool has_scans() const {
+        return with_scans;
+    }
+
+    // false at the end of the cache or on a short read
+    bool next(cached_frame& frame);
+
+private:
+    bool read_cloud(pcl::PointCloud<PointType>::Ptr& cloud);
+
+    FILE* fp = nullptr;
+    bool with_scans = false;
+    std::vector<char> buffer;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __FLIGHT_RECORDER_H__
+#define __FLIGHT_RECORDER_H__
+
+// The last N frames of registration input and output, kept in memory for post-mortem debugging.
+//
+// record() only moves shared cloud pointers into a ring, so the mapping thread never touches the
+// disk. A dump snapshots the ring and a background thread writes it to
+// <output>/<unix time>_<reason>/:
+//   NNN_{vl,vp,vn,ll,lp,ln}.pcd  the frame's velodyne/livox line, plane and non features
+//   NNN_map_*.pcd                the local map it was registered against, written again only
+//                                when it changed since the previous frame
+//   frames.txt                   index stamp x y z qx qy qz qw loss dropped map_index
+// Dumps are requested with request_dump(), from any thread, or flight_recorder_signal(), from
+// a signal handler, or start by themselves when the registration loss goes over loss_threshold.
+
+#include "comm.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct flight_record {
+    ros::Time time;
+    feature_frame features;
+    feature_frame local_map;
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity(); // in the map, identity if dropped
+    float loss = 0.0f;
+    bool dropped = false;
+};
+
+struct flight_recorder_config {
+    size_t frames = 0; // ring size, 0: off
+    std::string output = "/tmp/hloam_flight";
+
+    float loss_threshold = 0.0f; // 0: no automatic dumps
+    int frames_after = 5;        // an automatic dump waits this many frames past the spike
+    double min_interval = 30.0;  // s between automatic dumps
+};
+
+// async-signal-safe: asks every recorder for a dump, picked up within a tenth of a second
+void flight_recorder_signal();
+
+struct flight_recorder {
+    explicit flight_recorder(const flight_recorder_config& config);
+    ~flight_recorder();
+
+    flight_recorder(const flight_recorder&) = delete;
+    flight_recorder& operator=(const flight_recorder&) = delete;
+
+    bool enabled() const {
+        return !ring.empty();
+    }
+
+    void record(flight_record&& record);
+    void request_dump(const std::string& reason);
+
+    // dumps written so far
+    size_t dumps() const;
+
+private:
+    void __writer_thread();
+    void __write(const std::vector<flight_record>& records, const std::string& reason);
+
+    flight_recorder_config config;
+
+    mutable std::mutex lock;
+    std::condition_variable cv;
+    std::vector<flight_record> ring;
+    size_t head = 0, count = 0;
+
+    std::string pending_reason; // empty: no dump requested
+    int frames_to_spike_dump = -1;
+    double last_spike_dump = -1e9;
+    size_t written = 0;
+
+    bool should_stop = false;
+    std::thread writer;
+};
+
+#endif
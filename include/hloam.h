@@ -0,0 +1,87 @@
+#ifndef __HLOAM_H__
+#define __HLOAM_H__
+
+// Headless HLOAM for embedding: feature extraction, LM registration against the local map and
+// scan-context loop closure, in-process. No ROS types in the interface; at link time it needs
+// rostime (for ros::Time) but not roscpp, which hloam_embed_test checks.
+//
+//   hloam_odometry odom(config);
+//   odom.on_pose = [](double stamp, const Eigen::Matrix4d& pose, bool keyframe) { ... };
+//   auto pose = odom.push_frame(stamp, velodyne, livox);
+//
+// Clouds are passed by shared pointer and never copied or serialized. Keyframes keep theirs for
+// loop closure, so a cloud must not be modified once pushed. One instance is driven from one
+// thread; the callbacks run on it, before push_frame returns. sync_node is the ROS wrapper: its
+// feature thread calls extract, its mapping thread register_features.
+
+#include "cloud.h"
+#include "config.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct hloam_config {
+    feature_config features;
+    visual_odom_v2_config odometry;
+};
+
+struct hloam_keyframe {
+    double stamp;
+    Eigen::Matrix4d pose; // velodyne in the map
+};
+
+struct visual_odom_v2;
+
+struct hloam_odometry {
+    using cloud_ptr = pcl::PointCloud<PointType>::Ptr;
+
+    explicit hloam_odometry(const hloam_config& config);
+    ~hloam_odometry();
+
+    hloam_odometry(const hloam_odometry&) = delete;
+    hloam_odometry& operator=(const hloam_odometry&) = delete;
+
+    // one synchronized scan pair (livox may be null with features.use_livox off); the velodyne
+    // pose in the map, nullopt when the frame was dropped
+    std::optional<Eigen::Matrix4d> push_frame(double stamp, const cloud_ptr& velodyne,
+                                              const cloud_ptr& livox);
+
+    // the halves of push_frame, for callers overlapping extraction of one frame with mapping of
+    // the previous one. extract only reads the config and may run on another thread.
+    std::optional<feature_frame> extract(double stamp, const cloud_ptr& velodyne,
+                                         const cloud_ptr& livox) const;
+    std::optional<Eigen::Matrix4d> register_features(double stamp, const feature_frame& features,
+                                                     const cloud_ptr& velodyne);
+
+    // a livox micro-sweep between velodyne sweeps: its pose against the local map, which is left
+    // unchanged (on_pose reports it as a non-keyframe); nullopt before the first frame or when
+    // it was not tracked
+    std::optional<Eigen::Matrix4d> track(double stamp, const cloud_ptr& livox);
+
+    // where the first frame is in the map (identity by default), e.g. from sc_database::relocalize
+    // on a previous run's database; only before the first frame
+    void set_initial_pose(const Eigen::Matrix4d& pose);
+
+    // keyframe poses, as corrected by the loop closures so far
+    std::vector<hloam_keyframe> trajectory() const;
+    size_t loops() const;
+
+    // the odometry behind this, for the ROS wrapper's path/marker publishers and recorder
+    visual_odom_v2& state() {
+        return *odom;
+    }
+
+    std::function<void(double stamp, const std::string& reason)> on_dropped;
+    std::function<void(double stamp, const Eigen::Matrix4d& pose, bool keyframe)> on_pose;
+    // after a loop closure re-optimized the keyframes, with the corrected trajectory
+    std::function<void(const std::vector<hloam_keyframe>& trajectory)> on_loop;
+
+private:
+    hloam_config config;
+    std::unique_ptr<visual_odom_v2> odom;
+};
+
+#endif
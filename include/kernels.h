@@ -0,0 +1,87 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+// Hot loops compiled once per instruction set, picked at startup for the CPU we run on, so one
+// binary runs AVX2 code on AVX2 machines and AVX-512 code on AVX-512 ones without -march=native.
+//
+//   kernels().range_curvature(points, count, range, curvature);
+//
+// Each variant comes from the same source, src/kernels_impl.h, built with its own -m flags (see
+// CMakeLists.txt) into its own kernel_table. kernels() chooses the widest table the CPU supports
+// on first use; HLOAM_ISA=default|avx2|avx512 in the environment forces a narrower one, for
+// comparing variants or ruling one out. Everything else, Eigen included, stays baseline x86-64:
+// compiling the same inline templates for several ISAs in one binary lets the linker mix them.
+
+#include <cstddef>
+#include <cstdint>
+
+// layout of XYZIRT (cloud.h), which the kernels read without including PCL or Eigen
+struct alignas(16) kernel_point {
+    float x, y, z, w;
+    float intensity, intensity_pad[3];
+    std::uint16_t ring;
+    double time;
+};
+
+// map point stored as offsets from a cloud origin in steps of its resolution (quantized_cloud.h)
+struct quantized_point {
+    std::int16_t x, y, z;
+    std::uint8_t intensity;
+    std::uint8_t reserved;
+};
+
+// point tests for crop_points, on the points as decoded (sensor frame)
+struct kernel_roi {
+    float min_range2, max_range2; // squared range bounds
+    float box_min[3], box_max[3]; // points outside are dropped
+    // unit xy directions of the kept azimuth sector's edges, counter-clockwise from start to end;
+    // sector_mode 0: every azimuth, 1: a sector up to 180 degrees, 2: a wider one
+    float sector_start[2], sector_end[2];
+    int sector_mode;
+    const float (*exclude)[6]; // boxes whose points are dropped (vehicle body): min xyz, max xyz
+    int exclude_count;
+    std::uint32_t stride; // of each ring's decoded points only every stride-th is considered
+};
+
+struct kernel_table {
+    const char* isa;
+
+    // xyz = R * xyz + t in place, m is the top 3x4 of a row-major 4x4 transform
+    void (*transform_points)(kernel_point* points, size_t count, const double m[12]);
+
+    // range[i] = |p_i| for every point, curvature[i] = (sum of the 10 neighbours' ranges -
+    // 10 range[i])^2 for 5 <= i < count - 5, untouched elsewhere
+    void (*range_curvature)(const kernel_point* points, size_t count, float* range,
+                            float* curvature);
+
+    // ATA = A^T A and ATb = A^T b over rows [0, rows) of a column-major A with leading
+    // dimension ld (an Eigen::MatrixXd's rows()), 6 columns; both outputs column-major
+    void (*normal_equations)(const double* A, size_t ld, const double* b, size_t rows,
+                             double ATA[36], double ATb[6]);
+
+    // ScanContext distance of sc1 and sc2 shifted right by shift columns: 1 - the mean cosine
+    // similarity of the column pairs where neither column is all zeros. Column-major rows x cols.
+    double (*sc_distance)(const double* sc1, const double* sc2, int rows, int cols, int shift);
+
+    // voxel coordinates floor(p * inverse_leaf), three per point
+    void (*voxel_coords)(const kernel_point* points, size_t count, float inverse_leaf,
+                         std::int32_t* ijk);
+
+    // drops the points failing roi, moving the kept ones to the front in their order; the
+    // number kept
+    size_t (*crop_points)(kernel_point* points, size_t count, const kernel_roi* roi);
+
+    // out[i] = round((p_i - origin) * inverse_resolution), saturated to 16 bits; intensity
+    // rounded and saturated to 0-255
+    void (*quantize_points)(const kernel_point* points, size_t count, const float origin[3],
+                            float inverse_resolution, quantized_point* out);
+
+    // out[i] = R * (origin + q_i * resolution) + t with q_i's intensity, ring and time zeroed;
+    // m as for transform_points
+    void (*dequantize_points)(const quantized_point* points, size_t count, const float origin[3],
+                              float resolution, const double m[12], kernel_point* out);
+};
+
+const kernel_table& kernels();
+
+#endif
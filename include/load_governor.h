@@ -0,0 +1,54 @@
+#ifndef __LOAD_GOVERNOR_H__
+#define __LOAD_GOVERNOR_H__
+
+// Sheds registration work in stages while mapping lags behind the sensors, and restores it once
+// caught up. The lag is the age of the frame being mapped (wall clock minus scan stamp):
+//
+//   level 0  full quality
+//   level 1  fewer LM iterations
+//   level 2  coarser downsampling of the frame before LM
+//   level 3  no loop candidate search (keyframes are still stored, so a later check finds them)
+//   level 4  frames waiting behind a newer one are dropped unmapped
+//
+// Each level is entered when the lag exceeds its threshold and left when the lag falls below
+// recover times the threshold of the level beneath, so a lag near a threshold does not flip the
+// level every frame.
+//
+//   load_governor governor(config);
+//   governor.update(lag);
+//   if(governor.skip(queued)) drop the frame;
+//   else odom.quality = governor.quality();
+
+#include "config.h"
+
+struct load_governor_config {
+    bool enable = false;
+    double thresholds[4] = { 0.2, 0.5, 1.0, 2.0 }; // s of lag entering levels 1 to 4
+    double recover = 0.5;
+    int lm_iterations = 10; // from level 1
+    float leaf = 0.4f;      // m, from level 2
+};
+
+struct load_governor {
+    static constexpr int max_level = 4;
+
+    explicit load_governor(const load_governor_config& config);
+
+    // lag of the frame about to be mapped, in s; the resulting level
+    int update(double lag);
+
+    int level() const {
+        return current;
+    }
+
+    registration_quality quality() const;
+
+    // whether to drop the frame at the head of a queue of queued frames; counts the dropped ones
+    bool skip(size_t queued);
+
+private:
+    load_governor_config config;
+    int current = 0;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __LOG_H__
+#define __LOG_H__
+
+// Logging for the headless core (features, odometry, loop closure), which must not depend on
+// rosconsole. Messages go to stderr unless a handler is installed; sync_node forwards them to
+// ROS_INFO/ROS_WARN/ROS_ERROR, an embedding process to its own logger.
+//
+//   HLOAM_WARN("flight recorder: cannot create %s", directory);
+
+enum log_level {
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+};
+
+// called with the formatted message, without a trailing newline, from any thread
+using log_handler = void (*)(log_level level, const char* message);
+
+// nullptr restores stderr; not synchronized with concurrent logging, install it at startup
+void set_log_handler(log_handler handler);
+
+void log_printf(log_level level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#define HLOAM_INFO(...) log_printf(LOG_LEVEL_INFO, __VA_ARGS__)
+#define HLOAM_WARN(...) log_printf(LOG_LEVEL_WARN, __VA_ARGS__)
+#define HLOAM_ERROR(...) log_printf(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#define __HLOAM_LOG_ONCE(level, ...)                                                             \
+    do {                                                                                         \
+        static bool __logged = false;                                                            \
+        if(!__logged) {                                                                          \
+            __logged = true;                                                                     \
+            log_printf(level, __VA_ARGS__);                                                      \
+        }                                                                                        \
+    } while(0)
+
+#define HLOAM_INFO_ONCE(...) __HLOAM_LOG_ONCE(LOG_LEVEL_INFO, __VA_ARGS__)
+#define HLOAM_WARN_ONCE(...) __HLOAM_LOG_ONCE(LOG_LEVEL_WARN, __VA_ARGS__)
+
+#endif
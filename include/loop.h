@@ -3,13 +3,16 @@
 
 #include "Scancontext.h"
 #include "comm.h"
+#include "quantized_cloud.h"
 
 #include <gtsam/geometry/Pose3.h>
 
 using LMTransform = ::Transform;
 
 struct velodyne_frame {
-    pcl::PointCloud<XYZIRT>::Ptr velodyne_cloud;
+    // the keyframe's scan, only read back as xyz for the loop ICP's local map; shared with the
+    // checkpoint writer. Null for the newest frame until keep_back() confirms it.
+    std::shared_ptr<const quantized_cloud> velodyne_cloud;
     Eigen::Matrix4d transform;
 };
 
@@ -34,8 +37,14 @@ struct loop_var {
     size_t min_constriant_node = 0;
     loop_var();
 
+    // stores the keyframe, then looks for a loop unless search is off (the check is then
+    // retried on the next keyframe). Its scan is only kept by keep_back(), once the frame is
+    // known to stay; otherwise pop_back() drops it.
     size_t loop_detection(const pcl::PointCloud<XYZIRT>::Ptr& cloud, const feature_objects& frame,
-                          const Eigen::Matrix4d& transform);
+                          const Eigen::Matrix4d& transform, bool search = true);
+
+    // quantizes the newest keyframe's scan
+    void keep_back(const pcl::PointCloud<XYZIRT>& cloud);
 
     void optimization(size_t from_id);
 
@@ -48,8 +57,17 @@ struct loop_var {
     }
 
     void pop_back();
+
+    // bytes held by the keyframe scans
+    size_t frames_footprint() const;
 };
 
+// aligns a downsampled scan against the local map around a scan context candidate, seeded with
+// the candidate's relative yaw
+Eigen::Matrix4d loop_icp(const pcl::PointCloud<PointType>::Ptr& source,
+                         const pcl::PointCloud<PointType>::Ptr& target, float yaw,
+                         float* loss = nullptr);
+
 Eigen::Matrix4d solve_GTSAM(const Eigen::Matrix4d& M1, const Eigen::Matrix4d& M2, float loss_M1,
                             float loss_M2);
 
@@ -0,0 +1,237 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+// Process-wide counters, gauges and histograms for pipeline health.
+//
+//   static auto& dropped = metrics_counter("frames_dropped");
+//   dropped.add();
+//
+// Lookups take a lock, so call sites keep the returned reference (metrics are never removed).
+// Updates are lock-free.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+inline void __atomic_add_double(std::atomic<double>& target, double value) {
+    double current = target.load(std::memory_order_relaxed);
+    while(!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        ;
+}
+
+struct metric_counter {
+    std::atomic<uint64_t> value{ 0 };
+
+    void add(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+struct metric_gauge {
+    std::atomic<double> value{ 0.0 };
+
+    void set(double v) {
+        value.store(v, std::memory_order_relaxed);
+    }
+
+    double get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// fixed upper-bound buckets; the last bucket catches everything above bounds.back()
+struct metric_histogram {
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<double> sum{ 0.0 };
+    std::atomic<double> max{ 0.0 };
+
+    explicit metric_histogram(std::vector<double> _bounds):
+        bounds(std::move(_bounds)), buckets(new std::atomic<uint64_t>[bounds.size() + 1]) {
+        std::sort(bounds.begin(), bounds.end());
+        for(size_t i = 0; i <= bounds.size(); i++)
+            buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    void observe(double v) {
+        size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), v) - bounds.begin();
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        __atomic_add_double(sum, v);
+
+        double current = max.load(std::memory_order_relaxed);
+        while(v > current && !max.compare_exchange_weak(current, v, std::memory_order_relaxed))
+            ;
+    }
+
+    double mean() const {
+        uint64_t n = count.load(std::memory_order_relaxed);
+        return n == 0 ? 0.0 : sum.load(std::memory_order_relaxed) / n;
+    }
+
+    // upper bound of the bucket holding the q-quantile, capped at the largest value seen
+    double quantile(double q) const {
+        uint64_t n = count.load(std::memory_order_relaxed);
+        double largest = max.load(std::memory_order_relaxed);
+        if(n == 0)
+            return 0.0;
+
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(q * n + 0.5)), seen = 0;
+        for(size_t i = 0; i < bounds.size(); i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if(seen >= rank)
+                return std::min(bounds[i], largest);
+        }
+        return largest;
+    }
+};
+
+struct metrics_registry {
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<metric_counter>> counters;
+    std::map<std::string, std::unique_ptr<metric_gauge>> gauges;
+    std::map<std::string, std::unique_ptr<metric_histogram>> histograms;
+};
+
+inline metrics_registry& metrics_state() {
+    static metrics_registry registry;
+    return registry;
+}
+
+inline metric_counter& metrics_counter(const std::string& name) {
+    auto& state = metrics_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto& m = state.counters[name];
+    if(m == nullptr)
+        m.reset(new metric_counter());
+    return *m;
+}
+
+inline metric_gauge& metrics_gauge(const std::string& name) {
+    auto& state = metrics_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto& m = state.gauges[name];
+    if(m == nullptr)
+        m.reset(new metric_gauge());
+    return *m;
+}
+
+// bounds only matter for the first lookup of a name
+inline metric_histogram& metrics_histogram(const std::string& name,
+                                           std::vector<double> bounds = { 1, 2, 5, 10, 20, 50,
+                                                                          100, 200, 500, 1000 }) {
+    auto& state = metrics_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto& m = state.histograms[name];
+    if(m == nullptr)
+        m.reset(new metric_histogram(std::move(bounds)));
+    return *m;
+}
+
+inline const char* metrics_csv_header() {
+    return "time,name,kind,value,count,mean,p50,p90,p99,max\n";
+}
+
+// one csv row per metric, all stamped with `time`
+inline void metrics_write_csv(FILE* fp, double time) {
+    auto& state = metrics_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    for(auto&& [name, c]: state.counters) {
+        fprintf(fp, "%.3f,%s,counter,%llu,,,,,,\n", time, name.c_str(),
+                (unsigned long long)c->get());
+    }
+
+    for(auto&& [name, g]: state.gauges) {
+        fprintf(fp, "%.3f,%s,gauge,%g,,,,,,\n", time, name.c_str(), g->get());
+    }
+
+    for(auto&& [name, h]: state.histograms) {
+        fprintf(fp, "%.3f,%s,histogram,,%llu,%g,%g,%g,%g,%g\n", time, name.c_str(),
+                (unsigned long long)h->count.load(), h->mean(), h->quantile(0.5),
+                h->quantile(0.9), h->quantile(0.99), h->max.load());
+    }
+}
+
+// single human readable block, one metric per line
+inline std::string metrics_summary() {
+    auto& state = metrics_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    std::string text;
+    char line[256];
+    for(auto&& [name, c]: state.counters) {
+        snprintf(line, sizeof(line), "%s: %llu\n", name.c_str(), (unsigned long long)c->get());
+        text += line;
+    }
+
+    for(auto&& [name, g]: state.gauges) {
+        snprintf(line, sizeof(line), "%s: %g\n", name.c_str(), g->get());
+        text += line;
+    }
+
+    for(auto&& [name, h]: state.histograms) {
+        snprintf(line, sizeof(line), "%s: n=%llu mean=%g p50=%g p90=%g max=%g\n", name.c_str(),
+                 (unsigned long long)h->count.load(), h->mean(), h->quantile(0.5),
+                 h->quantile(0.9), h->max.load());
+        text += line;
+    }
+    return text;
+}
+
+// every memory.* gauge on one line for the log, *_bytes in MiB:
+//   "memory: loop_frames 412.3M, rss 980.1M, scan_context 10.2M, ..."
+inline std::string metrics_memory_line() {
+    auto& state = metrics_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    const std::string prefix = "memory.", suffix = "_bytes";
+    std::string text = "memory:";
+    char item[128];
+    for(auto&& [name, g]: state.gauges) {
+        if(name.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        std::string label = name.substr(prefix.size());
+        bool bytes = label.size() > suffix.size() &&
+                     label.compare(label.size() - suffix.size(), suffix.size(), suffix) == 0;
+        if(bytes) {
+            label.resize(label.size() - suffix.size());
+            snprintf(item, sizeof(item), " %s %.1fM,", label.c_str(), g->get() / (1 << 20));
+        } else {
+            snprintf(item, sizeof(item), " %s %g,", label.c_str(), g->get());
+        }
+        text += item;
+    }
+    if(text.back() == ',')
+        text.pop_back();
+    return text;
+}
+
+// resident set size of the whole process, from /proc/self/statm
+inline size_t metrics_process_rss() {
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(fp == nullptr)
+        return 0;
+
+    unsigned long long pages = 0, resident = 0;
+    int n = fscanf(fp, "%llu %llu", &pages, &resident);
+    fclose(fp);
+    if(n != 2)
+        return 0;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+#endif
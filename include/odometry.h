@@ -0,0 +1,135 @@
+#ifndef __ODOMETRY_H__
+#define __ODOMETRY_H__
+
+// Frame-to-local-map registration (downsampling, the LM2 solver, the sliding local map) and the
+// keyframe/loop bookkeeping on top of it. Lives outside mapping.cpp so the benchmarks and the
+// offline runner can drive it without the ROS threads.
+
+#include "comm.h"
+#include "flight_recorder.h"
+#include "loop.h"
+
+#include <geometry_msgs/Pose.h>
+#include <nav_msgs/Path.h>
+#include <optional>
+#include <result_of>
+#include <visualization_msgs/Marker.h>
+
+void remove_degenerate(Eigen::Matrix<double, 6, 6>& ATA, double threshold);
+
+void downsample_surf2(const pcl::PointCloud<PointType>::Ptr& surface_points,
+                      pcl::PointCloud<PointType>::Ptr& downsampled_surface_points);
+
+feature_objects downsample(const feature_objects& input, float leaf = 0.2f);
+feature_frame downsample(const feature_frame& input, float leaf = 0.2f);
+
+Transform LM2(const feature_frame& this_features, const feature_frame& local_maps,
+              float degenerate_threshold, Transform initial = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+              float* loss = nullptr, int max_iterations = 30);
+
+bool feature_ok(const feature_objects& object);
+
+struct local_map {
+    constexpr static size_t previous_frame_count = 10;
+    feature_frame prev_frames[previous_frame_count];
+    Eigen::Matrix4d prev_frame_location[previous_frame_count];
+
+    size_t head = previous_frame_count - 1, counters = 0;
+
+    feature_frame local_map;
+    bool local_map_dirty = true;
+    const feature_frame& get_local_map();
+
+    feature_frame update_local_map() const;
+
+    void push(const feature_frame& frame, const Eigen::Matrix4d& transform);
+
+    bool empty() const {
+        return counters == 0;
+    }
+
+    size_t size() const {
+        return counters;
+    }
+
+    const Eigen::Matrix4d& tr() const {
+        assert(counters > 0);
+        return prev_frame_location[head];
+    }
+
+    void set(size_t back_index, const Eigen::Matrix4d& transform);
+
+    // bytes held by the frames of the window, and by the merged map built from them
+    size_t window_footprint() const;
+    size_t merged_footprint() const;
+};
+
+geometry_msgs::Pose to_ros_pose(const Eigen::Matrix4d& transform);
+Eigen::Matrix4d from_ros_pose(const geometry_msgs::Pose& pose);
+
+// writes the poses as TUM lines (stamp x y z qx qy qz qw)
+bool save_tum(const nav_msgs::Path& traces, const std::string& filename);
+
+struct visual_odom_v2 {
+    local_map local_maps;
+
+    Transform next_initial_guess;
+    Eigen::Matrix4d prev_transform = Eigen::Matrix4d::Identity();
+    Eigen::Matrix4d initial_pose = Eigen::Matrix4d::Identity(); // the first frame's
+    Eigen::Matrix4d tracked_pose = Eigen::Matrix4d::Identity(); // latest of mapping() or track()
+    ros::Time tracked_time;                                     // of the frame tracked_pose is at
+
+    float degenerate_threshold = 10.0f;
+    registration_quality quality;
+
+    loop_var loop;
+
+    visual_odom_v2_config config;
+
+    visualization_msgs::Marker loop_markers;
+    nav_msgs::Path final_path;
+
+    // gets every frame passed to mapping(), with the local map and loss it was registered with
+    flight_recorder* recorder = nullptr;
+    float last_loss = 0.0f;
+    feature_frame last_local_map;
+
+    visual_odom_v2(const visual_odom_v2_config& _config);
+
+    result_of<Transform, std::string> update_current_frame_LM2(const feature_frame& this_features,
+                                                               const feature_frame& M);
+
+    result_of<Transform, std::string> update_current_frame_GTSAM(const feature_frame& this_features,
+                                                                 const feature_frame& M);
+
+    result_of<Transform, std::string> update_current_frame(const feature_frame& this_features);
+
+    Eigen::Matrix4d loop_detection(const pcl::PointCloud<PointType>::Ptr& cloud,
+                                   const feature_objects& frame, const Eigen::Matrix4d& transform,
+                                   bool* has_loop);
+
+    // pose of the first frame, for starting in an existing map; only before the first frame
+    void set_initial_pose(const Eigen::Matrix4d& pose);
+
+    // registers one frame; the pose in the map, or nullopt when the frame was dropped
+    std::optional<Eigen::Matrix4d> mapping(const pcl::PointCloud<PointType>::Ptr& velodyne_cloud,
+                                           const feature_frame& frame, ros::Time time);
+
+    // registers livox features of a micro-sweep against the local map, seeded with the latest
+    // pose, and leaves the map and keyframes alone; the pose in the map, or nullopt before the
+    // first frame or when it did not converge
+    std::optional<Eigen::Matrix4d> track(const feature_objects& livox, ros::Time time);
+
+    // one line per loop constraint between the keyframes' current poses
+    void update_loop_markers();
+
+    // publishes the footprint of every long-lived structure as memory.* gauges
+    void report_memory();
+
+private:
+    void __update_tracked_pose(const Eigen::Matrix4d& registered, const Eigen::Matrix4d& M,
+                               ros::Time time);
+    void __record(ros::Time time, const feature_frame& frame, const Eigen::Matrix4d* pose);
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __OFFLINE_H__
+#define __OFFLINE_H__
+
+// Runs recorded scans through feature extraction, LM2 and loop closure on the calling thread,
+// without roscore, and reports throughput, per-stage latency and trajectory error.
+//
+// Frames are processed one after another, so the reported frames/s is the cost of the whole
+// pipeline per frame rather than what the threaded node achieves with feature extraction and
+// mapping overlapped.
+
+#include "comm.h"
+#include "odometry.h"
+
+#include <limits>
+#include <result_of>
+#include <string>
+#include <vector>
+
+// velodyne_dir and livox_dir may also name an archive written by pack_scans (see scan_archive.h),
+// which loads without parsing.
+struct offline_options {
+    std::string velodyne_dir;      // *.pcd, or KITTI *.bin (x y z intensity as float32)
+    std::string livox_dir;         // optional *.pcd, paired with the velodyne scans in order
+    std::string ground_truth;      // optional TUM trajectory of the velodyne frame
+    std::string trajectory_output; // optional, estimated keyframes as TUM
+
+    size_t first = 0;
+    size_t count = std::numeric_limits<size_t>::max();
+
+    // stamps for files whose names carry none (KITTI uses <velodyne_dir>/../times.txt)
+    double frame_period = 0.1;
+
+    // ring assignment for KITTI scans, which come without one (HDL-64E: +2.0 .. -24.8 deg)
+    int kitti_rings = 64;
+    float kitti_fov_up = 2.0f;
+    float kitti_fov_down = -24.8f;
+
+    // write every frame's features to a cache (see feature_cache.h) while running
+    std::string feature_cache_output;
+    bool cache_scans = true; // also the velodyne scans, which replay needs for loop closure
+
+    // replay a cache instead of scans: mapping only, the scan directories are not read
+    std::string feature_cache;
+
+    feature_config features;
+    visual_odom_v2_config odom;
+    float degenerate_threshold = 10.0f;
+};
+
+struct latency_summary {
+    std::string stage;
+    size_t count = 0;
+    double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0; // ms
+};
+
+// heap allocations per frame charged to one stage (alloc_tracker.h)
+struct alloc_summary {
+    std::string stage;
+    double allocations = 0.0; // mean
+    double bytes = 0.0;       // mean
+    uint64_t max_allocations = 0;
+};
+
+struct offline_report {
+    size_t frames = 0;
+    size_t dropped = 0;
+    size_t keyframes = 0;
+    size_t loops = 0;
+
+    double wall_seconds = 0.0; // feature extraction + mapping, scan loading excluded
+    double fps = 0.0;
+
+    std::vector<latency_summary> stages; // load, feature (empty on replay), mapping, total
+
+    // feature extraction and mapping, empty unless built with HLOAM_ENABLE_ALLOC_TRACKING
+    std::vector<alloc_summary> allocations;
+
+    // keyframes matched to ground truth by stamp; errors are RMSE in m and deg
+    size_t matched = 0;
+    double ate = 0.0;
+    double rpe_translation = 0.0;
+    double rpe_rotation = 0.0;
+};
+
+result_of<offline_report, std::string> run_offline(const offline_options& options);
+
+void print_offline_report(FILE* fp, const offline_report& report);
+
+// converts a scan directory into a scan archive, resolving stamps the way run_offline does;
+// the value is the number of frames written
+result_of<size_t, std::string> pack_scans(const std::string& dir, const offline_options& options,
+                                          const std::string& output);
+
+#endif
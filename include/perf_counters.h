@@ -0,0 +1,210 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+// Hardware counters (cycles, instructions, LLC misses, branch misses) around the hot kernels,
+// read through perf_event_open on the calling thread.
+//
+//   PERF_SCOPE(PERF_KERNEL_AB);
+//
+// Off by default (perf_counters_enable); a disabled scope costs one relaxed load. Counters are
+// per thread, which is exact here since the kernels run single-threaded (no -fopenmp). Needs
+// kernel.perf_event_paranoid <= 2 (or CAP_PERFMON); otherwise the first scope warns once and
+// the thread stops trying.
+
+#include "metrics.h"
+#include "trace.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum perf_kernel {
+    PERF_KERNEL_AB,
+    PERF_KERNEL_GET_FEATURES,
+    PERF_KERNEL_DETECT_FEATURE_POINT2,
+    PERF_KERNEL_SC_DISTANCE,
+    PERF_KERNEL_COUNT
+};
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+struct perf_totals {
+    std::atomic<uint64_t> values[PERF_KERNEL_COUNT][PERF_COUNTER_COUNT] = {};
+    std::atomic<uint64_t> calls[PERF_KERNEL_COUNT] = {};
+    std::atomic<bool> enabled{ false };
+};
+
+inline perf_totals& perf_state() {
+    static perf_totals totals;
+    return totals;
+}
+
+inline void perf_counters_enable(bool enable) {
+    perf_state().enabled.store(enable, std::memory_order_relaxed);
+}
+
+inline bool perf_counters_enabled() {
+    return perf_state().enabled.load(std::memory_order_relaxed);
+}
+
+// one counter group per thread, cycles as the leader so all four are scheduled together
+struct perf_group {
+    int fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1 };
+    bool opened = false;
+    bool failed = false;
+
+    ~perf_group() {
+        for(int fd: fds) {
+            if(fd >= 0)
+                close(fd);
+        }
+    }
+
+    bool open() {
+        if(opened || failed)
+            return opened;
+
+        const uint64_t configs[PERF_COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+
+        for(int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if(fds[i] < 0) {
+                static std::atomic<bool> warned{ false };
+                if(!warned.exchange(true)) {
+                    fprintf(stderr, "perf_event_open failed (%s), hardware counters disabled\n",
+                            strerror(errno));
+                }
+                failed = true;
+                return false;
+            }
+        }
+
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        opened = true;
+        return true;
+    }
+
+    bool read(uint64_t* values) const {
+        struct {
+            uint64_t nr;
+            uint64_t values[PERF_COUNTER_COUNT];
+        } data;
+
+        if(::read(fds[0], &data, sizeof(data)) != sizeof(data) || data.nr != PERF_COUNTER_COUNT)
+            return false;
+        memcpy(values, data.values, sizeof(data.values));
+        return true;
+    }
+};
+
+inline perf_group* perf_local_group() {
+    thread_local perf_group group;
+    return group.open() ? &group : nullptr;
+}
+
+struct perf_scope {
+    perf_kernel kernel;
+    perf_group* group = nullptr;
+    uint64_t begin[PERF_COUNTER_COUNT];
+
+    explicit perf_scope(perf_kernel _kernel): kernel(_kernel) {
+        if(!perf_counters_enabled())
+            return;
+
+        group = perf_local_group();
+        if(group != nullptr && !group->read(begin))
+            group = nullptr;
+    }
+
+    ~perf_scope() {
+        uint64_t end[PERF_COUNTER_COUNT];
+        if(group == nullptr || !group->read(end))
+            return;
+
+        auto& totals = perf_state();
+        for(int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            totals.values[kernel][i].fetch_add(end[i] - begin[i], std::memory_order_relaxed);
+        }
+        totals.calls[kernel].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    perf_scope(const perf_scope&) = delete;
+    perf_scope& operator=(const perf_scope&) = delete;
+};
+
+// Publishes what the kernels consumed since the previous call as metrics gauges
+// (perf.<kernel>.<counter>) and as counter tracks in the latency trace. Called once per frame
+// by the mapping thread; the feature kernels run one pipeline stage ahead, so their numbers
+// belong to the frame currently in feature extraction.
+inline void perf_report_frame() {
+    if(!perf_counters_enabled())
+        return;
+
+    static const char* names[PERF_KERNEL_COUNT][PERF_COUNTER_COUNT + 1] = {
+        { "perf.ab.cycles", "perf.ab.instructions", "perf.ab.llc_misses",
+          "perf.ab.branch_misses", "perf.ab.calls" },
+        { "perf.get_features.cycles", "perf.get_features.instructions",
+          "perf.get_features.llc_misses", "perf.get_features.branch_misses",
+          "perf.get_features.calls" },
+        { "perf.detect_feature_point2.cycles", "perf.detect_feature_point2.instructions",
+          "perf.detect_feature_point2.llc_misses", "perf.detect_feature_point2.branch_misses",
+          "perf.detect_feature_point2.calls" },
+        { "perf.sc_distance.cycles", "perf.sc_distance.instructions",
+          "perf.sc_distance.llc_misses", "perf.sc_distance.branch_misses",
+          "perf.sc_distance.calls" },
+    };
+
+    static uint64_t last[PERF_KERNEL_COUNT][PERF_COUNTER_COUNT + 1] = {};
+    static metric_gauge* gauges[PERF_KERNEL_COUNT][PERF_COUNTER_COUNT + 1] = {};
+
+    auto& totals = perf_state();
+    for(int k = 0; k < PERF_KERNEL_COUNT; k++) {
+        for(int i = 0; i <= PERF_COUNTER_COUNT; i++) {
+            uint64_t now =
+                i < PERF_COUNTER_COUNT ? totals.values[k][i].load() : totals.calls[k].load();
+            uint64_t delta = now - last[k][i];
+            last[k][i] = now;
+
+            if(gauges[k][i] == nullptr)
+                gauges[k][i] = &metrics_gauge(names[k][i]);
+            gauges[k][i]->set(delta);
+            trace_counter(names[k][i], delta);
+        }
+    }
+}
+
+#ifdef HLOAM_ENABLE_PERF
+#define PERF_SCOPE(kernel) perf_scope __TRACE_CONCAT(__perf_scope_, __LINE__)(kernel)
+#else
+#define PERF_SCOPE(kernel) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef __POLAR_BINS_H__
+#define __POLAR_BINS_H__
+
+// Compile-time tables mapping a point's (x, y) to an azimuth or range bin without atan2, sqrt
+// or ceil per point.
+//
+//   static constexpr azimuth_bins<60> sectors(0.0, 0);  // 6 deg bins from atan2(y, x) = 0
+//   int sector = sectors(p.x, p.y);                      // [0, 60)
+//   static constexpr range_bins<20> rings(80.0);
+//   int ring = rings(p.x * p.x + p.y * p.y);             // [0, 20), -1 beyond 80 m
+//
+// azimuth_bins keeps the unit vector of every bin edge, sorted by angle. The point's octant comes
+// from the signs of x, y and |x| - |y|, and minor / major of |x|, |y| picks a cell of a table
+// per octant, narrow enough to hold at most one edge. The cell gives the last edge before it;
+// the sign of the cross product edge x point decides whether the point is past the next one.
+// One division, no atan. range_bins does the same over the squared range, so no sqrt either.
+//
+// Azimuth bins are closed at their lower edge, range bins at their upper one. Against the
+// round/ceil formulas they replace, a point can land in the neighbouring bin only within float
+// precision of an edge (about 1e-5 deg, 1e-5 m); test/polar_bins_test.cpp checks both sides of
+// every edge.
+
+#include <array>
+#include <cstdint>
+
+// sin and cos of an angle in deg, for the tables only
+static constexpr double constexpr_sincos(double degrees, bool cosine) {
+    constexpr double pi = 3.14159265358979323846;
+    while(degrees >= 180.0)
+        degrees -= 360.0;
+    while(degrees < -180.0)
+        degrees += 360.0;
+
+    double x = degrees * pi / 180.0;
+    double term = cosine ? 1.0 : x, sum = term;
+    for(int n = cosine ? 2 : 3; n < 40; n += 2) {
+        term *= -x * x / ((n - 1) * n);
+        sum += term;
+    }
+    return sum;
+}
+
+// bins equal slices of the full turn, labelled from the bin starting at first_edge (deg,
+// counter-clockwise from +x) on
+template<int bins>
+struct azimuth_bins {
+    static_assert(bins >= 8 && bins <= 32767, "one int16 label per bin");
+
+    // slices of each octant by the ratio of the minor to the major coordinate; narrower than
+    // the bins (1 / cells < 2 pi / bins), so at most one edge falls into each
+    static constexpr int cells = bins / 4;
+
+    std::array<float, bins> edge_x = {}, edge_y = {};         // unit vectors, ascending from 0 deg
+    std::array<std::int16_t, bins> labels = {};               // of the bin starting at each edge
+    std::array<std::int16_t, 8 * (cells + 1)> cell_edge = {}; // last edge before the cell
+
+    constexpr azimuth_bins(double first_edge, int first_label) {
+        const double width = 360.0 / bins;
+        double first = first_edge;
+        while(first < 0.0)
+            first += 360.0;
+        while(first >= 360.0)
+            first -= 360.0;
+
+        // the edge closest above 0 deg comes first, skipped edges after first_edge
+        int skipped = int(first / width + 1e-9);
+        double start = first - skipped * width;
+        if(start < 0.0)
+            start = 0.0;
+
+        double angles[bins] = {};
+        for(int i = 0; i < bins; i++) {
+            angles[i] = start + i * width;
+            edge_x[i] = constexpr_sincos(angles[i], true);
+            edge_y[i] = constexpr_sincos(angles[i], false);
+            int label = (first_label - skipped + i) % bins;
+            labels[i] = label < 0 ? label + bins : label;
+        }
+
+        int begin = 0;
+        for(int o = 0; o < 8; o++) {
+            int end = begin;
+            while(end < bins && angles[end] < 45.0 * (o + 1))
+                end++;
+
+            // minor / major of each edge in the octant: the tangent of its angle from the x or y
+            // axis, whichever is closer; it falls with the angle in odd octants
+            double ratios[bins] = {};
+            for(int i = begin; i < end; i++) {
+                double from_axis = o % 2 == 0 ? angles[i] - 45.0 * o : 45.0 * (o + 1) - angles[i];
+                ratios[i] = constexpr_sincos(from_axis, false) / constexpr_sincos(from_axis, true);
+            }
+
+            for(int c = 0; c <= cells; c++) {
+                // the cell's lowest angle is at ratio c / cells in even octants, at its upper
+                // ratio in odd ones
+                double ratio = double(o % 2 == 0 ? c : (c < cells ? c + 1 : cells)) / cells;
+                int edge = begin;
+                while(edge < end && (o % 2 == 0 ? ratios[edge] <= ratio : ratios[edge] >= ratio))
+                    edge++;
+                cell_edge[o * (cells + 1) + c] = edge == 0 ? bins - 1 : edge - 1;
+            }
+            begin = end;
+        }
+    }
+
+    // octant of atan2(y, x), [0, 8), each one closed at its lower edge
+    static constexpr int octant(float x, float y) {
+        int o = 0;
+        if(y < 0.0f || (y == 0.0f && x < 0.0f)) {
+            o = 4;
+            x = -x;
+            y = -y;
+        }
+        if(x <= 0.0f) {
+            float t = x;
+            o += 2;
+            x = y;
+            y = -t;
+        }
+        return y >= x ? o + 1 : o;
+    }
+
+    constexpr int operator()(float x, float y) const {
+        float ax = x < 0.0f ? -x : x, ay = y < 0.0f ? -y : y;
+        float major = ax > ay ? ax : ay, minor = ax > ay ? ay : ax;
+        int cell = major > 0.0f ? int(minor / major * cells) : 0;
+
+        // the last edge before the cell, or the one in it if the point is past that
+        int edge = cell_edge[octant(x, y) * (cells + 1) + cell];
+        int next = edge + 1 == bins ? 0 : edge + 1;
+        if(edge_x[next] * y - edge_y[next] * x >= 0.0f)
+            edge = next;
+        return labels[edge];
+    }
+};
+
+// bins rings of equal width out to max_range, closed at their upper edge
+template<int bins>
+struct range_bins {
+    static_assert(bins >= 1 && bins <= 32767, "one int16 ring per cell");
+
+    // slices of the squared range, no wider than the innermost ring, so at most one squared edge
+    // falls into each
+    static constexpr int cells = bins * bins;
+
+    std::array<float, bins> squared_edges = {};         // upper edge of each ring, squared
+    std::array<std::int16_t, cells + 1> cell_ring = {}; // ring of the cell's lower end
+    float cell_scale = 0.0f;                            // cells / max_range^2
+
+    constexpr range_bins(double max_range) {
+        for(int i = 0; i < bins; i++) {
+            double edge = max_range * (i + 1) / bins;
+            squared_edges[i] = edge * edge;
+        }
+
+        int ring = 0;
+        for(int c = 0; c <= cells; c++) {
+            double lower = max_range * max_range * c / cells;
+            while(ring < bins - 1 && squared_edges[ring] < lower)
+                ring++;
+            cell_ring[c] = ring;
+        }
+        cell_scale = cells / (max_range * max_range);
+    }
+
+    // ring of a point x * x + y * y from the sensor, -1 beyond max_range
+    constexpr int operator()(float squared_range) const {
+        if(!(squared_range <= squared_edges[bins - 1]))
+            return -1;
+
+        int cell = int(squared_range * cell_scale);
+        int ring = cell_ring[cell < cells ? cell : cells];
+        return squared_range > squared_edges[ring] ? ring + 1 : ring;
+    }
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __QUANTIZED_CLOUD_H__
+#define __QUANTIZED_CLOUD_H__
+
+// Compact storage for map points that are kept long but only read back as xyz (+ intensity):
+// 16-bit offsets from an origin at a fixed resolution, 8 bytes a point instead of XYZIRT's 48.
+//
+//   quantized_cloud scan = quantized_cloud::fit(*cloud);  // origin and resolution from extent
+//   scan.decode(transform, *local_map);                    // appends the moved points
+//
+// At the default 1 cm a cloud spans 655 m per axis; fit() coarsens the resolution for a larger
+// one. Intensity is rounded to 0-255, ring and time are dropped. Both directions run as kernels
+// (kernels.h), so decoding costs no more than the transform it is fused with.
+//
+// Searches run on decoded clouds: the loop ICP decodes its local map once, moved into the
+// candidate's frame, and builds its kd-tree over that. A KNN over the int16 points themselves,
+// dequantizing inside the distance, is not done; the kd-trees used here only take float
+// coordinates. test/quantized_cloud_test.cpp checks the round trip, the clamping and that every
+// kernel variant gives the same bits.
+//
+// quantized_map tiles clouds in a global frame, each tile a quantized_cloud around its centre.
+
+#include "cloud.h"
+#include "kernels.h"
+
+#include <array>
+#include <map>
+#include <vector>
+
+struct quantized_cloud {
+    float origin[3] = { 0.0f, 0.0f, 0.0f };
+    float resolution = 0.01f; // m
+    std::vector<quantized_point> points;
+
+    quantized_cloud() = default;
+    quantized_cloud(const Eigen::Vector3f& origin, float resolution);
+
+    // centred on the cloud's bounding box, at resolution or the finest that covers it
+    static quantized_cloud fit(const pcl::PointCloud<PointType>& cloud, float resolution = 0.01f);
+
+    // points further than 32767 steps from the origin are clamped onto the boundary
+    void append(const PointType* begin, size_t count);
+
+    // appends the points, moved by transform, to out
+    void decode(const Eigen::Matrix4d& transform, pcl::PointCloud<PointType>& out) const;
+
+    size_t size() const {
+        return points.size();
+    }
+
+    bool empty() const {
+        return points.empty();
+    }
+
+    size_t bytes() const {
+        return points.capacity() * sizeof(quantized_point);
+    }
+};
+
+struct quantized_map {
+    float tile_size = 256.0f; // m, fits 1 cm offsets from the tile centre
+    float resolution = 0.01f;
+    std::map<std::array<int, 3>, quantized_cloud> tiles;
+
+    void insert(const pcl::PointCloud<PointType>& cloud);
+
+    // every tile's points, appended to out
+    void decode(pcl::PointCloud<PointType>& out) const;
+
+    size_t size() const;
+    size_t bytes() const;
+};
+
+#endif
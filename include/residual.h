@@ -31,14 +31,18 @@ struct feature_adapter {
 
 using feature_pair = std::pair<feature_objects, feature_adapter>;
 
+// rows [0, top) of A and b are the residuals; the rows past them are spare room
 struct newton {
     Eigen::MatrixXd A;
     Eigen::VectorXd b;
-    size_t top;
+    size_t top = 0;
 };
 
 newton Ab(std::initializer_list<feature_pair> pairs, const Transform& t = Transform(),
           float* _loss = nullptr);
+// the same into N, reusing its storage: no allocation once N has room for the pairs' points
+void Ab(std::initializer_list<feature_pair> pairs, newton& N, const Transform& t = Transform(),
+        float* _loss = nullptr);
 
 Transform LM(const feature_objects& source, const feature_objects& target,
              const Transform& initial_guess = Transform(), float* loss = nullptr);
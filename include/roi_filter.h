@@ -0,0 +1,40 @@
+#ifndef __ROI_FILTER_H__
+#define __ROI_FILTER_H__
+
+// Per-sensor crop applied to each scan as it is decoded, so points on the vehicle or beyond
+// useful range never reach sync, feature extraction or the copies in between.
+//
+//   roi_config config; config.enable = true; config.max_range = 100.0f;
+//   roi_filter(config, *cloud); // right after pcl::fromROSMsg
+//
+// A point is kept when it is within [min_range, max_range] of the sensor, inside box, within
+// the azimuth sector and outside every exclude box; of each ring's decoded points only every
+// stride-th is considered, so a velodyne scan is thinned along azimuth with every ring left in.
+// All in the sensor's own frame. The kept points stay in decode order, so the per-ring layout
+// the velodyne extractor relies on holds. One pass: kernels().crop_points.
+
+#include "cloud.h"
+
+#include <vector>
+
+struct roi_box {
+    float min[3];
+    float max[3];
+};
+
+struct roi_config {
+    bool enable = false;
+    float min_range = 0.0f; // m
+    float max_range = 0.0f; // m, 0: unbounded
+    roi_box box = { { -1e9f, -1e9f, -1e9f }, { 1e9f, 1e9f, 1e9f } };
+    // deg, atan2(y, x); kept counter-clockwise from azimuth_min to azimuth_max
+    float azimuth_min = -180.0f;
+    float azimuth_max = 180.0f;
+    std::vector<roi_box> exclude; // self-body
+    int stride = 1;
+};
+
+// drops the points of cloud outside config's region, in place; the number dropped
+size_t roi_filter(const roi_config& config, pcl::PointCloud<PointType>& cloud);
+
+#endif
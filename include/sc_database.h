@@ -0,0 +1,98 @@
+#ifndef __SC_DATABASE_H__
+#define __SC_DATABASE_H__
+
+// Scan context descriptors of a finished run with their keyframe poses, saved so a later session
+// can place itself in that run's map from its first scans.
+//
+//   save_sc_database("map.scdb", odom.loop);            // end of the mapping run
+//   sc_database db; db.open("map.scdb");                // next session, before the first frame
+//   auto pose = db.relocalize(*scan);                   // velodyne pose in the old map
+//
+// Layout (native endianness, every section on a 64-byte boundary):
+//   sc_database_header
+//   double[16] per keyframe    pose in the map, column-major
+//   float[rows] per keyframe   ring key, the kd-tree key
+//   double[cols] per keyframe  sector key, for the yaw pre-alignment
+//   double[rows * cols]        descriptor, column-major
+// open() maps the file and reads the sections in place; only the ring key tree is built.
+//
+// The pose relocalize() returns is coarse: the matched keyframe's pose turned by the yaw that
+// aligns the two descriptors, good to about a sector (6 degrees) and the keyframe spacing.
+// Registration refines it from the second frame on.
+
+#include "Scancontext.h"
+#include "loop.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <result_of>
+#include <string>
+
+struct sc_database_header {
+    char magic[8]; // "HLSCDB1"
+    std::uint32_t version;
+    std::uint32_t rows, cols;
+    std::uint32_t reserved;
+    std::uint64_t keyframes;
+    std::uint64_t poses_offset;
+    std::uint64_t ring_keys_offset;
+    std::uint64_t sector_keys_offset;
+    std::uint64_t descriptors_offset;
+};
+
+// the loop keyframes (optimized poses) and their descriptors; written to filename.tmp, then
+// renamed over filename
+bool save_sc_database(const std::string& filename, const loop_var& loop);
+
+struct sc_match {
+    size_t index;    // keyframe in the database
+    double distance; // scan context distance, below SCManager::SC_DIST_THRES
+    float yaw;       // rad, the scan's heading relative to the keyframe's
+};
+
+struct sc_key_tree;
+
+struct sc_database {
+    sc_database();
+    ~sc_database();
+
+    sc_database(const sc_database&) = delete;
+    sc_database& operator=(const sc_database&) = delete;
+
+    // the value is the number of keyframes
+    result_of<size_t, std::string> open(const std::string& filename);
+    void close();
+
+    size_t size() const {
+        return keyframes;
+    }
+
+    Eigen::Matrix4d pose(size_t i) const;
+    Eigen::Map<const Eigen::MatrixXd> descriptor(size_t i) const;
+
+    // best keyframe for a descriptor made by SCManager::makeScancontext, nullopt if none is
+    // close enough
+    std::optional<sc_match> query(const Eigen::MatrixXd& sc) const;
+
+    // velodyne pose of a raw scan in the database's map, nullopt if it was not recognized
+    std::optional<Eigen::Matrix4d> relocalize(const pcl::PointCloud<PointType>& scan,
+                                              sc_match* match = nullptr) const;
+
+private:
+    int fd = -1;
+    const std::uint8_t* base = nullptr;
+    size_t length = 0;
+    size_t keyframes = 0;
+    int rows = 0, cols = 0;
+
+    const double* poses = nullptr;
+    const float* ring_keys = nullptr;
+    const double* sector_keys = nullptr;
+    const double* descriptors = nullptr;
+
+    std::unique_ptr<sc_key_tree> tree;
+    mutable SCManager sc; // parameters and distance functions, which are not const
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef __SCAN_ARCHIVE_H__
+#define __SCAN_ARCHIVE_H__
+
+// Packed scan file for the offline tools: one stream of frames stored as raw PointType records,
+// so opening a frame is a pointer into a memory map instead of a PCD parse.
+//
+// Layout (native endianness, offsets from the start of the file):
+//   scan_archive_header
+//   frame data, each frame a run of sizeof(PointType) records starting on a 64-byte boundary
+//   scan_archive_entry[header.frames] at header.index_offset
+//
+// The records are the in-memory PointType, so an archive is only readable by a build with the
+// same point layout; open() rejects anything else.
+
+#include "comm.h"
+
+#include <cstdint>
+#include <result_of>
+#include <string>
+#include <vector>
+
+struct scan_archive_header {
+    char magic[8]; // "HLSCAN1"
+    std::uint32_t version;
+    std::uint32_t record_size; // sizeof(PointType) of the writer
+    std::uint64_t frames;
+    std::uint64_t index_offset;
+};
+
+struct scan_archive_entry {
+    double stamp; // s
+    std::uint64_t offset;
+    std::uint64_t count;
+};
+
+// points of one frame, valid as long as the archive stays open
+struct scan_view {
+    const PointType* points = nullptr;
+    size_t count = 0;
+    double stamp = NAN;
+
+    const PointType* begin() const {
+        return points;
+    }
+
+    const PointType* end() const {
+        return points + count;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    const PointType& operator[](size_t i) const {
+        return points[i];
+    }
+};
+
+// Frames are appended in order to <filename>.tmp; close() puts the index at its end and renames it
+// over filename. An archive not closed, or whose close() failed, is removed, so a pack that stops
+// partway never leaves a valid-looking truncated archive behind.
+struct scan_archive_writer {
+    scan_archive_writer() = default;
+    // abort() unless close() was called
+    ~scan_archive_writer();
+
+    scan_archive_writer(const scan_archive_writer&) = delete;
+    scan_archive_writer& operator=(const scan_archive_writer&) = delete;
+
+    bool open(const std::string& filename);
+    bool append(double stamp, const PointType* points, size_t count);
+    bool append(double stamp, const pcl::PointCloud<PointType>& cloud) {
+        return append(stamp, cloud.points.data(), cloud.size());
+    }
+    bool close();
+    // discards what was appended, filename is left as it was
+    void abort();
+
+    size_t size() const {
+        return index.size();
+    }
+
+private:
+    std::string filename;
+    FILE* fp = nullptr;
+    std::uint64_t offset = 0;
+    std::vector<scan_archive_entry> index;
+};
+
+struct scan_archive {
+    // frames past the one returned by frame() that the kernel is asked to page in ahead of use
+    size_t read_ahead = 4;
+
+    scan_archive() = default;
+    ~scan_archive();
+
+    scan_archive(const scan_archive&) = delete;
+    scan_archive& operator=(const scan_archive&) = delete;
+
+    // maps the whole file; the value is the number of frames
+    result_of<size_t, std::string> open(const std::string& filename);
+    void close();
+
+    size_t size() const {
+        return frames;
+    }
+
+    double stamp(size_t i) const {
+        return index[i].stamp;
+    }
+
+    // zero-copy view of frame i; also starts read-ahead of the frames after it
+    scan_view frame(size_t i) const;
+
+    // copies frame i into a cloud for the stages that need a PointCloud
+    void load(size_t i, pcl::PointCloud<PointType>& cloud) const;
+
+    // asynchronous, returns before the pages are resident
+    void prefetch(size_t first, size_t count) const;
+
+private:
+    int fd = -1;
+    const std::uint8_t* base = nullptr;
+    size_t length = 0;
+    const scan_archive_entry* index = nullptr;
+    size_t frames = 0;
+    mutable size_t prefetched = 0; // frames [0, prefetched) already requested
+};
+
+#endif
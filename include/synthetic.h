@@ -0,0 +1,96 @@
+#ifndef __SYNTHETIC_H__
+#define __SYNTHETIC_H__
+
+// Procedural scenes, scripted trajectories and ray-cast LiDAR models, so benchmarks and
+// offline runs do not need recorded data. Everything is seeded and deterministic.
+//
+// Scans use the XYZIRT layout the drivers produce: points in the sensor frame at their own
+// firing time (motion distortion included, nothing deskewed), `time` in seconds from the start
+// of the sweep and `ring` the laser index. Ground truth is the sensor pose at sweep start.
+
+#include "comm.h"
+
+#include <random>
+#include <vector>
+
+enum synthetic_scene_kind {
+    SCENE_CORRIDOR,     // walls with door recesses and pillars, floor and ceiling
+    SCENE_URBAN_CANYON, // street between building blocks, poles and parked cars
+    SCENE_OPEN_FIELD,   // ground with scattered trees and a few sheds
+};
+
+enum synthetic_trajectory_kind {
+    TRAJECTORY_STRAIGHT, // forward with a gentle weave
+    TRAJECTORY_LOOP,     // circle, revisits its start so loop closure triggers
+};
+
+struct synthetic_box {
+    Eigen::Vector3f min, max;
+};
+
+struct synthetic_pole {
+    float x, y, radius;
+    float bottom, top;
+};
+
+struct synthetic_trajectory {
+    synthetic_trajectory_kind kind = TRAJECTORY_STRAIGHT;
+    double speed = 5.0;   // m/s
+    double radius = 40.0; // TRAJECTORY_LOOP
+
+    Eigen::Matrix4d pose(double t) const;
+};
+
+struct synthetic_scene {
+    float ground = NAN;  // z of the floor/ground plane, NAN for none
+    float ceiling = NAN; // z of the ceiling plane, NAN for none
+    std::vector<synthetic_box> boxes;
+    std::vector<synthetic_pole> poles;
+
+    // range to the first surface along the unit direction, INFINITY if nothing within max_range
+    float cast(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction,
+               float max_range) const;
+
+    // copy holding only what can be hit from `origin` within max_range
+    synthetic_scene around(const Eigen::Vector3f& origin, float max_range) const;
+};
+
+// populates the neighbourhood of `duration` seconds of the trajectory
+synthetic_scene make_scene(synthetic_scene_kind kind, const synthetic_trajectory& trajectory,
+                           double duration, unsigned seed);
+
+struct spinning_model {
+    int rings = 16;
+    float fov_up = 15.0f, fov_down = -15.0f; // deg
+    int columns = 1800;
+    double period = 0.1;
+    float min_range = 0.5f, max_range = 100.0f;
+    float range_noise = 0.02f; // m, standard deviation
+};
+
+// VLP-16, HDL-32E and HDL-64E beam layouts
+spinning_model make_spinning_model(int rings);
+
+// Livox HAP-like: 120 x 25 deg, six beams tracing incommensurate Lissajous figures, so the
+// pattern never repeats and fills the field of view over time
+struct livox_model {
+    size_t points = 45000; // per frame, HAP emits ~452k points/s
+    float fov_horizontal = 120.0f, fov_vertical = 25.0f;
+    int beams = 6;
+    double period = 0.1;
+    float min_range = 0.5f, max_range = 150.0f;
+    float range_noise = 0.02f;
+    Eigen::Matrix4d extrinsic = Eigen::Matrix4d::Identity(); // livox -> velodyne frame
+};
+
+pcl::PointCloud<PointType>::Ptr scan_spinning(const synthetic_scene& scene,
+                                              const synthetic_trajectory& trajectory,
+                                              const spinning_model& model, double start,
+                                              std::mt19937& rng);
+
+pcl::PointCloud<PointType>::Ptr scan_livox(const synthetic_scene& scene,
+                                           const synthetic_trajectory& trajectory,
+                                           const livox_model& model, double start,
+                                           std::mt19937& rng);
+
+#endif
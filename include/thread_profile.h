@@ -0,0 +1,22 @@
+#ifndef __THREAD_PROFILE_H__
+#define __THREAD_PROFILE_H__
+
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+
+// scheduling placement of one pipeline thread, loaded from /hloam/threads/<name>/...
+struct thread_profile {
+    std::string name;
+    std::vector<int> cpus;        // empty: no pinning
+    std::string policy = "other"; // other, fifo or rr
+    int priority = 0;             // only used by fifo / rr
+    int nice = 0;                 // only used by other
+};
+
+thread_profile load_thread_profile(ros::NodeHandle* nh, const std::string& name);
+
+// applies the profile to the calling thread and logs the placement that actually took effect
+void apply_thread_profile(const thread_profile& profile);
+
+#endif
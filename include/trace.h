@@ -0,0 +1,189 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// Scoped latency trace points, exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+//   TRACE_SCOPE("registration.lm2_iteration");
+//
+// Names are "<stage>.<what>" string literals. Each thread records into its own ring buffer
+// without locks; the only lock is taken once per thread when its buffer is registered. Scopes
+// cost one relaxed load while tracing is disabled at runtime (trace_enable) and disappear
+// entirely when built without HLOAM_ENABLE_TRACE. With HLOAM_ENABLE_ALLOC_TRACKING the scopes
+// also mark the stage allocations are charged to (alloc_tracker.h), tracing enabled or not.
+
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+struct trace_event {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t duration_ns; // counter value for 'C' events
+    uint64_t frame;
+    char phase;           // 'X' span or 'C' counter sample
+};
+
+// written only by its owning thread; keeps the most recent `capacity` events
+struct trace_buffer {
+    static constexpr size_t capacity = 1 << 16;
+
+    std::unique_ptr<trace_event[]> events{ new trace_event[capacity] };
+    std::atomic<size_t> count{ 0 };
+    uint64_t frame = 0;
+    int tid = 0;
+    std::string thread_name;
+
+    void push(const char* name, uint64_t begin_ns, uint64_t duration_ns, char phase = 'X') {
+        size_t n = count.load(std::memory_order_relaxed);
+        events[n % capacity] = { name, begin_ns, duration_ns, frame, phase };
+        count.store(n + 1, std::memory_order_release);
+    }
+};
+
+struct trace_registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<trace_buffer>> buffers;
+    std::atomic<bool> enabled{ false };
+};
+
+inline trace_registry& trace_state() {
+    static trace_registry registry;
+    return registry;
+}
+
+inline bool trace_enabled() {
+    return trace_state().enabled.load(std::memory_order_relaxed);
+}
+
+inline void trace_enable(bool enable) {
+    trace_state().enabled.store(enable, std::memory_order_relaxed);
+}
+
+inline uint64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline trace_buffer& trace_local_buffer() {
+    thread_local std::shared_ptr<trace_buffer> buffer = [] {
+        auto b = std::make_shared<trace_buffer>();
+        b->tid = syscall(SYS_gettid);
+
+        char name[16] = { 0 };
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        b->thread_name = name;
+
+        // registry keeps the buffer alive after the thread exits, so it can still be exported
+        auto& state = trace_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.buffers.push_back(b);
+        return b;
+    }();
+    return *buffer;
+}
+
+// tags every following event of this thread with a frame id (e.g. the sensor stamp in ns)
+inline void trace_set_frame(uint64_t frame) {
+    if(trace_enabled())
+        trace_local_buffer().frame = frame;
+}
+
+// samples a counter track (shown as a graph next to the spans)
+inline void trace_counter(const char* name, uint64_t value) {
+    if(trace_enabled())
+        trace_local_buffer().push(name, trace_now_ns(), value, 'C');
+}
+
+struct trace_scope {
+    const char* name;
+    uint64_t begin_ns;
+#ifdef HLOAM_ENABLE_ALLOC_TRACKING
+    int alloc_previous;
+#endif
+
+    explicit trace_scope(const char* _name): name(_name), begin_ns(0) {
+#ifdef HLOAM_ENABLE_ALLOC_TRACKING
+        alloc_previous = alloc_enter_stage(alloc_stage_of(_name));
+#endif
+        if(trace_enabled())
+            begin_ns = trace_now_ns();
+    }
+
+    ~trace_scope() {
+        if(begin_ns != 0)
+            trace_local_buffer().push(name, begin_ns, trace_now_ns() - begin_ns);
+#ifdef HLOAM_ENABLE_ALLOC_TRACKING
+        alloc_leave_stage(alloc_previous);
+#endif
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+};
+
+// Writes every recorded event as Chrome trace JSON. Meant to run once the pipeline threads have
+// stopped; events still being written concurrently may come out torn.
+inline bool trace_export_chrome(const std::string& filename) {
+    FILE* fp = fopen(filename.c_str(), "w");
+    if(fp == nullptr)
+        return false;
+
+    std::vector<std::shared_ptr<trace_buffer>> buffers;
+    {
+        auto& state = trace_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        buffers = state.buffers;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for(auto&& b: buffers) {
+        fprintf(fp, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", b->tid, b->thread_name.c_str());
+        first = false;
+
+        size_t count = b->count.load(std::memory_order_acquire);
+        size_t begin = count > trace_buffer::capacity ? count - trace_buffer::capacity : 0;
+        for(size_t i = begin; i < count; i++) {
+            const trace_event& e = b->events[i % trace_buffer::capacity];
+            if(e.phase == 'C') {
+                fprintf(fp, ",\n{\"ph\":\"C\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+                        "\"args\":{\"value\":%llu}}",
+                        e.name, b->tid, e.begin_ns / 1000.0, (unsigned long long)e.duration_ns);
+                continue;
+            }
+            fprintf(fp, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                    e.name, b->tid, e.begin_ns / 1000.0, e.duration_ns / 1000.0,
+                    (unsigned long long)e.frame);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return true;
+}
+
+#define __TRACE_CONCAT2(a, b) a##b
+#define __TRACE_CONCAT(a, b) __TRACE_CONCAT2(a, b)
+
+#ifdef HLOAM_ENABLE_TRACE
+#define TRACE_SCOPE(name) trace_scope __TRACE_CONCAT(__trace_scope_, __LINE__)(name)
+#define TRACE_FRAME(frame) trace_set_frame(frame)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FRAME(frame) ((void)0)
+#endif
+
+#endif
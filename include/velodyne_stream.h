@@ -0,0 +1,57 @@
+#ifndef __VELODYNE_STREAM_H__
+#define __VELODYNE_STREAM_H__
+
+// Velodyne features extracted sector by sector while the sweep comes in, for drivers publishing
+// each turn as several partial scans (e.g. velodyne_driver with npackets set to a fraction of a
+// revolution). Each part has its features picked as soon as it is decoded, on the callback
+// thread that would otherwise wait for the next part; when the last one arrives the sweep is
+// put together and synced with its features ready, so the feature thread skips the velodyne
+// extractor and registration starts right after the livox coverage is there.
+//
+//   velodyne_stream stream(6);
+//   if(auto sweep = stream.push(cloud, stamp)) queue sweep->cloud with sweep->features;
+//
+// A part is extracted as a sweep of its own with 6 / sectors slices per ring, which lines up
+// with the whole-sweep extractor's 6 slices. The 5 points at either end of each ring of a part
+// have no curvature, so edges are not picked right at a sector seam.
+//
+// Sweeps start where the first part received did: a part whose first firing is within half a
+// part's width of that azimuth starts the next sweep, which is complete after sectors parts. A
+// starting part arriving early means one was lost, and the incomplete sweep is dropped; parts
+// after a lost starting one are dropped until the next starts, so every sweep covers the same
+// turn of the sensor.
+
+#include "comm.h"
+
+#include <cmath>
+#include <optional>
+
+struct velodyne_sweep {
+    pcl::PointCloud<PointType>::Ptr cloud; // the parts in order, point times absolute
+    feature_objects features;
+    double time; // stamp of the first part
+};
+
+struct velodyne_stream {
+    explicit velodyne_stream(int sectors);
+
+    // one partial scan; the completed sweep after its last part
+    std::optional<velodyne_sweep> push(const pcl::PointCloud<PointType>::Ptr& part, double stamp);
+
+    // incomplete sweeps dropped for a lost part
+    size_t dropped() const {
+        return dropped_sweeps;
+    }
+
+private:
+    void __reset();
+
+    int sectors;
+    int received = 0;
+    double start_azimuth = NAN; // rad, of the first firing of a sweep; from the first part
+    size_t dropped_sweeps = 0;
+
+    velodyne_sweep pending;
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "Scancontext.h"
 
+#include "kernels.h"
+
+#include "perf_counters.h"
+#include "polar_bins.h"
+
 // namespace SC2
 // {
 
@@ -97,6 +102,8 @@ int SCManager::fastAlignUsingVkey(const Eigen::MatrixXd& _vkey1, const Eigen::Ma
 
 std::pair<double, int> SCManager::distanceBtnScanContext(const Eigen::MatrixXd& _sc1,
                                                          const Eigen::MatrixXd& _sc2) {
+    PERF_SCOPE(PERF_KERNEL_SC_DISTANCE);
+
     // 1. fast align using variant key (not in original IROS18)
     Eigen::MatrixXd vkey_sc1 = makeSectorkeyFromScancontext(_sc1);
     Eigen::MatrixXd vkey_sc2 = makeSectorkeyFromScancontext(_sc2);
@@ -114,8 +121,8 @@ std::pair<double, int> SCManager::distanceBtnScanContext(const Eigen::MatrixXd&
     int argmin_shift = 0;
     double min_sc_dist = 10000000;
     for(int num_shift: shift_idx_search_space) {
-        Eigen::MatrixXd sc2_shifted = circshift(_sc2, num_shift);
-        double cur_sc_dist = distDirectSC(_sc1, sc2_shifted);
+        double cur_sc_dist =
+            kernels().sc_distance(_sc1.data(), _sc2.data(), _sc1.rows(), _sc1.cols(), num_shift);
         if(cur_sc_dist < min_sc_dist) {
             argmin_shift = num_shift;
             min_sc_dist = cur_sc_dist;
@@ -134,31 +141,24 @@ Eigen::MatrixXd SCManager::makeScancontext(const pcl::PointCloud<SCPointType>& _
     const int NO_POINT = -1000;
     Eigen::MatrixXd desc = NO_POINT * Eigen::MatrixXd::Ones(PC_NUM_RING, PC_NUM_SECTOR);
 
-    SCPointType pt;
-    float azim_angle, azim_range; // wihtin 2d plane
-    int ring_idx, sctor_idx;
+    // ring ceil(range / PC_UNIT_RINGGAP) - 1 and sector ceil(xy2theta / PC_UNIT_SECTORANGLE) - 1,
+    // looked up without the sqrt and atan
+    static constexpr range_bins<PC_NUM_RING> rings(PC_MAX_RADIUS);
+    static constexpr azimuth_bins<PC_NUM_SECTOR> sectors(0.0, 0);
     for(int pt_idx = 0; pt_idx < num_pts_scan_down; pt_idx++) {
-        pt.x = _scan_down.points[pt_idx].x;
-        pt.y = _scan_down.points[pt_idx].y;
-        pt.z = _scan_down.points[pt_idx].z +
-            LIDAR_HEIGHT; // naive adding is ok (all points should be > 0).
-
-        // xyz to ring, sector
-        azim_range = sqrt(pt.x * pt.x + pt.y * pt.y);
-        azim_angle = xy2theta(pt.x, pt.y);
+        const SCPointType& pt = _scan_down.points[pt_idx];
 
         // if range is out of roi, pass
-        if(azim_range > PC_MAX_RADIUS)
+        int ring_idx = rings(pt.x * pt.x + pt.y * pt.y);
+        if(ring_idx < 0)
             continue;
 
-        ring_idx = std::max(
-            std::min(PC_NUM_RING, int(ceil((azim_range / PC_MAX_RADIUS) * PC_NUM_RING))), 1);
-        sctor_idx =
-            std::max(std::min(PC_NUM_SECTOR, int(ceil((azim_angle / 360.0) * PC_NUM_SECTOR))), 1);
+        int sctor_idx = sectors(pt.x, pt.y);
+        float z = pt.z + LIDAR_HEIGHT; // naive adding is ok (all points should be > 0).
 
         // taking maximum z
-        if(desc(ring_idx - 1, sctor_idx - 1) < pt.z)  // -1 means cpp starts from 0
-            desc(ring_idx - 1, sctor_idx - 1) = pt.z; // update for taking maximum value at that bin
+        if(desc(ring_idx, sctor_idx) < z)
+            desc(ring_idx, sctor_idx) = z; // update for taking maximum value at that bin
     }
 
     // reset no points to zero (for cosine dist later)
@@ -197,7 +197,10 @@ Eigen::MatrixXd SCManager::makeSectorkeyFromScancontext(const Eigen::MatrixXd& _
 } // SCManager::makeSectorkeyFromScancontext
 
 void SCManager::makeAndSaveScancontextAndKeys(const pcl::PointCloud<SCPointType>& _scan_down) {
-    Eigen::MatrixXd sc = makeScancontext(_scan_down); // v1
+    saveScancontextAndKeys(makeScancontext(_scan_down)); // v1
+} // SCManager::makeAndSaveScancontextAndKeys
+
+void SCManager::saveScancontextAndKeys(const Eigen::MatrixXd& sc) {
     Eigen::MatrixXd ringkey = makeRingkeyFromScancontext(sc);
     Eigen::MatrixXd sectorkey = makeSectorkeyFromScancontext(sc);
     std::vector<float> polarcontext_invkey_vec = eig2stdvec(ringkey);
@@ -209,7 +212,28 @@ void SCManager::makeAndSaveScancontextAndKeys(const pcl::PointCloud<SCPointType>
 
     // cout <<polarcontext_vkeys_.size() << endl;
 
-} // SCManager::makeAndSaveScancontextAndKeys
+} // SCManager::saveScancontextAndKeys
+
+size_t SCManager::memory_footprint() const {
+    size_t bytes = 0;
+    for(auto descriptors: { &polarcontexts_, &polarcontext_invkeys_, &polarcontext_vkeys_ }) {
+        bytes += descriptors->capacity() * sizeof(Eigen::MatrixXd);
+        for(auto&& m: *descriptors) {
+            bytes += m.size() * sizeof(double);
+        }
+    }
+
+    for(auto keys: { &polarcontext_invkeys_mat_, &polarcontext_invkeys_to_search_ }) {
+        bytes += keys->capacity() * sizeof(std::vector<float>);
+        for(auto&& key: *keys) {
+            bytes += key.capacity() * sizeof(float);
+        }
+    }
+
+    if(polarcontext_tree_ != nullptr)
+        bytes += polarcontext_tree_->index->usedMemory(*polarcontext_tree_->index);
+    return bytes;
+}
 
 std::pair<int, float> SCManager::detectLoopClosureID(void) {
     int loop_id{
@@ -0,0 +1,117 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <cerrno>
+#include <malloc.h>
+
+// glibc's own entry points; everything below forwards to them after counting. Nothing here may
+// allocate, and the thread locals use the initial-exec model so that touching them never does.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+#define ALLOC_TLS __attribute__((tls_model("initial-exec")))
+
+static thread_local int current_stage ALLOC_TLS = ALLOC_STAGE_OTHER;
+static thread_local uint64_t thread_allocations ALLOC_TLS = 0;
+
+struct alloc_stage_counters {
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
+
+static alloc_stage_counters counters[ALLOC_STAGE_COUNT];
+
+static inline void count_allocation(void* ptr, size_t size) {
+    if(ptr == nullptr)
+        return;
+
+    auto& c = counters[current_stage];
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+    thread_allocations++;
+}
+
+static inline void count_free(void* ptr) {
+    if(ptr != nullptr)
+        counters[current_stage].frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+alloc_snapshot alloc_totals() {
+    alloc_snapshot snapshot;
+    for(int i = 0; i < ALLOC_STAGE_COUNT; i++) {
+        snapshot.stages[i].allocations = counters[i].allocations.load(std::memory_order_relaxed);
+        snapshot.stages[i].frees = counters[i].frees.load(std::memory_order_relaxed);
+        snapshot.stages[i].bytes = counters[i].bytes.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+uint64_t alloc_thread_allocations() {
+    return thread_allocations;
+}
+
+int alloc_enter_stage(alloc_stage stage) {
+    int previous = current_stage;
+    current_stage = stage;
+    return previous;
+}
+
+void alloc_leave_stage(int previous) {
+    current_stage = previous;
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    count_allocation(ptr, size);
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* ptr = __libc_calloc(count, size);
+    count_allocation(ptr, count * size);
+    return ptr;
+}
+
+// a resize counts as a free of the old block and an allocation of the new one
+void* realloc(void* ptr, size_t size) {
+    void* result = __libc_realloc(ptr, size);
+    if(result != nullptr || size == 0)
+        count_free(ptr);
+    count_allocation(result, size);
+    return result;
+}
+
+void free(void* ptr) {
+    count_free(ptr);
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    count_allocation(ptr, size);
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+    if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    void* ptr = memalign(alignment, size);
+    if(ptr == nullptr && size != 0)
+        return ENOMEM;
+    *out = ptr;
+    return 0;
+}
+}
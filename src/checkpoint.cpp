@@ -0,0 +1,562 @@
+#include "checkpoint.h"
+
+#include "metrics.h"
+#include "odometry.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char checkpoint_magic[8] = "HLCKPT1";
+static constexpr char keyframe_log_magic[8] = "HLKEYF1";
+static constexpr std::uint32_t checkpoint_version = 2; // 2: quantized keyframe scans
+static constexpr std::uint64_t keyframe_log_alignment = 64;
+static constexpr std::uint64_t no_cloud = UINT64_MAX;
+
+struct checkpoint_snapshot {
+    double stamp = 0.0;
+    std::vector<checkpoint_pose> path;
+    std::vector<Eigen::Matrix4d> keyframes;
+    std::vector<loop_result> constraints;
+
+    // keyframes [first_new, keyframes.size()) are not in the log yet
+    size_t first_new = 0;
+    std::vector<std::shared_ptr<const quantized_cloud>> new_scans;
+    std::vector<Eigen::MatrixXd> new_descriptors;
+    int sc_rows = 0, sc_cols = 0;
+
+    feature_frame window[local_map::previous_frame_count];
+    Eigen::Matrix4d window_pose[local_map::previous_frame_count];
+    size_t window_head = 0, window_size = 0;
+
+    Transform next_initial_guess;
+    Eigen::Matrix4d prev_transform = Eigen::Matrix4d::Identity();
+    int loop_counter = 0;
+    size_t min_constraint_node = 0;
+};
+
+template<typename T>
+static void put(std::vector<char>& buffer, const T* data, size_t count) {
+    const char* bytes = reinterpret_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + count * sizeof(T));
+}
+
+template<typename T>
+static void put(std::vector<char>& buffer, const T& value) {
+    put(buffer, &value, 1);
+}
+
+static void put_cloud_count(std::vector<char>& buffer, const pcl::PointCloud<PointType>::Ptr& c) {
+    put(buffer, c == nullptr ? no_cloud : std::uint64_t(c->size()));
+}
+
+static void put_cloud(std::vector<char>& buffer, const pcl::PointCloud<PointType>::Ptr& c) {
+    if(c != nullptr)
+        put(buffer, c->points.data(), c->size());
+}
+
+checkpointer::checkpointer(const checkpoint_config& config): config(config) {
+    if(enabled()) {
+        mkdir(config.path.c_str(), 0755);
+        writer = std::thread(&checkpointer::__writer_thread, this);
+    }
+}
+
+checkpointer::~checkpointer() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        should_stop = true;
+    }
+    cv.notify_all();
+    if(writer.joinable())
+        writer.join();
+    if(log != nullptr)
+        fclose(log);
+}
+
+size_t checkpointer::written() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+void checkpointer::update(ros::Time time, const visual_odom_v2& odom, bool force) {
+    if(!enabled())
+        return;
+
+    double now = time.toSec();
+    if(!force && now - last_checkpoint < config.interval)
+        return;
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if(busy && !force)
+            return;
+        cv.wait(guard, [this] { return !busy; });
+        // a failed write starts the keyframe log over
+        if(log_index.size() < captured)
+            captured = log_index.size();
+    }
+    last_checkpoint = now;
+
+    TRACE_SCOPE("checkpoint.capture");
+    auto snapshot = std::make_unique<checkpoint_snapshot>();
+    snapshot->stamp = now;
+
+    snapshot->path.reserve(odom.final_path.poses.size());
+    for(auto&& pose: odom.final_path.poses) {
+        const auto& p = pose.pose;
+        snapshot->path.push_back({ pose.header.stamp.toSec(), p.position.x, p.position.y,
+                                   p.position.z, p.orientation.x, p.orientation.y,
+                                   p.orientation.z, p.orientation.w });
+    }
+
+    const auto& loop = odom.loop;
+    snapshot->keyframes.reserve(loop.frames.size());
+    for(auto&& frame: loop.frames) {
+        snapshot->keyframes.push_back(frame.transform);
+    }
+    snapshot->constraints = loop.loop;
+
+    // keyframe scans and descriptors are append-only, so only the new ones are copied
+    snapshot->first_new = captured;
+    for(size_t i = captured; i < loop.frames.size(); i++) {
+        snapshot->new_scans.push_back(loop.frames[i].velodyne_cloud);
+        snapshot->new_descriptors.push_back(loop.sc_manager.polarcontexts_[i]);
+    }
+    captured = loop.frames.size();
+    snapshot->sc_rows = loop.sc_manager.PC_NUM_RING;
+    snapshot->sc_cols = loop.sc_manager.PC_NUM_SECTOR;
+
+    const auto& window = odom.local_maps;
+    for(size_t i = 0; i < window.counters; i++) {
+        snapshot->window[i] = window.prev_frames[i];
+        snapshot->window_pose[i] = window.prev_frame_location[i];
+    }
+    snapshot->window_head = window.head;
+    snapshot->window_size = window.counters;
+
+    snapshot->next_initial_guess = odom.next_initial_guess;
+    snapshot->prev_transform = odom.prev_transform;
+    snapshot->loop_counter = loop.loop_counter;
+    snapshot->min_constraint_node = loop.min_constriant_node;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending = std::move(snapshot);
+        busy = true;
+    }
+    cv.notify_all();
+}
+
+void checkpointer::__writer_thread() {
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+        cv.wait(guard, [this] { return should_stop || pending != nullptr; });
+        if(pending == nullptr)
+            break;
+
+        auto snapshot = std::move(pending);
+        guard.unlock();
+        bool success = __write(*snapshot);
+        snapshot.reset(); // drops the cloud references off the mapping thread
+        guard.lock();
+
+        busy = false;
+        if(success)
+            count++;
+        cv.notify_all();
+    }
+}
+
+bool checkpointer::__append_keyframes(checkpoint_snapshot& snapshot) {
+    std::string filename = config.path + "/keyframes";
+
+    if(log == nullptr && run_id != 0) {
+        // continuing a restored run: drop whatever a crash left past the restored state
+        log = fopen(filename.c_str(), "r+b");
+        if(log == nullptr || ftruncate(fileno(log), log_length) != 0 ||
+           fseek(log, log_length, SEEK_SET) != 0)
+            return false;
+    } else if(log == nullptr) {
+        std::random_device entropy;
+        run_id = (std::uint64_t(entropy()) << 32 | entropy()) ^
+            std::chrono::steady_clock::now().time_since_epoch().count();
+        log_index.clear();
+
+        log = fopen(filename.c_str(), "wb");
+        if(log == nullptr)
+            return false;
+
+        keyframe_log_header header = {};
+        memcpy(header.magic, keyframe_log_magic, sizeof(header.magic));
+        header.version = checkpoint_version;
+        header.run_id = run_id;
+        if(fwrite(&header, sizeof(header), 1, log) != 1)
+            return false;
+        log_length = sizeof(header);
+    }
+
+    if(snapshot.first_new != log_index.size())
+        return false;
+
+    static const char zeros[keyframe_log_alignment] = {};
+    static const quantized_cloud no_scan;
+    for(size_t i = 0; i < snapshot.new_scans.size(); i++) {
+        size_t padding = (keyframe_log_alignment - log_length % keyframe_log_alignment) %
+                         keyframe_log_alignment;
+        if(padding > 0 && fwrite(zeros, 1, padding, log) != padding)
+            return false;
+        log_length += padding;
+
+        const auto& descriptor = snapshot.new_descriptors[i];
+        if(descriptor.rows() != snapshot.sc_rows || descriptor.cols() != snapshot.sc_cols ||
+           fwrite(descriptor.data(), sizeof(double), descriptor.size(), log) !=
+               (size_t)descriptor.size())
+            return false;
+
+        const auto& scan = snapshot.new_scans[i] != nullptr ? *snapshot.new_scans[i] : no_scan;
+        keyframe_scan scan_header = { { scan.origin[0], scan.origin[1], scan.origin[2] },
+                                      scan.resolution };
+        size_t points = scan.size();
+        if(fwrite(&scan_header, sizeof(scan_header), 1, log) != 1 ||
+           (points > 0 &&
+            fwrite(scan.points.data(), sizeof(quantized_point), points, log) != points))
+            return false;
+
+        log_index.push_back({ log_length, points });
+        log_length += descriptor.size() * sizeof(double) + sizeof(scan_header) +
+                      points * sizeof(quantized_point);
+    }
+
+    // the state written next points into this, so it has to be on disk first
+    return fflush(log) == 0 && fdatasync(fileno(log)) == 0;
+}
+
+bool checkpointer::__write(checkpoint_snapshot& snapshot) {
+    TRACE_SCOPE("checkpoint.write");
+    static auto& checkpoints = metrics_counter("checkpoint.written");
+    static auto& failures = metrics_counter("checkpoint.failed");
+    static auto& bytes = metrics_gauge("checkpoint.log_bytes");
+
+    if(!__append_keyframes(snapshot)) {
+        HLOAM_WARN("checkpoint: cannot append to %s/keyframes, starting a new log",
+                   config.path.c_str());
+        if(log != nullptr)
+            fclose(log);
+        log = nullptr;
+        run_id = 0;
+        log_index.clear();
+        failures.add();
+        return false;
+    }
+
+    checkpoint_header header = {};
+    memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.version = checkpoint_version;
+    header.record_size = sizeof(PointType);
+    header.run_id = run_id;
+    header.log_length = log_length;
+    header.stamp = snapshot.stamp;
+    header.sc_rows = snapshot.sc_rows;
+    header.sc_cols = snapshot.sc_cols;
+    header.path = snapshot.path.size();
+    header.keyframes = snapshot.keyframes.size();
+    header.constraints = snapshot.constraints.size();
+    header.window_head = snapshot.window_head;
+    header.window_size = snapshot.window_size;
+    header.loop_counter = snapshot.loop_counter;
+    header.min_constraint_node = snapshot.min_constraint_node;
+    memcpy(header.prev_transform, snapshot.prev_transform.data(), sizeof(header.prev_transform));
+    const auto& guess = snapshot.next_initial_guess;
+    double next_initial_guess[6] = { guess.x,    guess.y,     guess.z,
+                                     guess.roll, guess.pitch, guess.yaw };
+    memcpy(header.next_initial_guess, next_initial_guess, sizeof(next_initial_guess));
+
+    std::vector<char> buffer;
+    put(buffer, header);
+    put(buffer, snapshot.path.data(), snapshot.path.size());
+
+    for(size_t i = 0; i < snapshot.keyframes.size(); i++) {
+        checkpoint_keyframe keyframe;
+        memcpy(keyframe.pose, snapshot.keyframes[i].data(), sizeof(keyframe.pose));
+        keyframe.offset = log_index[i].offset;
+        keyframe.count = log_index[i].count;
+        put(buffer, keyframe);
+    }
+
+    for(auto&& c: snapshot.constraints) {
+        checkpoint_constraint constraint = { c.source_frame_id, c.target_frame_id, {} };
+        Eigen::Matrix4d pose = c.transform.matrix();
+        memcpy(constraint.pose, pose.data(), sizeof(constraint.pose));
+        put(buffer, constraint);
+    }
+
+    for(size_t i = 0; i < snapshot.window_size; i++) {
+        put(buffer, snapshot.window_pose[i].data(), 16);
+        auto clouds = clouds_of(snapshot.window[i]);
+        for(auto cloud: clouds) {
+            put_cloud_count(buffer, *cloud);
+        }
+        for(auto cloud: clouds) {
+            put_cloud(buffer, *cloud);
+        }
+    }
+
+    std::string filename = config.path + "/state";
+    std::string temporary = filename + ".tmp";
+    FILE* fp = fopen(temporary.c_str(), "wb");
+    bool written = fp != nullptr && fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size() &&
+                   fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if(fp != nullptr)
+        written = fclose(fp) == 0 && written;
+    if(!written || rename(temporary.c_str(), filename.c_str()) != 0) {
+        HLOAM_WARN("checkpoint: cannot write %s", filename.c_str());
+        failures.add();
+        return false;
+    }
+
+    checkpoints.add();
+    bytes.set(log_length);
+    return true;
+}
+
+// read-only mapping of a whole file
+struct mapped_file {
+    const std::uint8_t* data = nullptr;
+    size_t length = 0;
+
+    ~mapped_file() {
+        if(data != nullptr)
+            munmap(const_cast<std::uint8_t*>(data), length);
+    }
+
+    bool open(const std::string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED)
+            return false;
+
+        data = static_cast<const std::uint8_t*>(mapped);
+        length = st.st_size;
+        return true;
+    }
+};
+
+// bounds-checked sequential reads from a mapped file
+struct checkpoint_reader {
+    const std::uint8_t* cursor;
+    const std::uint8_t* end;
+
+    // whether count records of T are left; the counts come from the file, so nothing is sized
+    // by one before this
+    template<typename T>
+    bool fits(std::uint64_t count) const {
+        return count <= size_t(end - cursor) / sizeof(T);
+    }
+
+    template<typename T>
+    bool take(T* out, size_t count = 1) {
+        if(!fits<T>(count))
+            return false;
+        memcpy(out, cursor, count * sizeof(T));
+        cursor += count * sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool take(std::uint64_t count, std::vector<T>& out) {
+        if(!fits<T>(count))
+            return false;
+        out.resize(count);
+        return take(out.data(), count);
+    }
+
+    bool take_cloud(std::uint64_t count, pcl::PointCloud<PointType>::Ptr& cloud) {
+        if(count == no_cloud) {
+            cloud.reset();
+            return true;
+        }
+        if(!fits<PointType>(count))
+            return false;
+
+        cloud = acquire_cloud();
+        cloud->resize(count);
+        cloud->height = 1;
+        cloud->is_dense = true;
+        return take(cloud->points.data(), count);
+    }
+};
+
+result_of<size_t, std::string> checkpointer::restore(visual_odom_v2& odom) {
+    TRACE_SCOPE("checkpoint.restore");
+    if(!odom.final_path.poses.empty() || !odom.local_maps.empty())
+        return fail("restore needs a fresh odometry");
+
+    std::string filename = config.path + "/state";
+    mapped_file state;
+    if(!state.open(filename))
+        return fail("no checkpoint in " + config.path);
+
+    checkpoint_reader in = { state.data, state.data + state.length };
+    checkpoint_header header;
+    if(!in.take(&header) || memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0 ||
+       header.version != checkpoint_version)
+        return fail(filename + " is not a checkpoint");
+    if(header.record_size != sizeof(PointType))
+        return fail(filename + " was written with a different point layout");
+
+    auto& loop = odom.loop;
+    if(header.sc_rows != (std::uint32_t)loop.sc_manager.PC_NUM_RING ||
+       header.sc_cols != (std::uint32_t)loop.sc_manager.PC_NUM_SECTOR)
+        return fail(filename + " has scan contexts of another size");
+    if(header.window_size > local_map::previous_frame_count ||
+       header.window_head >= local_map::previous_frame_count)
+        return fail(filename + " is corrupt");
+
+    std::string log_name = config.path + "/keyframes";
+    mapped_file keyframe_log;
+    keyframe_log_header log_header;
+    if(!keyframe_log.open(log_name) || keyframe_log.length < sizeof(log_header))
+        return fail("cannot open " + log_name);
+    memcpy(&log_header, keyframe_log.data, sizeof(log_header));
+    if(memcmp(log_header.magic, keyframe_log_magic, sizeof(log_header.magic)) != 0 ||
+       log_header.version != checkpoint_version || log_header.run_id != header.run_id)
+        return fail(log_name + " belongs to another checkpoint");
+    if(keyframe_log.length < header.log_length)
+        return fail(log_name + " is truncated");
+
+    std::vector<checkpoint_pose> path;
+    std::vector<checkpoint_keyframe> keyframes;
+    std::vector<checkpoint_constraint> constraints;
+    if(!in.take(header.path, path) || !in.take(header.keyframes, keyframes) ||
+       !in.take(header.constraints, constraints))
+        return fail(filename + " is truncated");
+
+    // everything is read and checked before odom is touched, so a corrupt checkpoint leaves it
+    // as fresh as it came in
+    feature_frame window_frames[local_map::previous_frame_count];
+    Eigen::Matrix4d window_locations[local_map::previous_frame_count];
+    for(size_t i = 0; i < header.window_size; i++) {
+        std::uint64_t counts[6];
+        if(!in.take(window_locations[i].data(), 16) || !in.take(counts, 6))
+            return fail(filename + " is truncated");
+
+        auto clouds = clouds_of(window_frames[i]);
+        for(int j = 0; j < 6; j++) {
+            if(!in.take_cloud(counts[j], *clouds[j]))
+                return fail(filename + " is truncated");
+        }
+    }
+
+    size_t descriptor_bytes = size_t(header.sc_rows) * header.sc_cols * sizeof(double);
+    size_t fixed_bytes = descriptor_bytes + sizeof(keyframe_scan);
+    for(auto&& keyframe: keyframes) {
+        if(keyframe.offset % alignof(double) != 0 || keyframe.offset > header.log_length ||
+           fixed_bytes > header.log_length - keyframe.offset ||
+           keyframe.count >
+               (header.log_length - keyframe.offset - fixed_bytes) / sizeof(quantized_point))
+            return fail(log_name + " has a corrupt index");
+
+        keyframe_scan scan;
+        memcpy(&scan, keyframe_log.data + keyframe.offset + descriptor_bytes, sizeof(scan));
+        if(!(scan.resolution > 0.0f) || !std::isfinite(scan.resolution))
+            return fail(log_name + " has a corrupt keyframe scan");
+    }
+    for(auto&& c: constraints) {
+        if(c.source >= keyframes.size() || c.target >= keyframes.size())
+            return fail(filename + " has a corrupt loop constraint");
+    }
+
+    auto& window = odom.local_maps;
+    for(size_t i = 0; i < header.window_size; i++) {
+        window.prev_frames[i] = std::move(window_frames[i]);
+        window.prev_frame_location[i] = window_locations[i];
+    }
+    window.head = header.window_head;
+    window.counters = header.window_size;
+    window.local_map_dirty = true;
+
+    loop.frames.reserve(keyframes.size());
+    for(auto&& keyframe: keyframes) {
+        const std::uint8_t* record = keyframe_log.data + keyframe.offset;
+        Eigen::MatrixXd descriptor(header.sc_rows, header.sc_cols);
+        memcpy(descriptor.data(), record, descriptor_bytes);
+        loop.sc_manager.saveScancontextAndKeys(descriptor);
+
+        keyframe_scan scan_header;
+        memcpy(&scan_header, record + descriptor_bytes, sizeof(scan_header));
+        auto scan = std::make_shared<quantized_cloud>(
+            Eigen::Vector3f(scan_header.origin[0], scan_header.origin[1], scan_header.origin[2]),
+            scan_header.resolution);
+        scan->points.resize(keyframe.count);
+        memcpy(scan->points.data(), record + fixed_bytes, keyframe.count * sizeof(quantized_point));
+
+        Eigen::Matrix4d pose;
+        memcpy(pose.data(), keyframe.pose, sizeof(keyframe.pose));
+        loop.frames.push_back({ std::move(scan), pose });
+    }
+
+    for(auto&& c: constraints) {
+        Eigen::Matrix4d pose;
+        memcpy(pose.data(), c.pose, sizeof(c.pose));
+        gtsam::Pose3 transform(gtsam::Rot3(pose.block<3, 3>(0, 0)),
+                               gtsam::Point3(pose(0, 3), pose(1, 3), pose(2, 3)));
+        loop.loop.push_back({ c.source, c.target, transform });
+    }
+    loop.loop_counter = header.loop_counter;
+    loop.min_constriant_node = header.min_constraint_node;
+
+    odom.final_path.poses.reserve(path.size());
+    for(auto&& p: path) {
+        geometry_msgs::PoseStamped pose;
+        pose.header.frame_id = "map";
+        pose.header.stamp = ros::Time(p.stamp);
+        pose.pose.position.x = p.x;
+        pose.pose.position.y = p.y;
+        pose.pose.position.z = p.z;
+        pose.pose.orientation.x = p.qx;
+        pose.pose.orientation.y = p.qy;
+        pose.pose.orientation.z = p.qz;
+        pose.pose.orientation.w = p.qw;
+        odom.final_path.poses.push_back(pose);
+    }
+    odom.final_path.header.stamp = ros::Time(header.stamp);
+
+    memcpy(odom.prev_transform.data(), header.prev_transform, sizeof(header.prev_transform));
+    odom.tracked_pose = odom.prev_transform;
+    const double* guess = header.next_initial_guess;
+    odom.next_initial_guess = { guess[0], guess[1], guess[2], guess[3], guess[4], guess[5] };
+    odom.update_loop_markers();
+    odom.loop_markers.header.stamp = ros::Time(header.stamp);
+    odom.report_memory();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        run_id = header.run_id;
+        log_length = header.log_length;
+        log_index.clear();
+        for(auto&& keyframe: keyframes) {
+            log_index.push_back({ keyframe.offset, keyframe.count });
+        }
+    }
+    captured = keyframes.size();
+    last_checkpoint = header.stamp;
+
+    return ok(keyframes.size());
+}
@@ -0,0 +1,231 @@
+#include "feature_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+static constexpr char feature_cache_magic[8] = "HLFEAT1";
+static constexpr std::uint32_t feature_cache_version = 1;
+static constexpr std::uint32_t no_cloud = UINT32_MAX;
+
+struct feature_cache_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags; // FEATURE_CACHE_SCAN if every kept frame carries its scan
+    std::uint64_t frames;
+};
+
+// 24 bytes against 48 for PointType
+struct packed_point {
+    float x, y, z, intensity;
+    float time; // s after the cloud's time base
+    std::uint16_t ring;
+    std::uint16_t reserved;
+};
+
+static_assert(sizeof(packed_point) == 24, "packed_point must stay 24 bytes");
+
+feature_cache_writer::~feature_cache_writer() {
+    abort();
+}
+
+bool feature_cache_writer::open(const std::string& filename, bool with_scans) {
+    abort();
+
+    std::string temporary = filename + ".tmp";
+    fp = fopen(temporary.c_str(), "wb");
+    if(fp == nullptr)
+        return false;
+
+    // rewritten with the frame count on close()
+    feature_cache_header header = {};
+    if(fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        fp = nullptr;
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    this->filename = filename;
+    this->with_scans = with_scans;
+    frames = 0;
+    return true;
+}
+
+bool feature_cache_writer::write_cloud(const pcl::PointCloud<PointType>::Ptr& cloud) {
+    if(cloud == nullptr) {
+        return fwrite(&no_cloud, sizeof(no_cloud), 1, fp) == 1;
+    }
+
+    std::uint32_t count = cloud->size();
+    double base = 0.0;
+    if(count > 0) {
+        base = std::min_element(cloud->begin(), cloud->end(),
+                                [](const PointType& a, const PointType& b) {
+                                    return a.time < b.time;
+                                })->time;
+    }
+
+    buffer.resize(count * sizeof(packed_point));
+    auto packed = reinterpret_cast<packed_point*>(buffer.data());
+    for(std::uint32_t i = 0; i < count; i++) {
+        const auto& p = cloud->points[i];
+        packed[i] = { p.x, p.y, p.z, p.intensity, float(p.time - base), p.ring, 0 };
+    }
+
+    return fwrite(&count, sizeof(count), 1, fp) == 1 && fwrite(&base, sizeof(base), 1, fp) == 1 &&
+           fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+}
+
+bool feature_cache_writer::append(ros::Time time, const feature_frame& features,
+                                  const pcl::PointCloud<PointType>::Ptr& scan) {
+    if(fp == nullptr)
+        return false;
+
+    double stamp = time.toSec();
+    std::uint32_t flags = with_scans ? FEATURE_CACHE_SCAN : 0;
+    if(fwrite(&stamp, sizeof(stamp), 1, fp) != 1 || fwrite(&flags, sizeof(flags), 1, fp) != 1)
+        return false;
+
+    for(auto objects: { &features.livox_feature, &features.velodyne_feature }) {
+        if(!write_cloud(objects->line_features) || !write_cloud(objects->plane_features) ||
+           !write_cloud(objects->non_features))
+            return false;
+    }
+
+    if(with_scans && !write_cloud(scan))
+        return false;
+
+    frames++;
+    return true;
+}
+
+bool feature_cache_writer::append_dropped(ros::Time time) {
+    if(fp == nullptr)
+        return false;
+
+    double stamp = time.toSec();
+    std::uint32_t flags = FEATURE_CACHE_DROPPED;
+    if(fwrite(&stamp, sizeof(stamp), 1, fp) != 1 || fwrite(&flags, sizeof(flags), 1, fp) != 1)
+        return false;
+
+    frames++;
+    return true;
+}
+
+bool feature_cache_writer::close() {
+    if(fp == nullptr)
+        return false;
+
+    feature_cache_header header = {};
+    memcpy(header.magic, feature_cache_magic, sizeof(header.magic));
+    header.version = feature_cache_version;
+    header.flags = with_scans ? FEATURE_CACHE_SCAN : 0;
+    header.frames = frames;
+
+    bool written = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+    written = fclose(fp) == 0 && written;
+    fp = nullptr;
+
+    std::string temporary = filename + ".tmp";
+    if(written && rename(temporary.c_str(), filename.c_str()) == 0)
+        return true;
+
+    unlink(temporary.c_str());
+    return false;
+}
+
+void feature_cache_writer::abort() {
+    if(fp == nullptr)
+        return;
+
+    fclose(fp);
+    fp = nullptr;
+    unlink((filename + ".tmp").c_str());
+}
+
+feature_cache_reader::~feature_cache_reader() {
+    close();
+}
+
+result_of<size_t, std::string> feature_cache_reader::open(const std::string& filename) {
+    close();
+
+    fp = fopen(filename.c_str(), "rb");
+    if(fp == nullptr)
+        return fail("cannot open " + filename);
+
+    feature_cache_header header;
+    if(fread(&header, sizeof(header), 1, fp) != 1 ||
+       memcmp(header.magic, feature_cache_magic, sizeof(header.magic)) != 0 ||
+       header.version != feature_cache_version) {
+        close();
+        return fail(filename + " is not a feature cache");
+    }
+
+    with_scans = (header.flags & FEATURE_CACHE_SCAN) != 0;
+    return ok((size_t)header.frames);
+}
+
+void feature_cache_reader::close() {
+    if(fp != nullptr)
+        fclose(fp);
+    fp = nullptr;
+    with_scans = false;
+}
+
+bool feature_cache_reader::read_cloud(pcl::PointCloud<PointType>::Ptr& cloud) {
+    std::uint32_t count;
+    if(fread(&count, sizeof(count), 1, fp) != 1)
+        return false;
+
+    if(count == no_cloud) {
+        cloud.reset();
+        return true;
+    }
+
+    double base;
+    buffer.resize(count * sizeof(packed_point));
+    if(fread(&base, sizeof(base), 1, fp) != 1 ||
+       fread(buffer.data(), 1, buffer.size(), fp) != buffer.size())
+        return false;
+
+    cloud = acquire_cloud();
+    cloud->resize(count);
+    auto packed = reinterpret_cast<const packed_point*>(buffer.data());
+    for(std::uint32_t i = 0; i < count; i++) {
+        auto& p = cloud->points[i];
+        p.x = packed[i].x;
+        p.y = packed[i].y;
+        p.z = packed[i].z;
+        p.intensity = packed[i].intensity;
+        p.ring = packed[i].ring;
+        p.time = base + packed[i].time;
+    }
+    return true;
+}
+
+bool feature_cache_reader::next(cached_frame& frame) {
+    if(fp == nullptr)
+        return false;
+
+    double stamp;
+    std::uint32_t flags;
+    if(fread(&stamp, sizeof(stamp), 1, fp) != 1 || fread(&flags, sizeof(flags), 1, fp) != 1)
+        return false;
+
+    frame.time = ros::Time(stamp);
+    frame.dropped = (flags & FEATURE_CACHE_DROPPED) != 0;
+    frame.features = {};
+    frame.scan.reset();
+    if(frame.dropped)
+        return true;
+
+    for(auto objects: { &frame.features.livox_feature, &frame.features.velodyne_feature }) {
+        if(!read_cloud(objects->line_features) || !read_cloud(objects->plane_features) ||
+           !read_cloud(objects->non_features))
+            return false;
+    }
+
+    return (flags & FEATURE_CACHE_SCAN) == 0 || read_cloud(frame.scan);
+}
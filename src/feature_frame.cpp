@@ -0,0 +1,35 @@
+#include "comm.h"
+#include "trace.h"
+
+result_of<feature_frame, std::string> extract_features(const synced_message& msg,
+                                                       const feature_config& config) {
+    feature_frame frame;
+
+    if(config.use_velodyne && !msg.livox_only) {
+        if(msg.velodyne_features.line_features != nullptr) {
+            frame.velodyne_feature = msg.velodyne_features;
+        } else {
+            TRACE_SCOPE("feature.velodyne");
+            feature_velodyne(msg.velodyne, frame.velodyne_feature);
+        }
+        if(frame.velodyne_feature.line_features->size() < 20 ||
+           frame.velodyne_feature.plane_features->size() < 100) {
+            return fail("velodyne feature not enough!");
+        }
+    }
+
+    if(config.use_livox) {
+        {
+            TRACE_SCOPE("feature.livox");
+            feature_livox(msg.livox, frame.livox_feature);
+        }
+        if(frame.livox_feature.plane_features->empty() ||
+           frame.livox_feature.non_features->empty()) {
+            return fail("livox feature empty!");
+        }
+
+        transform_cloud(frame.livox_feature, frame.livox_feature, config.livox_transform);
+    }
+
+    return ok(frame);
+}
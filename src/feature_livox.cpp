@@ -1,4 +1,5 @@
 #include "comm.h"
+#include "perf_counters.h"
 
 #include <Eigen/Dense>
 #include <condition_variable>
@@ -7,14 +8,23 @@
 #include <queue>
 #include <thread>
 
+// a frame with fewer edge points keeps no line cloud: feature_ok would reject the whole frame
+static constexpr size_t min_line_features = 10;
+
 void detectFeaturePoint2(const pcl::PointCloud<PointType>::Ptr& cloud,
                          pcl::PointCloud<PointType>::Ptr& pointsLessFlat,
-                         pcl::PointCloud<PointType>::Ptr& pointsNonFeature) {
+                         pcl::PointCloud<PointType>::Ptr& pointsNonFeature,
+                         pcl::PointCloud<PointType>::Ptr* pointsLessSharp) {
+    PERF_SCOPE(PERF_KERNEL_DETECT_FEATURE_POINT2);
 
     int cloudSize = cloud->points.size();
 
-    pointsLessFlat.reset(new pcl::PointCloud<PointType>());
-    pointsNonFeature.reset(new pcl::PointCloud<PointType>());
+    if(pointsLessFlat == nullptr)
+        pointsLessFlat = acquire_cloud();
+    if(pointsNonFeature == nullptr)
+        pointsNonFeature = acquire_cloud();
+    if(pointsLessSharp != nullptr && *pointsLessSharp == nullptr)
+        *pointsLessSharp = acquire_cloud();
 
     pcl::KdTreeFLANN<PointType>::Ptr KdTreeCloud;
     KdTreeCloud.reset(new pcl::KdTreeFLANN<PointType>);
@@ -35,6 +45,7 @@ void detectFeaturePoint2(const pcl::PointCloud<PointType>::Ptr& cloud,
         double thre2d = 0.8;
         double thre3d = 0.5;
         double thre3d2 = 0.13;
+        double thre1d_line = 0.8; // a1d of an edge: second axis under a fifth of the first
 
         double disti =
             sqrt(cloud->points[i].x * cloud->points[i].x + cloud->points[i].y * cloud->points[i].y +
@@ -133,6 +144,10 @@ void detectFeaturePoint2(const pcl::PointCloud<PointType>::Ptr& cloud,
                 pointsLessFlat->points.push_back(cloud->points[i + k]);
             }
             pointsLessFlat->points.push_back(cloud->points[i]);
+        } else if(pointsLessSharp != nullptr && a1d > thre1d_line) {
+            // the neighbours spread along one axis only: an edge, matched point-to-line. Only
+            // the point itself, its scan neighbours i +- k need not lie on the edge
+            (*pointsLessSharp)->points.push_back(cloud->points[i]);
         } else if(a3d > thre3d) {
             for(int k = 1; k < interval; k++) {
                 pointsNonFeature->points.push_back(cloud->points[i - k]);
@@ -144,14 +159,14 @@ void detectFeaturePoint2(const pcl::PointCloud<PointType>::Ptr& cloud,
 }
 
 void FeatureExtract_hap(const pcl::PointCloud<XYZIRT>& msg,
+                        pcl::PointCloud<PointType>::Ptr& laserCornerFeature,
                         pcl::PointCloud<PointType>::Ptr& laserSurfFeature,
                         pcl::PointCloud<PointType>::Ptr& laserNonFeature) {
+    laserCornerFeature->clear();
     laserSurfFeature->clear();
     laserNonFeature->clear();
 
-    pcl::PointCloud<PointType>::Ptr laserCloud(new pcl::PointCloud<PointType>());
-
-    laserCloud->clear();
+    auto laserCloud = acquire_cloud();
     laserCloud->resize(msg.size());
 
     double time_base = msg.points.front().time;
@@ -162,24 +177,30 @@ void FeatureExtract_hap(const pcl::PointCloud<XYZIRT>& msg,
         laserCloud->at(i).time = (msg.points[i].time - time_base) / timeSpan;
     }
 
-    detectFeaturePoint2(laserCloud, laserSurfFeature, laserNonFeature);
+    detectFeaturePoint2(laserCloud, laserSurfFeature, laserNonFeature, &laserCornerFeature);
 }
 
 void feature_livox(const pcl::PointCloud<PointType>::Ptr& cloud, feature_objects& feature) {
-    // no line features for livox-hap
-    feature.line_features.reset();
+    if(feature.line_features != nullptr) {
+        feature.line_features->clear();
+    } else {
+        feature.line_features = acquire_cloud();
+    }
 
     if(feature.plane_features != nullptr) {
         feature.plane_features->clear();
     } else {
-        feature.plane_features.reset(new pcl::PointCloud<PointType>());
+        feature.plane_features = acquire_cloud();
     }
 
     if(feature.non_features != nullptr) {
         feature.non_features->clear();
     } else {
-        feature.non_features.reset(new pcl::PointCloud<PointType>());
+        feature.non_features = acquire_cloud();
     }
 
-    FeatureExtract_hap(*cloud, feature.plane_features, feature.non_features);
+    FeatureExtract_hap(*cloud, feature.line_features, feature.plane_features,
+                       feature.non_features);
+    if(feature.line_features->size() < min_line_features)
+        feature.line_features.reset();
 }
@@ -1,8 +1,7 @@
 #include <Eigen/Dense>
 #include <comm.h>
-#include <pcl/filters/impl/voxel_grid.hpp>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/impl/pcl_base.hpp>
+#include <perf_counters.h>
+#include <polar_bins.h>
 #include <vector>
 template<typename T>
 struct array_view {
@@ -96,7 +95,8 @@ inline void downsample_surf(continer_type& surface_points) {
 
 template<typename point_type>
 inline void get_features(point_type* begin, point_type* end, const size_t* ranges,
-                         feature_objects& features) {
+                         feature_objects& features, int sections) {
+    PERF_SCOPE(PERF_KERNEL_GET_FEATURES);
 
     constexpr size_t H_SCAN = 1800;
     constexpr float edgeThreshold = 1.0;
@@ -123,30 +123,21 @@ inline void get_features(point_type* begin, point_type* end, const size_t* range
     std::vector<float> curvature(std::distance(begin, end));
     std::vector<smoothness_t> smoothness(std::distance(begin, end));
 
-    for(point_type* i = begin; i != end; i++) {
-        float d = i->x * i->x + i->y * i->y + i->z * i->z;
-        range[i - begin] = std::sqrt(d);
+    static_assert(sizeof(point_type) == sizeof(kernel_point), "kernels read XYZIRT points");
+    kernels().range_curvature(reinterpret_cast<const kernel_point*>(begin), range.size(),
+                              range.data(), curvature.data());
 
-        float angle = std::atan2(i->x, i->y) * 180.0f / M_PI;
-        int columnIdn = -round((angle - 90.0f) / (360.0f / H_SCAN)) + H_SCAN / 2;
-        if(columnIdn >= H_SCAN)
-            columnIdn -= H_SCAN;
-
-        if(columnIdn < 0 || columnIdn >= H_SCAN)
-            columnIdn = 0;
-        cols[i - begin] = columnIdn;
-    }
+    // column of -round((atan2(x, y) - 90 deg) / 0.2 deg) + H_SCAN / 2, that is the 0.2 deg bin
+    // of atan2(y, x) centred on it, 0 deg in column H_SCAN / 2
+    static constexpr azimuth_bins<H_SCAN> columns(-180.0 / H_SCAN, H_SCAN / 2);
+    for(point_type* i = begin; i != end; i++)
+        cols[i - begin] = columns(i->x, i->y);
 
     std::vector<bool> neighbor_picked(std::distance(begin, end), false);
     std::vector<bool> flag(std::distance(begin, end), false);
 
     size_t cloudSize = curvature.size();
-    for(int i = 5; i < cloudSize - 5; i++) {
-        float curv = range[i - 5] + range[i - 4] + range[i - 3] + range[i - 2] + range[i - 1] -
-            range[i] * 10 + range[i + 1] + range[i + 2] + range[i + 3] + range[i + 4] +
-            range[i + 5];
-
-        curvature[i] = curv * curv;
+    for(size_t i = 5; i + 5 < cloudSize; i++) {
         smoothness[i].value = curvature[i];
         smoothness[i].ind = i;
     }
@@ -184,14 +175,24 @@ inline void get_features(point_type* begin, point_type* end, const size_t* range
             neighbor_picked[i] = true;
     }
 
+    // the curvature of the 5 points at either end of a ring mixes in the neighbouring ring
+    for(int i = 0; i < ring_id; i++) {
+        size_t ring_begin = i == 0 ? 0 : points.range_offsets[i - 1];
+        size_t ring_end = points.range_offsets[i];
+        for(size_t k = 0; k < 5 && ring_begin + k < ring_end; k++) {
+            neighbor_picked[ring_begin + k] = true;
+            neighbor_picked[ring_end - 1 - k] = true;
+        }
+    }
+
     for(int i = 0; i < ring_id; i++) {
         auto cloud_span = points.ring_span(i, begin);
         auto smoothness_span = points.ring_span(i, smoothness.data());
 
-        for(int j = 0; j < 6; j++) {
+        for(int j = 0; j < sections; j++) {
 
-            int sp = (cloud_span.size() * j) / 6;
-            int ep = (cloud_span.size() * (j + 1)) / 6 - 1;
+            int sp = (cloud_span.size() * j) / sections;
+            int ep = (cloud_span.size() * (j + 1)) / sections - 1;
 
             if(sp >= ep)
                 continue;
@@ -212,13 +213,13 @@ inline void get_features(point_type* begin, point_type* end, const size_t* range
                     }
 
                     neighbor_picked[ind] = true;
-                    for(int l = 1; l <= 5; l++) {
+                    for(int l = 1; l <= 5 && ind + l < int(cloudSize); l++) {
                         int columnDiff = std::abs(int(cols[ind + l] - cols[ind + l - 1]));
                         if(columnDiff > 10)
                             break;
                         neighbor_picked[ind + l] = true;
                     }
-                    for(int l = -1; l >= -5; l--) {
+                    for(int l = -1; l >= -5 && ind + l >= 0; l--) {
                         int columnDiff = std::abs(int(cols[ind + l] - cols[ind + l + 1]));
                         if(columnDiff > 10)
                             break;
@@ -235,7 +236,7 @@ inline void get_features(point_type* begin, point_type* end, const size_t* range
                     flag[ind] = false;
                     neighbor_picked[ind] = true;
 
-                    for(int l = 1; l <= 5; l++) {
+                    for(int l = 1; l <= 5 && ind + l < int(cloudSize); l++) {
 
                         int columnDiff = std::abs(cols[ind + l] - cols[ind + l - 1]);
                         if(columnDiff > 10)
@@ -243,7 +244,7 @@ inline void get_features(point_type* begin, point_type* end, const size_t* range
 
                         neighbor_picked[ind + l] = true;
                     }
-                    for(int l = -1; l >= -5; l--) {
+                    for(int l = -1; l >= -5 && ind + l >= 0; l--) {
 
                         int columnDiff = std::abs(cols[ind + l] - cols[ind + l + 1]);
                         if(columnDiff > 10)
@@ -263,7 +264,8 @@ inline void get_features(point_type* begin, point_type* end, const size_t* range
     }
 }
 
-void feature_velodyne(const pcl::PointCloud<PointType>::Ptr& cloud, feature_objects& feature) {
+void feature_velodyne(const pcl::PointCloud<PointType>::Ptr& cloud, feature_objects& feature,
+                      int sections) {
     size_t ring_count[64] = { 0 };
     auto cond = [](auto&& p) {
         auto d = sqrtf(p2(p.x) + p2(p.y) + p2(p.z));
@@ -280,24 +282,26 @@ void feature_velodyne(const pcl::PointCloud<PointType>::Ptr& cloud, feature_obje
         ring_offset[i] = ring_offset[i - 1] + ring_count[i - 1];
     }
 
-    std::vector<PointType> points(ring_offset[63] + ring_count[63]);
+    auto points = acquire_cloud();
+    points->resize(ring_offset[63] + ring_count[63]);
     for(auto& p: *cloud) {
         if(p.ring < 64 && cond(p))
-            points[ring_offset[p.ring]++] = p;
+            points->points[ring_offset[p.ring]++] = p;
     }
 
     if(feature.line_features != nullptr) {
         feature.line_features->clear();
     } else {
-        feature.line_features.reset(new pcl::PointCloud<PointType>());
+        feature.line_features = acquire_cloud();
     }
 
     if(feature.plane_features != nullptr) {
         feature.plane_features->clear();
     } else {
-        feature.plane_features.reset(new pcl::PointCloud<PointType>());
+        feature.plane_features = acquire_cloud();
     }
 
     feature.non_features.reset();
-    get_features(points.data(), points.data() + points.size(), ring_count, feature);
+    get_features(points->points.data(), points->points.data() + points->size(), ring_count,
+                 feature, sections);
 }
@@ -1,9 +1,13 @@
 #include <comm.h>
+#include <metrics.h>
+#include <thread_profile.h>
+#include <trace.h>
 #include <condition_variable>
 #include <mutex>
 #include <pcl/common/transforms.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <queue>
+#include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <thread>
 
@@ -13,6 +17,7 @@ struct feature_thread {
 
     volatile bool should_stop = false;
 
+    ros::Publisher pub_livox_line_features;
     ros::Publisher pub_livox_plane_features;
     ros::Publisher pub_livox_non_features;
     ros::Publisher pub_velodyne_line_features;
@@ -22,34 +27,40 @@ struct feature_thread {
     ~feature_thread();
 
 private:
-    Eigen::Matrix4d livox_transform;
     void __features_thread();
     static void __features_thread_entry(feature_thread* self);
 
-    bool use_livox = true;
-    bool use_velodyne = true;
+    feature_config config;
+
+    thread_profile profile;
 };
 
 void feature_thread::__features_thread() {
+    apply_thread_profile(profile);
+
+    static auto& queue_depth = metrics_gauge("queue.feature");
+    static auto& dropped = metrics_counter("frames_dropped.features");
+
     printf("Features thread started\r\n");
     while(true) {
-        auto pq = q.acquire([this]() { return this->should_stop; });
+        auto pq = q.acquire([this]() { return this->should_stop || !ros::ok(); });
 
         if(pq.empty()) {
             break;
         }
 
         for(; !pq.empty() && !this->should_stop; pq.pop()) {
-            feature_frame frame;
-
-            if(use_velodyne) {
-                feature_velodyne(pq.front().velodyne, frame.velodyne_feature);
-                if(frame.velodyne_feature.line_features->size() < 20 ||
-                   frame.velodyne_feature.plane_features->size() < 100) {
-                    printf("velodyne feature not enough!\r\n");
-                    continue;
-                }
+            TRACE_FRAME(pq.front().time.toNSec());
+            queue_depth.set(pq.size() - 1);
+            auto fr = extract_features(pq.front(), config);
+            if(!fr.ok()) {
+                printf("%s\r\n", fr.error().c_str());
+                dropped.add();
+                continue;
+            }
+            feature_frame frame = fr.value();
 
+            if(config.use_velodyne) {
                 if(pub_velodyne_line_features.getNumSubscribers() > 0) {
                     sensor_msgs::PointCloud2 msg;
                     pcl::toROSMsg(*frame.velodyne_feature.line_features, msg);
@@ -67,20 +78,16 @@ void feature_thread::__features_thread() {
                 }
             }
 
-            if(use_livox) {
-                feature_livox(pq.front().livox, frame.livox_feature);
-                if(frame.livox_feature.plane_features->empty() ||
-                   frame.livox_feature.non_features->empty()) {
-                    printf("livox feature empty!\r\n");
-                    continue;
+            if(config.use_livox) {
+                if(frame.livox_feature.line_features != nullptr &&
+                   pub_livox_line_features.getNumSubscribers() > 0) {
+                    sensor_msgs::PointCloud2 msg;
+                    pcl::toROSMsg(*frame.livox_feature.line_features, msg);
+                    msg.header.stamp = pq.front().time;
+                    msg.header.frame_id = "velodyne16";
+                    pub_livox_line_features.publish(msg);
                 }
 
-                pcl::transformPointCloud(*frame.livox_feature.plane_features,
-                                         *frame.livox_feature.plane_features, livox_transform);
-
-                pcl::transformPointCloud(*frame.livox_feature.non_features,
-                                         *frame.livox_feature.non_features, livox_transform);
-
                 if(pub_livox_plane_features.getNumSubscribers() > 0) {
                     sensor_msgs::PointCloud2 msg;
                     pcl::toROSMsg(*frame.livox_feature.plane_features, msg);
@@ -105,8 +112,8 @@ void feature_thread::__features_thread() {
 }
 
 feature_thread::feature_thread(ros::NodeHandle* nh) {
-    nh->param<bool>("/hloam/use_livox", use_livox, true);
-    nh->param<bool>("/hloam/use_velodyne", use_velodyne, true);
+    nh->param<bool>("/hloam/use_livox", config.use_livox, true);
+    nh->param<bool>("/hloam/use_velodyne", config.use_velodyne, true);
 
     pub_velodyne_line_features =
         nh->advertise<sensor_msgs::PointCloud2>("/features/velodyne_line_features", 1, true);
@@ -114,16 +121,19 @@ feature_thread::feature_thread(ros::NodeHandle* nh) {
     pub_velodyne_plane_features =
         nh->advertise<sensor_msgs::PointCloud2>("/features/velodyne_plane_features", 1, true);
 
+    pub_livox_line_features =
+        nh->advertise<sensor_msgs::PointCloud2>("/features/livox_line_features", 1, true);
+
     pub_livox_plane_features =
         nh->advertise<sensor_msgs::PointCloud2>("/features/livox_plane_features", 1, true);
 
     pub_livox_non_features =
         nh->advertise<sensor_msgs::PointCloud2>("/features/livox_non_features", 1, true);
 
-    if(!use_livox && !use_velodyne) {
+    if(!config.use_livox && !config.use_velodyne) {
         ROS_FATAL("use_livox and use_velodyne cannot be both false");
-        use_livox = true;
-        use_velodyne = true;
+        config.use_livox = true;
+        config.use_velodyne = true;
     }
 
     // X,Y,Z,R,P,Y
@@ -144,7 +154,9 @@ feature_thread::feature_thread(ros::NodeHandle* nh) {
 
     ROS_INFO("livox_transform: %f %f %f %f %f %f", tr.x, tr.y, tr.z, tr.roll, tr.pitch, tr.yaw);
 
-    livox_transform = to_eigen(tr).inverse();
+    config.livox_transform = to_eigen(tr).inverse();
+
+    profile = load_thread_profile(nh, "feature");
 
     sync_frame_delegate.append([this](const synced_message& msg) { q.push(msg); });
     thread = std::thread(&feature_thread::__features_thread_entry, this);
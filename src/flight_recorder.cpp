@@ -0,0 +1,183 @@
+#include "flight_recorder.h"
+
+#include "metrics.h"
+
+#include <atomic>
+#include <cerrno>
+#include <pcl/io/pcd_io.h>
+#include <sys/stat.h>
+
+// bumped by flight_recorder_signal, each recorder dumps when it sees a new value
+static std::atomic<int> signal_generation{ 0 };
+static_assert(std::atomic<int>::is_always_lock_free, "signal handlers need a lock-free counter");
+
+void flight_recorder_signal() {
+    signal_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+flight_recorder::flight_recorder(const flight_recorder_config& config):
+    config(config), ring(config.frames) {
+    if(enabled())
+        writer = std::thread(&flight_recorder::__writer_thread, this);
+}
+
+flight_recorder::~flight_recorder() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        should_stop = true;
+    }
+    cv.notify_all();
+    if(writer.joinable())
+        writer.join();
+}
+
+void flight_recorder::record(flight_record&& record) {
+    if(!enabled())
+        return;
+
+    bool spike = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        double now = record.time.toSec();
+
+        if(config.loss_threshold > 0.0f && record.loss > config.loss_threshold &&
+           frames_to_spike_dump < 0 && now - last_spike_dump >= config.min_interval) {
+            frames_to_spike_dump = config.frames_after;
+            last_spike_dump = now;
+        }
+
+        // the previous frame's clouds are released here, on the mapping thread, which is what
+        // dropping them without the recorder would have cost anyway
+        head = (head + 1) % ring.size();
+        ring[head] = std::move(record);
+        if(count < ring.size())
+            count++;
+
+        if(frames_to_spike_dump >= 0 && frames_to_spike_dump-- == 0 && pending_reason.empty()) {
+            pending_reason = "loss";
+            spike = true;
+        }
+    }
+
+    if(spike)
+        cv.notify_all();
+}
+
+void flight_recorder::request_dump(const std::string& reason) {
+    if(!enabled())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if(pending_reason.empty())
+            pending_reason = reason.empty() ? "request" : reason;
+    }
+    cv.notify_all();
+}
+
+size_t flight_recorder::dumps() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return written;
+}
+
+void flight_recorder::__writer_thread() {
+    int seen_generation = signal_generation.load(std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> guard(lock);
+    while(!should_stop) {
+        // signal handlers cannot notify, so the signal counter is polled
+        cv.wait_for(guard, std::chrono::milliseconds(100));
+
+        int generation = signal_generation.load(std::memory_order_relaxed);
+        if(generation != seen_generation && pending_reason.empty())
+            pending_reason = "signal";
+        seen_generation = generation;
+
+        if(pending_reason.empty() || should_stop || count == 0)
+            continue;
+
+        // copying the ring only copies cloud pointers, oldest first
+        std::vector<flight_record> records;
+        records.reserve(count);
+        for(size_t i = 0; i < count; i++) {
+            records.push_back(ring[(head + ring.size() - count + 1 + i) % ring.size()]);
+        }
+        std::string reason = std::move(pending_reason);
+        pending_reason.clear();
+
+        guard.unlock();
+        __write(records, reason);
+        guard.lock();
+        written++;
+    }
+}
+
+static void save_cloud(const char* filename, const pcl::PointCloud<PointType>::Ptr& cloud) {
+    if(cloud != nullptr && !cloud->empty())
+        pcl::io::savePCDFileBinary(filename, *cloud);
+}
+
+static void save_features(const std::string& prefix, const feature_frame& frame) {
+    static const char* suffixes[6] = { "vl", "vp", "vn", "ll", "lp", "ln" };
+    auto clouds = clouds_of(frame);
+
+    char filename[512];
+    for(int i = 0; i < 6; i++) {
+        snprintf(filename, sizeof(filename), "%s_%s.pcd", prefix.c_str(), suffixes[i]);
+        save_cloud(filename, *clouds[i]);
+    }
+}
+
+static bool same_map(const feature_frame& a, const feature_frame& b) {
+    auto clouds_a = clouds_of(a), clouds_b = clouds_of(b);
+    for(int i = 0; i < 6; i++) {
+        if(*clouds_a[i] != *clouds_b[i])
+            return false;
+    }
+    return true;
+}
+
+void flight_recorder::__write(const std::vector<flight_record>& records,
+                              const std::string& reason) {
+    static auto& dumps = metrics_counter("flight_recorder.dumps");
+
+    mkdir(config.output.c_str(), 0755);
+    char directory[512];
+    snprintf(directory, sizeof(directory), "%s/%ld_%s", config.output.c_str(), time(nullptr),
+             reason.c_str());
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        HLOAM_WARN("flight recorder: cannot create %s", directory);
+        return;
+    }
+
+    std::string index_name = std::string(directory) + "/frames.txt";
+    FILE* index = fopen(index_name.c_str(), "w");
+    if(index == nullptr) {
+        HLOAM_WARN("flight recorder: cannot write %s", index_name.c_str());
+        return;
+    }
+
+    char prefix[600];
+    size_t map_index = 0;
+    for(size_t i = 0; i < records.size(); i++) {
+        const auto& r = records[i];
+
+        snprintf(prefix, sizeof(prefix), "%s/%03zu", directory, i);
+        save_features(prefix, r.features);
+
+        if(i == 0 || !same_map(r.local_map, records[map_index].local_map)) {
+            map_index = i;
+            snprintf(prefix, sizeof(prefix), "%s/%03zu_map", directory, i);
+            save_features(prefix, r.local_map);
+        }
+
+        Eigen::Quaterniond q(Eigen::Matrix3d(r.pose.block<3, 3>(0, 0)));
+        fprintf(index, "%03zu %.6f %f %f %f %f %f %f %f %f %d %03zu\n", i, r.time.toSec(),
+                r.pose(0, 3), r.pose(1, 3), r.pose(2, 3), q.x(), q.y(), q.z(), q.w(), r.loss,
+                r.dropped ? 1 : 0, map_index);
+    }
+    fclose(index);
+
+    dumps.add();
+    HLOAM_INFO("flight recorder: %zd frames written to %s", records.size(), directory);
+}
@@ -1,4 +1,5 @@
 #include "comm.h"
+#include "quantized_cloud.h"
 
 #include <filesystem>
 #include <mutex>
@@ -157,8 +158,8 @@ class Gen: public ros::NodeHandle {
     ros::Publisher pub_feature_livox_plane;
     ros::Publisher pub_feature_livox_non;
 
-    pcl::PointCloud<XYZIRT> global_map_velodyne;
-    pcl::PointCloud<XYZIRT> global_map_livox;
+    quantized_map global_map_velodyne;
+    quantized_map global_map_livox;
 
     feature_frame global_features;
 
@@ -378,8 +379,8 @@ public:
         auto velodyne_ds = downsample(velodyne_tr, downsample_rate);
         auto livox_ds = downsample(livox_tr, downsample_rate);
 
-        global_map_livox += livox_ds;
-        global_map_velodyne += velodyne_ds;
+        global_map_livox.insert(livox_ds);
+        global_map_velodyne.insert(velodyne_ds);
 
         sensor_msgs::PointCloud2 msg;
         pcl::toROSMsg(velodyne_ds, msg);
@@ -437,16 +438,20 @@ public:
             std::filesystem::create_directories(global_map_filename);
         }
 
+        pcl::PointCloud<PointType> velodyne_global, livox_global;
+        global_map_velodyne.decode(velodyne_global);
+        global_map_livox.decode(livox_global);
+
         char filenames[1024];
         sprintf(filenames, "%s/velodyne_global.pcd", global_map_filename.c_str());
-        pcl::io::savePCDFileBinary(filenames, global_map_velodyne);
+        pcl::io::savePCDFileBinary(filenames, velodyne_global);
 
         sprintf(filenames, "%s/livox_global.pcd", global_map_filename.c_str());
-        pcl::io::savePCDFileBinary(filenames, global_map_livox);
+        pcl::io::savePCDFileBinary(filenames, livox_global);
 
         pcl::PointCloud<PointType> global_map;
-        global_map += global_map_velodyne;
-        global_map += global_map_livox;
+        global_map += velodyne_global;
+        global_map += livox_global;
 
         sprintf(filenames, "%s/global.pcd", global_map_filename.c_str());
         pcl::io::savePCDFileBinary(filenames, global_map);
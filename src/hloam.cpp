@@ -0,0 +1,97 @@
+#include "hloam.h"
+
+#include "odometry.h"
+
+hloam_odometry::hloam_odometry(const hloam_config& config):
+    config(config), odom(std::make_unique<visual_odom_v2>(config.odometry)) {
+    odom->degenerate_threshold = config.odometry.degenerate_threshold;
+}
+
+hloam_odometry::~hloam_odometry() = default;
+
+std::optional<Eigen::Matrix4d> hloam_odometry::push_frame(double stamp, const cloud_ptr& velodyne,
+                                                          const cloud_ptr& livox) {
+    auto features = extract(stamp, velodyne, livox);
+    if(!features.has_value())
+        return std::nullopt;
+    return register_features(stamp, *features, velodyne);
+}
+
+std::optional<feature_frame> hloam_odometry::extract(double stamp, const cloud_ptr& velodyne,
+                                                     const cloud_ptr& livox) const {
+    synced_message msg;
+    msg.velodyne = velodyne;
+    msg.livox = livox;
+    msg.time = ros::Time(stamp);
+
+    auto fr = extract_features(msg, config.features);
+    if(!fr.ok()) {
+        if(on_dropped)
+            on_dropped(stamp, fr.error());
+        return std::nullopt;
+    }
+    return fr.value();
+}
+
+std::optional<Eigen::Matrix4d> hloam_odometry::register_features(double stamp,
+                                                                 const feature_frame& features,
+                                                                 const cloud_ptr& velodyne) {
+    size_t keyframes = odom->final_path.poses.size();
+    size_t loops = odom->loop.loop.size();
+
+    auto M = odom->mapping(velodyne, features, ros::Time(stamp));
+    if(!M.has_value()) {
+        if(on_dropped)
+            on_dropped(stamp, "registration failed");
+        return std::nullopt;
+    }
+
+    if(on_pose)
+        on_pose(stamp, *M, odom->final_path.poses.size() > keyframes);
+    if(on_loop && odom->loop.loop.size() > loops)
+        on_loop(trajectory());
+    return M;
+}
+
+std::optional<Eigen::Matrix4d> hloam_odometry::track(double stamp, const cloud_ptr& livox) {
+    synced_message msg;
+    msg.velodyne = acquire_cloud();
+    msg.livox = livox;
+    msg.time = ros::Time(stamp);
+    msg.livox_only = true;
+
+    auto fr = extract_features(msg, config.features);
+    if(!fr.ok()) {
+        if(on_dropped)
+            on_dropped(stamp, fr.error());
+        return std::nullopt;
+    }
+
+    auto M = odom->track(fr.value().livox_feature, ros::Time(stamp));
+    if(!M.has_value()) {
+        if(on_dropped)
+            on_dropped(stamp, "micro-sweep not tracked");
+        return std::nullopt;
+    }
+
+    if(on_pose)
+        on_pose(stamp, *M, false);
+    return M;
+}
+
+void hloam_odometry::set_initial_pose(const Eigen::Matrix4d& pose) {
+    odom->set_initial_pose(pose);
+}
+
+std::vector<hloam_keyframe> hloam_odometry::trajectory() const {
+    std::vector<hloam_keyframe> keyframes;
+    keyframes.reserve(odom->final_path.poses.size());
+    for(auto&& pose: odom->final_path.poses) {
+        keyframes.push_back({ pose.header.stamp.toSec(), from_ros_pose(pose.pose) });
+    }
+    return keyframes;
+}
+
+size_t hloam_odometry::loops() const {
+    return odom->loop.loop.size();
+}
@@ -0,0 +1,109 @@
+#include "metrics.h"
+#include "offline.h"
+#include "trace.h"
+
+#include <cstring>
+
+static void usage(const char* name) {
+    printf("Usage: %s (--velodyne <dir> | --features <file>) [options]\r\n"
+           "  --velodyne <dir>         velodyne scans, *.pcd or KITTI *.bin\r\n"
+           "  --livox <dir>            livox scans (*.pcd), paired with the velodyne scans\r\n"
+           "  --livox-transform x,y,z,roll,pitch,yaw\r\n"
+           "  --gt <file>              ground truth, TUM format\r\n"
+           "  --output <file>          estimated keyframe trajectory, TUM format\r\n"
+           "  --first <n> --count <n>  frame range\r\n"
+           "  --period <s>             frame period for unstamped scans (0.1)\r\n"
+           "  --method <n>             0: LM2, 1: per-sensor LM fused with GTSAM\r\n"
+           "  --no-loop                disable loop closure\r\n"
+           "  --write-features <file>  cache the extracted features of every frame\r\n"
+           "  --no-cache-scans         leave the velodyne scans out of the cache\r\n"
+           "  --features <file>        replay a feature cache instead of the scans\r\n"
+           "  --trace <file>           write a Chrome trace of the run\r\n",
+           name);
+}
+
+static bool parse_transform(const char* text, Transform& tr) {
+    return sscanf(text, "%lf,%lf,%lf,%lf,%lf,%lf", &tr.x, &tr.y, &tr.z, &tr.roll, &tr.pitch,
+                  &tr.yaw) == 6;
+}
+
+int main(int argc, const char* const* argv) {
+    offline_options options;
+    std::string trace_output;
+
+    for(int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if(strcmp(arg, "--no-loop") == 0) {
+            options.odom.enable_loop = false;
+            continue;
+        }
+
+        if(strcmp(arg, "--no-cache-scans") == 0) {
+            options.cache_scans = false;
+            continue;
+        }
+
+        if(value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+
+        if(strcmp(arg, "--velodyne") == 0) {
+            options.velodyne_dir = value;
+        } else if(strcmp(arg, "--livox") == 0) {
+            options.livox_dir = value;
+        } else if(strcmp(arg, "--livox-transform") == 0) {
+            Transform tr;
+            if(!parse_transform(value, tr)) {
+                usage(argv[0]);
+                return 1;
+            }
+            options.features.livox_transform = to_eigen(tr).inverse();
+        } else if(strcmp(arg, "--gt") == 0) {
+            options.ground_truth = value;
+        } else if(strcmp(arg, "--output") == 0) {
+            options.trajectory_output = value;
+        } else if(strcmp(arg, "--first") == 0) {
+            options.first = strtoull(value, nullptr, 10);
+        } else if(strcmp(arg, "--count") == 0) {
+            options.count = strtoull(value, nullptr, 10);
+        } else if(strcmp(arg, "--period") == 0) {
+            options.frame_period = atof(value);
+        } else if(strcmp(arg, "--method") == 0) {
+            options.odom.method = atoi(value);
+        } else if(strcmp(arg, "--write-features") == 0) {
+            options.feature_cache_output = value;
+        } else if(strcmp(arg, "--features") == 0) {
+            options.feature_cache = value;
+        } else if(strcmp(arg, "--trace") == 0) {
+            trace_output = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(options.velodyne_dir.empty() == options.feature_cache.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    trace_enable(!trace_output.empty());
+
+    auto result = run_offline(options);
+    if(!result.ok()) {
+        printf("offline run failed: %s\r\n", result.error().c_str());
+        return 1;
+    }
+
+    print_offline_report(stdout, result.value());
+    printf("%s", metrics_summary().c_str());
+
+    if(!trace_output.empty() && !trace_export_chrome(trace_output)) {
+        printf("cannot write trace to %s\r\n", trace_output.c_str());
+    }
+    return 0;
+}
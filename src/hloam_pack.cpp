@@ -0,0 +1,194 @@
+#include "offline.h"
+#include "scan_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <pcl_conversions/pcl_conversions.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/PointCloud2.h>
+
+// Packs scans into <out>/velodyne.scans and <out>/livox.scans, which hloam_offline and loop_test
+// take in place of the scan directories.
+
+static void usage(const char* name) {
+    printf("Usage: %s --out <dir> (--velodyne <dir> [--livox <dir>] | --bag <file>)\r\n"
+           "  --velodyne <dir>         velodyne scans, *.pcd or KITTI *.bin\r\n"
+           "  --livox <dir>            livox scans (*.pcd)\r\n"
+           "  --bag <file>             recorded driver topics\r\n"
+           "  --velodyne-topic <name>  (/u2102)\r\n"
+           "  --livox-topic <name>     (/livox_hap), empty for none\r\n",
+           name);
+}
+
+struct bag_sweep {
+    pcl::PointCloud<PointType>::Ptr cloud;
+    double start, end;
+};
+
+// absolute sweep bounds; drivers stamp points either absolute or relative to the message
+static bag_sweep make_sweep(const pcl::PointCloud<PointType>::Ptr& cloud, double stamp) {
+    auto var = std::minmax_element(
+        cloud->begin(), cloud->end(),
+        [](const PointType& a, const PointType& b) { return a.time < b.time; });
+
+    double offset = var.first->time < 1.0 ? stamp : 0.0;
+    return { cloud, var.first->time + offset, var.second->time + offset };
+}
+
+// Pairs each velodyne sweep with the livox points that fall inside it, the way sync_node does
+// online, so the packed frames match what the feature thread would have received.
+static result_of<size_t, std::string> pack_bag(const std::string& filename,
+                                               const std::string& velodyne_topic,
+                                               const std::string& livox_topic,
+                                               const std::string& out) {
+    rosbag::Bag bag;
+    try {
+        bag.open(filename, rosbag::bagmode::Read);
+    } catch(const rosbag::BagException&) {
+        return fail("cannot open " + filename);
+    }
+
+    scan_archive_writer velodyne, livox;
+    if(!velodyne.open(out + "/velodyne.scans"))
+        return fail("cannot write " + out + "/velodyne.scans");
+    if(!livox_topic.empty() && !livox.open(out + "/livox.scans"))
+        return fail("cannot write " + out + "/livox.scans");
+
+    std::vector<std::string> topics = { velodyne_topic };
+    if(!livox_topic.empty())
+        topics.push_back(livox_topic);
+
+    std::deque<bag_sweep> sweeps;
+    std::vector<PointType> livox_points; // sorted by time
+    size_t frames = 0;
+    bool written = true;
+
+    auto flush = [&]() {
+        while(!sweeps.empty()) {
+            auto& sweep = sweeps.front();
+            if(livox_topic.empty()) {
+                written = written && velodyne.append(sweep.start, *sweep.cloud);
+                frames++;
+                sweeps.pop_front();
+                continue;
+            }
+
+            if(livox_points.empty() || livox_points.back().time < sweep.end)
+                return;
+
+            auto by_time = [](const PointType& p, double t) { return p.time < t; };
+            auto first = std::lower_bound(livox_points.begin(), livox_points.end(), sweep.start,
+                                          by_time);
+            auto last = std::lower_bound(first, livox_points.end(), sweep.end, by_time);
+
+            // sweeps older than the first livox point have nothing to pair with
+            if(first != livox_points.begin() || livox_points.front().time <= sweep.start) {
+                const PointType* points = livox_points.data() + (first - livox_points.begin());
+                written = written && velodyne.append(sweep.start, *sweep.cloud) &&
+                          livox.append(sweep.start, points, last - first);
+                frames++;
+            }
+
+            livox_points.erase(livox_points.begin(), last);
+            sweeps.pop_front();
+        }
+    };
+
+    for(const rosbag::MessageInstance& m: rosbag::View(bag, rosbag::TopicQuery(topics))) {
+        auto msg = m.instantiate<sensor_msgs::PointCloud2>();
+        if(msg == nullptr)
+            continue;
+
+        auto cloud = acquire_cloud();
+        pcl::fromROSMsg(*msg, *cloud);
+        if(cloud->empty())
+            continue;
+
+        if(m.getTopic() == velodyne_topic) {
+            sweeps.push_back(make_sweep(cloud, msg->header.stamp.toSec()));
+        } else {
+            size_t middle = livox_points.size();
+            livox_points.insert(livox_points.end(), cloud->points.begin(), cloud->points.end());
+            auto by_time = [](const PointType& a, const PointType& b) { return a.time < b.time; };
+            std::sort(livox_points.begin() + middle, livox_points.end(), by_time);
+            std::inplace_merge(livox_points.begin(), livox_points.begin() + middle,
+                               livox_points.end(), by_time);
+        }
+        flush();
+        if(!written)
+            return fail("cannot write to " + out);
+    }
+    bag.close();
+
+    if(!velodyne.close() || (!livox_topic.empty() && !livox.close()))
+        return fail("cannot write to " + out);
+    return ok(frames);
+}
+
+int main(int argc, const char* const* argv) {
+    if(argc % 2 == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    offline_options options;
+    std::string out, bag, velodyne_topic = "/u2102", livox_topic = "/livox_hap";
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if(strcmp(arg, "--out") == 0) {
+            out = value;
+        } else if(strcmp(arg, "--velodyne") == 0) {
+            options.velodyne_dir = value;
+        } else if(strcmp(arg, "--livox") == 0) {
+            options.livox_dir = value;
+        } else if(strcmp(arg, "--bag") == 0) {
+            bag = value;
+        } else if(strcmp(arg, "--velodyne-topic") == 0) {
+            velodyne_topic = value;
+        } else if(strcmp(arg, "--livox-topic") == 0) {
+            livox_topic = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(out.empty() || bag.empty() == options.velodyne_dir.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::filesystem::create_directories(out);
+
+    if(!bag.empty()) {
+        auto packed = pack_bag(bag, velodyne_topic, livox_topic, out);
+        if(!packed.ok()) {
+            printf("%s\r\n", packed.error().c_str());
+            return 1;
+        }
+        printf("%zd frames packed from %s\r\n", packed.value(), bag.c_str());
+        return 0;
+    }
+
+    auto packed = pack_scans(options.velodyne_dir, options, out + "/velodyne.scans");
+    if(!packed.ok()) {
+        printf("%s\r\n", packed.error().c_str());
+        return 1;
+    }
+    printf("%zd velodyne frames packed\r\n", packed.value());
+
+    if(!options.livox_dir.empty()) {
+        auto packed_livox = pack_scans(options.livox_dir, options, out + "/livox.scans");
+        if(!packed_livox.ok()) {
+            printf("%s\r\n", packed_livox.error().c_str());
+            return 1;
+        }
+        printf("%zd livox frames packed\r\n", packed_livox.value());
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "odometry.h"
+#include "synthetic.h"
+
+#include <cstring>
+#include <filesystem>
+
+// Writes <out>/velodyne/<stamp>.pcd, <out>/livox/<stamp>.pcd and <out>/ground_truth.txt (TUM),
+// which hloam_offline reads as
+//   hloam_offline --velodyne <out>/velodyne --livox <out>/livox --gt <out>/ground_truth.txt
+
+static void usage(const char* name) {
+    printf("Usage: %s --out <dir> [options]\r\n"
+           "  --scene corridor|urban|field   (urban)\r\n"
+           "  --trajectory straight|loop     (straight)\r\n"
+           "  --rings 16|32|64               (16)\r\n"
+           "  --frames <n>                   (300)\r\n"
+           "  --speed <m/s>                  (5, 1 in a corridor)\r\n"
+           "  --livox-points <n>             per frame, 0 for no livox (45000)\r\n"
+           "  --seed <n>                     (1)\r\n",
+           name);
+}
+
+int main(int argc, const char* const* argv) {
+    if(argc % 2 == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string out, scene_name = "urban", trajectory_name = "straight";
+    int rings = 16, frames = 300;
+    double speed = 0.0;
+    size_t livox_points = 45000;
+    unsigned seed = 1;
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if(strcmp(arg, "--out") == 0) {
+            out = value;
+        } else if(strcmp(arg, "--scene") == 0) {
+            scene_name = value;
+        } else if(strcmp(arg, "--trajectory") == 0) {
+            trajectory_name = value;
+        } else if(strcmp(arg, "--rings") == 0) {
+            rings = atoi(value);
+        } else if(strcmp(arg, "--frames") == 0) {
+            frames = atoi(value);
+        } else if(strcmp(arg, "--speed") == 0) {
+            speed = atof(value);
+        } else if(strcmp(arg, "--livox-points") == 0) {
+            livox_points = strtoull(value, nullptr, 10);
+        } else if(strcmp(arg, "--seed") == 0) {
+            seed = strtoul(value, nullptr, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    synthetic_scene_kind kind;
+    if(scene_name == "corridor") {
+        kind = SCENE_CORRIDOR;
+    } else if(scene_name == "urban") {
+        kind = SCENE_URBAN_CANYON;
+    } else if(scene_name == "field") {
+        kind = SCENE_OPEN_FIELD;
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(out.empty() || (rings != 16 && rings != 32 && rings != 64) || frames <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    synthetic_trajectory trajectory;
+    trajectory.kind = trajectory_name == "loop" ? TRAJECTORY_LOOP : TRAJECTORY_STRAIGHT;
+    trajectory.speed = speed > 0.0 ? speed : kind == SCENE_CORRIDOR ? 1.0 : 5.0;
+
+    spinning_model velodyne = make_spinning_model(rings);
+    livox_model livox;
+    livox.points = livox_points;
+
+    double duration = frames * velodyne.period;
+    auto scene = make_scene(kind, trajectory, duration, seed);
+    printf("scene: %zd boxes, %zd poles\r\n", scene.boxes.size(), scene.poles.size());
+
+    std::filesystem::create_directories(out + "/velodyne");
+    if(livox_points > 0)
+        std::filesystem::create_directories(out + "/livox");
+
+    // stamps that look like sensor time, so the offline runner picks them up from the names
+    constexpr double epoch = 1600000000.0;
+
+    nav_msgs::Path truth;
+    std::mt19937 rng(seed);
+    char filename[512];
+    for(int i = 0; i < frames; i++) {
+        double t = i * velodyne.period;
+
+        auto cloud = scan_spinning(scene, trajectory, velodyne, t, rng);
+        sprintf(filename, "%s/velodyne/%.6f.pcd", out.c_str(), epoch + t);
+        pcl::io::savePCDFileBinary(filename, *cloud);
+
+        if(livox_points > 0) {
+            auto livox_cloud = scan_livox(scene, trajectory, livox, t, rng);
+            sprintf(filename, "%s/livox/%.6f.pcd", out.c_str(), epoch + t);
+            pcl::io::savePCDFileBinary(filename, *livox_cloud);
+        }
+
+        geometry_msgs::PoseStamped pose;
+        pose.header.stamp = ros::Time(epoch + t);
+        pose.pose = to_ros_pose(trajectory.pose(t));
+        truth.poses.push_back(pose);
+
+        if((i + 1) % 50 == 0)
+            printf("%d/%d frames\r\n", i + 1, frames);
+    }
+
+    if(!save_tum(truth, out + "/ground_truth.txt")) {
+        printf("cannot write %s/ground_truth.txt\r\n", out.c_str());
+        return 1;
+    }
+    return 0;
+}
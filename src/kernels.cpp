@@ -0,0 +1,57 @@
+#include "kernels.h"
+
+#include "cloud.h"
+#include "log.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+static_assert(sizeof(kernel_point) == sizeof(PointType), "kernel_point must mirror XYZIRT");
+static_assert(offsetof(kernel_point, x) == offsetof(PointType, x), "kernel_point.x");
+static_assert(offsetof(kernel_point, intensity) == offsetof(PointType, intensity),
+              "kernel_point.intensity");
+static_assert(offsetof(kernel_point, ring) == offsetof(PointType, ring), "kernel_point.ring");
+static_assert(offsetof(kernel_point, time) == offsetof(PointType, time), "kernel_point.time");
+static_assert(sizeof(quantized_point) == 8, "quantized_point must stay packed");
+
+extern const kernel_table kernels_default;
+#ifdef HLOAM_KERNELS_X86
+extern const kernel_table kernels_avx2;
+extern const kernel_table kernels_avx512;
+#endif
+
+static const kernel_table& select_kernels() {
+    const kernel_table* candidates[3] = { &kernels_default };
+    int count = 1;
+
+#ifdef HLOAM_KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        candidates[count++] = &kernels_avx2;
+    if(count == 2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+       __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw"))
+        candidates[count++] = &kernels_avx512;
+#endif
+
+    const kernel_table* selected = candidates[count - 1];
+
+    const char* forced = getenv("HLOAM_ISA");
+    if(forced != nullptr && *forced != '\0') {
+        int i = 0;
+        while(i < count && strcmp(candidates[i]->isa, forced) != 0)
+            i++;
+        if(i < count)
+            selected = candidates[i];
+        else
+            HLOAM_WARN("HLOAM_ISA=%s is not supported here, using %s", forced, selected->isa);
+    }
+
+    HLOAM_INFO("kernels: %s", selected->isa);
+    return *selected;
+}
+
+const kernel_table& kernels() {
+    static const kernel_table& table = select_kernels();
+    return table;
+}
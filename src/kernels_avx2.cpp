@@ -0,0 +1,4 @@
+// built with the avx2 flags from CMakeLists.txt
+#define KERNEL_ISA avx2
+#define KERNEL_TABLE kernels_avx2
+#include "kernels_impl.h"
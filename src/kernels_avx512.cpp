@@ -0,0 +1,4 @@
+// built with the avx512 flags from CMakeLists.txt
+#define KERNEL_ISA avx512
+#define KERNEL_TABLE kernels_avx512
+#include "kernels_impl.h"
@@ -0,0 +1,4 @@
+// baseline x86-64, and the only variant on other architectures
+#define KERNEL_ISA default
+#define KERNEL_TABLE kernels_default
+#include "kernels_impl.h"
@@ -0,0 +1,253 @@
+// Body of every kernel variant: included once by each src/kernels_<isa>.cpp, which defines
+// KERNEL_TABLE and is compiled with that ISA's flags.
+//
+// Nothing here may use a function defined in a header (no std::, no Eigen): an out-of-line copy
+// of such a function compiled for AVX-512 could be the one the linker keeps for the whole
+// binary. All functions are static for the same reason, and the math is __builtin_*.
+//
+// Variants are built with -ffp-contract=off and reductions are split into a fixed number of
+// lanes, so every variant returns bit-identical results and the pipeline behaves the same on
+// every machine; the wider ISAs only get there faster.
+
+#include "kernels.h"
+
+#ifndef KERNEL_TABLE
+#error "define KERNEL_TABLE before including kernels_impl.h"
+#endif
+
+#define KERNEL_STRINGIFY2(x) #x
+#define KERNEL_STRINGIFY(x) KERNEL_STRINGIFY2(x)
+
+static constexpr int kernel_lanes = 8;
+
+static void transform_points(kernel_point* points, size_t count, const double m[12]) {
+    for(size_t i = 0; i < count; i++) {
+        double x = points[i].x, y = points[i].y, z = points[i].z;
+        points[i].x = float(m[0] * x + m[1] * y + m[2] * z + m[3]);
+        points[i].y = float(m[4] * x + m[5] * y + m[6] * z + m[7]);
+        points[i].z = float(m[8] * x + m[9] * y + m[10] * z + m[11]);
+    }
+}
+
+static void range_curvature(const kernel_point* points, size_t count, float* range,
+                            float* curvature) {
+    for(size_t i = 0; i < count; i++) {
+        float d = points[i].x * points[i].x + points[i].y * points[i].y + points[i].z * points[i].z;
+        range[i] = __builtin_sqrtf(d);
+    }
+
+    // same summation order as the scalar loop this replaced
+    for(size_t i = 5; i + 5 < count; i++) {
+        float curv = range[i - 5] + range[i - 4] + range[i - 3] + range[i - 2] + range[i - 1] -
+            range[i] * 10 + range[i + 1] + range[i + 2] + range[i + 3] + range[i + 4] +
+            range[i + 5];
+        curvature[i] = curv * curv;
+    }
+}
+
+static void normal_equations(const double* A, size_t ld, const double* b, size_t rows,
+                             double ATA[36], double ATb[6]) {
+    // 21 upper-triangle products and 6 right-hand sides, each summed in kernel_lanes lanes
+    double acc[27][kernel_lanes] = {};
+
+    size_t r = 0;
+    for(; r + kernel_lanes <= rows; r += kernel_lanes) {
+        int e = 0;
+        for(int j = 0; j < 6; j++) {
+            const double* cj = A + j * ld + r;
+            for(int k = j; k < 6; k++, e++) {
+                const double* ck = A + k * ld + r;
+                for(int l = 0; l < kernel_lanes; l++) {
+                    acc[e][l] += cj[l] * ck[l];
+                }
+            }
+            for(int l = 0; l < kernel_lanes; l++) {
+                acc[21 + j][l] += cj[l] * b[r + l];
+            }
+        }
+    }
+
+    for(int l = 0; r < rows; r++, l++) {
+        int e = 0;
+        for(int j = 0; j < 6; j++) {
+            for(int k = j; k < 6; k++, e++) {
+                acc[e][l] += A[j * ld + r] * A[k * ld + r];
+            }
+            acc[21 + j][l] += A[j * ld + r] * b[r];
+        }
+    }
+
+    double sum[27];
+    for(int e = 0; e < 27; e++) {
+        sum[e] = 0.0;
+        for(int l = 0; l < kernel_lanes; l++) {
+            sum[e] += acc[e][l];
+        }
+    }
+
+    int e = 0;
+    for(int j = 0; j < 6; j++) {
+        for(int k = j; k < 6; k++, e++) {
+            ATA[j * 6 + k] = ATA[k * 6 + j] = sum[e];
+        }
+        ATb[j] = sum[21 + j];
+    }
+}
+
+static void column_products(const double* c1, const double* c2, int rows, double* dot,
+                            double* norm1, double* norm2) {
+    double d[kernel_lanes] = {}, n1[kernel_lanes] = {}, n2[kernel_lanes] = {};
+
+    int r = 0;
+    for(; r + kernel_lanes <= rows; r += kernel_lanes) {
+        for(int l = 0; l < kernel_lanes; l++) {
+            d[l] += c1[r + l] * c2[r + l];
+            n1[l] += c1[r + l] * c1[r + l];
+            n2[l] += c2[r + l] * c2[r + l];
+        }
+    }
+    for(int l = 0; r < rows; r++, l++) {
+        d[l] += c1[r] * c2[r];
+        n1[l] += c1[r] * c1[r];
+        n2[l] += c2[r] * c2[r];
+    }
+
+    *dot = *norm1 = *norm2 = 0.0;
+    for(int l = 0; l < kernel_lanes; l++) {
+        *dot += d[l];
+        *norm1 += n1[l];
+        *norm2 += n2[l];
+    }
+}
+
+static double sc_distance(const double* sc1, const double* sc2, int rows, int cols, int shift) {
+    int num_eff_cols = 0;
+    double sum_sector_similarity = 0.0;
+    for(int col = 0; col < cols; col++) {
+        // column col of sc2 shifted right by shift
+        int source = ((col - shift) % cols + cols) % cols;
+
+        double dot, norm1, norm2;
+        column_products(sc1 + col * rows, sc2 + source * rows, rows, &dot, &norm1, &norm2);
+        if(norm1 == 0.0 || norm2 == 0.0)
+            continue;
+
+        sum_sector_similarity += dot / (__builtin_sqrt(norm1) * __builtin_sqrt(norm2));
+        num_eff_cols++;
+    }
+
+    return 1.0 - sum_sector_similarity / num_eff_cols;
+}
+
+static void voxel_coords(const kernel_point* points, size_t count, float inverse_leaf,
+                         std::int32_t* ijk) {
+    for(size_t i = 0; i < count; i++) {
+        ijk[3 * i + 0] = std::int32_t(__builtin_floorf(points[i].x * inverse_leaf));
+        ijk[3 * i + 1] = std::int32_t(__builtin_floorf(points[i].y * inverse_leaf));
+        ijk[3 * i + 2] = std::int32_t(__builtin_floorf(points[i].z * inverse_leaf));
+    }
+}
+
+static size_t crop_points(kernel_point* points, size_t count, const kernel_roi* roi) {
+    // the tests fill a chunk's mask with straight-line code the compiler vectorizes; compacting
+    // the chunk only writes at or below the points it reads
+    constexpr size_t chunk = 256;
+    unsigned char keep[chunk];
+
+    // decoded points seen per ring, so stride thins each ring along its azimuth whatever order
+    // the rings were decoded in; rings past 255 share counters
+    std::uint32_t seen[256];
+    if(roi->stride > 1) {
+        for(auto& n: seen)
+            n = 0;
+    }
+
+    size_t kept = 0;
+    for(size_t base = 0; base < count; base += chunk) {
+        size_t n = count - base < chunk ? count - base : chunk;
+        const kernel_point* p = points + base;
+
+        for(size_t i = 0; i < n; i++) {
+            float x = p[i].x, y = p[i].y, z = p[i].z;
+            float r2 = x * x + y * y + z * z;
+            bool in = (r2 >= roi->min_range2) & (r2 <= roi->max_range2) &
+                (x >= roi->box_min[0]) & (x <= roi->box_max[0]) & (y >= roi->box_min[1]) &
+                (y <= roi->box_max[1]) & (z >= roi->box_min[2]) & (z <= roi->box_max[2]);
+
+            bool after_start = roi->sector_start[0] * y - roi->sector_start[1] * x >= 0.0f;
+            bool before_end = x * roi->sector_end[1] - y * roi->sector_end[0] >= 0.0f;
+            bool in_sector = (roi->sector_mode == 0) |
+                ((roi->sector_mode == 1) & after_start & before_end) |
+                ((roi->sector_mode == 2) & (after_start | before_end));
+
+            keep[i] = in & in_sector;
+        }
+
+        for(int b = 0; b < roi->exclude_count; b++) {
+            const float* box = roi->exclude[b];
+            for(size_t i = 0; i < n; i++) {
+                bool inside = (p[i].x >= box[0]) & (p[i].x <= box[3]) & (p[i].y >= box[1]) &
+                    (p[i].y <= box[4]) & (p[i].z >= box[2]) & (p[i].z <= box[5]);
+                keep[i] &= !inside;
+            }
+        }
+
+        if(roi->stride > 1) {
+            for(size_t i = 0; i < n; i++) {
+                keep[i] &= seen[p[i].ring & 255]++ % roi->stride == 0;
+            }
+        }
+
+        for(size_t i = 0; i < n; i++) {
+            points[kept] = p[i];
+            kept += keep[i];
+        }
+    }
+    return kept;
+}
+
+static std::int16_t quantize(float offset, float inverse_resolution) {
+    float q = __builtin_floorf(offset * inverse_resolution + 0.5f);
+    q = q < -32767.0f ? -32767.0f : q;
+    q = q > 32767.0f ? 32767.0f : q;
+    return std::int16_t(q);
+}
+
+static void quantize_points(const kernel_point* points, size_t count, const float origin[3],
+                            float inverse_resolution, quantized_point* out) {
+    for(size_t i = 0; i < count; i++) {
+        float intensity = __builtin_floorf(points[i].intensity + 0.5f);
+        intensity = intensity < 0.0f ? 0.0f : intensity;
+        intensity = intensity > 255.0f ? 255.0f : intensity;
+
+        out[i].x = quantize(points[i].x - origin[0], inverse_resolution);
+        out[i].y = quantize(points[i].y - origin[1], inverse_resolution);
+        out[i].z = quantize(points[i].z - origin[2], inverse_resolution);
+        out[i].intensity = std::uint8_t(intensity);
+        out[i].reserved = 0;
+    }
+}
+
+static void dequantize_points(const quantized_point* points, size_t count, const float origin[3],
+                              float resolution, const double m[12], kernel_point* out) {
+    for(size_t i = 0; i < count; i++) {
+        double x = origin[0] + points[i].x * resolution;
+        double y = origin[1] + points[i].y * resolution;
+        double z = origin[2] + points[i].z * resolution;
+
+        kernel_point p = {};
+        p.x = float(m[0] * x + m[1] * y + m[2] * z + m[3]);
+        p.y = float(m[4] * x + m[5] * y + m[6] * z + m[7]);
+        p.z = float(m[8] * x + m[9] * y + m[10] * z + m[11]);
+        p.w = 1.0f;
+        p.intensity = points[i].intensity;
+        out[i] = p;
+    }
+}
+
+extern const kernel_table KERNEL_TABLE;
+const kernel_table KERNEL_TABLE = {
+    KERNEL_STRINGIFY(KERNEL_ISA), transform_points, range_curvature,
+    normal_equations,             sc_distance,      voxel_coords,
+    crop_points,                  quantize_points,  dequantize_points,
+};
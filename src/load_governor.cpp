@@ -0,0 +1,43 @@
+#include "load_governor.h"
+
+#include "metrics.h"
+
+load_governor::load_governor(const load_governor_config& config): config(config) {
+}
+
+int load_governor::update(double lag) {
+    static auto& level_gauge = metrics_gauge("load.level");
+    static auto& lag_gauge = metrics_gauge("load.lag");
+    lag_gauge.set(lag);
+
+    if(!config.enable)
+        return current;
+
+    while(current < max_level && lag > config.thresholds[current])
+        current++;
+    while(current > 0 && lag < config.recover * config.thresholds[current - 1])
+        current--;
+
+    level_gauge.set(current);
+    return current;
+}
+
+registration_quality load_governor::quality() const {
+    registration_quality quality;
+    if(current >= 1)
+        quality.lm_iterations = config.lm_iterations;
+    if(current >= 2)
+        quality.downsample_leaf = config.leaf;
+    if(current >= 3)
+        quality.loop_search = false;
+    return quality;
+}
+
+bool load_governor::skip(size_t queued) {
+    static auto& frames_shed = metrics_counter("frames_shed");
+    // the newest frame is always mapped, so the pose keeps up with the sensors
+    bool shed = current >= max_level && queued > 1;
+    if(shed)
+        frames_shed.add();
+    return shed;
+}
@@ -0,0 +1,26 @@
+#include "log.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+static log_handler handler = nullptr;
+
+void set_log_handler(log_handler h) {
+    handler = h;
+}
+
+void log_printf(log_level level, const char* format, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if(handler != nullptr) {
+        handler(level, message);
+        return;
+    }
+
+    static const char* prefixes[] = { "INFO", "WARN", "ERROR" };
+    fprintf(stderr, "[%s] %s\n", prefixes[level], message);
+}
@@ -1,6 +1,8 @@
 #include "loop.h"
 
+#include "metrics.h"
 #include "residual.h"
+#include "trace.h"
 
 #include <gtsam/nonlinear/ISAM2.h>
 #include <gtsam/slam/BetweenFactor.h>
@@ -28,34 +30,7 @@ static Eigen::Matrix4d to_eigen(const gtsam::Pose3& tr) {
 
 static void downsample_surf2(const pcl::PointCloud<PointType>::Ptr& surface_points,
                              pcl::PointCloud<PointType>& downsampled_surface_points) {
-    static pcl::VoxelGrid<PointType> downSizeFilter;
-    downSizeFilter.setInputCloud(surface_points);
-    downSizeFilter.setLeafSize(0.4, 0.4, 0.4);
-    downSizeFilter.filter(downsampled_surface_points);
-}
-
-inline feature_objects downsample(const feature_objects& input) {
-    feature_objects result;
-    if(input.line_features != nullptr) {
-        result.line_features.reset(new pcl::PointCloud<PointType>());
-        downsample_surf2(input.line_features, *result.line_features);
-    }
-    if(input.plane_features != nullptr) {
-        result.plane_features.reset(new pcl::PointCloud<PointType>());
-        downsample_surf2(input.plane_features, *result.plane_features);
-    }
-    if(input.non_features != nullptr) {
-        result.non_features.reset(new pcl::PointCloud<PointType>());
-        downsample_surf2(input.non_features, *result.non_features);
-    }
-    return result;
-}
-
-inline feature_frame downsample(const feature_frame& input) {
-    feature_frame result;
-    result.velodyne_feature = downsample(input.velodyne_feature);
-    result.livox_feature = downsample(input.livox_feature);
-    return result;
+    voxel_downsample(*surface_points, 0.4f, downsampled_surface_points);
 }
 
 static void dump_features(const feature_objects& f, const char* filename) {
@@ -77,13 +52,47 @@ static void dump_features(const feature_objects& f, const char* filename) {
     }
 }
 
+Eigen::Matrix4d loop_icp(const pcl::PointCloud<PointType>::Ptr& source,
+                         const pcl::PointCloud<PointType>::Ptr& target, float yaw, float* loss) {
+    if(yaw > M_PI)
+        yaw -= M_PI * 2.0;
+
+    pcl::IterativeClosestPoint<PointType, PointType> icp;
+    icp.setInputSource(source);
+    icp.setInputTarget(target);
+    icp.setMaximumIterations(100);
+    icp.setTransformationEpsilon(1e-6);
+    icp.setMaxCorrespondenceDistance(0.5);
+
+    Eigen::Matrix4f init_tr = Eigen::Matrix4f::Identity();
+    init_tr.block<3, 3>(0, 0) =
+        Eigen::AngleAxisf(-yaw, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+
+    pcl::PointCloud<PointType> final;
+    {
+        TRACE_SCOPE("loop.icp");
+        icp.align(final, init_tr);
+    }
+
+    if(loss != nullptr)
+        *loss = icp.getFitnessScore();
+    return icp.getFinalTransformation().cast<double>();
+}
+
 loop_var::loop_var(): loop_counter(loop_reset) {
 }
 
 size_t loop_var::loop_detection(const pcl::PointCloud<XYZIRT>::Ptr& cloud,
-                                const feature_objects& frame, const Eigen::Matrix4d& transform) {
-    sc_manager.makeAndSaveScancontextAndKeys(*cloud);
-    frames.push_back({ cloud, transform });
+                                const feature_objects& frame, const Eigen::Matrix4d& transform,
+                                bool search) {
+    {
+        TRACE_SCOPE("loop.sc_make");
+        sc_manager.makeAndSaveScancontextAndKeys(*cloud);
+    }
+    frames.push_back({ nullptr, transform });
+
+    if(!search)
+        return NO_LOOP;
 
     if(loop_counter > 0) {
         loop_counter--;
@@ -92,7 +101,14 @@ size_t loop_var::loop_detection(const pcl::PointCloud<XYZIRT>::Ptr& cloud,
 
     loop_counter = loop_reset;
 
-    auto [id, yaw] = sc_manager.detectLoopClosureID();
+    static auto& attempts = metrics_counter("loop.attempts");
+    static auto& accepts = metrics_counter("loop.accepts");
+    attempts.add();
+
+    auto [id, yaw] = [this] {
+        TRACE_SCOPE("loop.sc_search");
+        return sc_manager.detectLoopClosureID();
+    }();
 
     if(id == -1) {
         return NO_LOOP;
@@ -110,40 +126,23 @@ size_t loop_var::loop_detection(const pcl::PointCloud<XYZIRT>::Ptr& cloud,
         end_index = frames.size() - 1;
     }
 
-    pcl::PointCloud<XYZIRT>::Ptr local_map(new pcl::PointCloud<XYZIRT>);
-    pcl::PointCloud<XYZIRT>::Ptr transformed(new pcl::PointCloud<XYZIRT>);
+    auto local_map = acquire_cloud();
+    auto transformed = acquire_cloud();
 
     Eigen::Matrix4d tr = frames[id].transform.inverse();
 
+    // the frame being detected has no scan yet; candidates are never that recent anyway
     for(int i = start_index; i <= end_index; i++) {
         auto& frame = frames[i];
-        Eigen::Matrix4d this_tr = tr * frame.transform;
-        pcl::transformPointCloud(*frame.velodyne_cloud, *transformed, this_tr);
-        *local_map += *transformed;
+        if(frame.velodyne_cloud != nullptr)
+            frame.velodyne_cloud->decode(tr * frame.transform, *local_map);
     }
 
     downsample_surf2(local_map, *local_map);
     downsample_surf2(cloud, *transformed);
 
-    if(yaw > M_PI)
-        yaw -= M_PI * 2.0;
-
-    pcl::IterativeClosestPoint<PointType, PointType> icp;
-    icp.setInputSource(transformed);
-    icp.setInputTarget(local_map);
-    icp.setMaximumIterations(100);
-    icp.setTransformationEpsilon(1e-6);
-    icp.setMaxCorrespondenceDistance(0.5);
-
-    Eigen::Matrix4f init_tr = Eigen::Matrix4f::Identity();
-    init_tr.block<3, 3>(0, 0) =
-        Eigen::AngleAxisf(-yaw, Eigen::Vector3f::UnitZ()).toRotationMatrix();
-
-    pcl::PointCloud<PointType> final;
-    icp.align(final, init_tr);
-
-    Eigen::Matrix4d final_tr = icp.getFinalTransformation().cast<double>();
-    float loss = icp.getFitnessScore();
+    float loss = 0.0f;
+    Eigen::Matrix4d final_tr = loop_icp(transformed, local_map, yaw, &loss);
 
     gtsam::Pose3 from = p(frames[id].transform);
     gtsam::Pose3 to = p(frames[id].transform * final_tr);
@@ -157,6 +156,7 @@ size_t loop_var::loop_detection(const pcl::PointCloud<XYZIRT>::Ptr& cloud,
         from.between(to),
     };
     loop.push_back(r);
+    accepts.add();
 
     if(id < min_constriant_node)
         min_constriant_node = id;
@@ -201,14 +201,39 @@ void loop_var::optimization(size_t from_id) {
         graph.push_back(loop_factor);
     }
 
-    isam.update(graph, initial);
-    auto result = isam.calculateEstimate();
+    gtsam::Values result;
+    {
+        TRACE_SCOPE("loop.isam2");
+        isam.update(graph, initial);
+        result = isam.calculateEstimate();
+    }
+
+    // the graph is rebuilt for every closure and freed afterwards, so this is a transient peak;
+    // factor and pose payloads only, ISAM2's Bayes tree is not counted
+    static auto& graph_bytes = metrics_gauge("memory.gtsam_graph_bytes");
+    graph_bytes.set(graph.size() * sizeof(gtsam::BetweenFactor<gtsam::Pose3>) +
+                    initial.size() * sizeof(gtsam::Pose3));
 
     for(auto&& value: result) {
         frames[value.key].transform = to_eigen(value.value.cast<gtsam::Pose3>());
     }
 }
 
+size_t loop_var::frames_footprint() const {
+    size_t bytes = frames.capacity() * sizeof(velodyne_frame);
+    for(auto&& frame: frames) {
+        if(frame.velodyne_cloud != nullptr)
+            bytes += frame.velodyne_cloud->bytes();
+    }
+    return bytes + loop.capacity() * sizeof(loop_result);
+}
+
+void loop_var::keep_back(const pcl::PointCloud<XYZIRT>& cloud) {
+    TRACE_SCOPE("loop.quantize");
+    frames.back().velodyne_cloud =
+        std::make_shared<const quantized_cloud>(quantized_cloud::fit(cloud));
+}
+
 void loop_var::pop_back() {
     if(!loop.empty() && loop.back().target_frame_id == frames.size() - 1)
         loop.pop_back();
@@ -255,7 +280,6 @@ Eigen::Matrix4d solve_GTSAM(const Eigen::Matrix4d& M1, const Eigen::Matrix4d& M2
     return to_eigen(result.at<gtsam::Pose3>(1));
 }
 
-#include <pcl/filters/impl/voxel_grid.hpp>
 #include <pcl/impl/pcl_base.hpp>
 #include <pcl/kdtree/impl/kdtree_flann.hpp>
 #include <pcl/registration/impl/icp.hpp>
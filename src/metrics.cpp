@@ -0,0 +1,113 @@
+#include "comm.h"
+#include "metrics.h"
+
+#include <ros/ros.h>
+#include <std_msgs/String.h>
+#include <sys/stat.h>
+
+struct metrics_thread {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool should_stop = false;
+
+    ros::Publisher pub_summary;
+
+    double interval = 5.0;
+    double memory_log_interval = 60.0;
+    std::string output;
+    size_t max_file_size = 16 << 20;
+
+    metrics_thread(ros::NodeHandle* nh);
+    ~metrics_thread();
+
+private:
+    void __metrics_thread();
+    void write_snapshot(double time);
+};
+
+void metrics_thread::write_snapshot(double time) {
+    if(output.empty())
+        return;
+
+    // rolling file: once it grows past max_file_size it becomes <output>.1
+    struct stat st;
+    if(stat(output.c_str(), &st) == 0 && (size_t)st.st_size > max_file_size) {
+        std::string rotated = output + ".1";
+        rename(output.c_str(), rotated.c_str());
+    }
+
+    bool fresh = stat(output.c_str(), &st) != 0 || st.st_size == 0;
+    FILE* fp = fopen(output.c_str(), "a");
+    if(fp == nullptr) {
+        ROS_WARN_ONCE("cannot open metrics output %s", output.c_str());
+        return;
+    }
+
+    if(fresh)
+        fputs(metrics_csv_header(), fp);
+    metrics_write_csv(fp, time);
+    fclose(fp);
+}
+
+void metrics_thread::__metrics_thread() {
+    static auto& rss = metrics_gauge("memory.rss_bytes");
+    static auto& pooled = metrics_gauge("memory.cloud_pool_cached");
+
+    auto last_memory_log = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(!should_stop) {
+        cond.wait_for(lock, std::chrono::duration<double>(interval),
+                      [this] { return should_stop; });
+
+        rss.set(metrics_process_rss());
+        pooled.set(cloud_pool().cached());
+
+        write_snapshot(ros::Time::now().toSec());
+
+        auto now = std::chrono::steady_clock::now();
+        if(memory_log_interval > 0.0 &&
+           now - last_memory_log >= std::chrono::duration<double>(memory_log_interval)) {
+            ROS_INFO("%s", metrics_memory_line().c_str());
+            last_memory_log = now;
+        }
+
+        if(pub_summary.getNumSubscribers() > 0) {
+            std_msgs::String msg;
+            msg.data = metrics_summary();
+            pub_summary.publish(msg);
+        }
+    }
+}
+
+metrics_thread::metrics_thread(ros::NodeHandle* nh) {
+    int max_file_mb = 16;
+    nh->param<double>("/hloam/metrics/interval", interval, 5.0);
+    nh->param<std::string>("/hloam/metrics/output", output, "");
+    nh->param<int>("/hloam/metrics/max_file_mb", max_file_mb, 16);
+    // footprint of the long-lived map state in the log; 0 disables
+    nh->param<double>("/hloam/metrics/memory_log_interval", memory_log_interval, 60.0);
+
+    if(interval < 0.1) {
+        ROS_WARN("metrics interval %f too small, using 0.1s", interval);
+        interval = 0.1;
+    }
+    max_file_size = size_t(max_file_mb) << 20;
+
+    pub_summary = nh->advertise<std_msgs::String>("/hloam/metrics", 10);
+    thread = std::thread(&metrics_thread::__metrics_thread, this);
+}
+
+metrics_thread::~metrics_thread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        should_stop = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+std::shared_ptr<metrics_thread> create_metrics_thread(ros::NodeHandle* nh) {
+    return std::make_shared<metrics_thread>(nh);
+}
@@ -0,0 +1,703 @@
+#include "odometry.h"
+
+#include "metrics.h"
+#include "residual.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+void remove_degenerate(Eigen::Matrix<double, 6, 6>& ATA, double threshold) {
+    auto eigen = ATA.eigenvalues();
+    bool is_degenerate = false;
+    for(int i = 0; i < 6; i++) {
+        if(eigen(i).real() < threshold) {
+            HLOAM_INFO("degenerate: %f", eigen(i).real());
+            is_degenerate = true;
+            break;
+        }
+    }
+
+    if(is_degenerate) {
+        for(int i = 0; i < 6; i++) {
+            ATA(i, i) += 0.5;
+        }
+    }
+}
+
+void voxel_downsample(const pcl::PointCloud<PointType>& in, float leaf,
+                      pcl::PointCloud<PointType>& out) {
+    // per-thread scratch, kept between calls so a warmed-up call does not allocate
+    static thread_local std::vector<std::int32_t> ijk;
+    static thread_local std::vector<std::pair<std::uint64_t, std::uint32_t>> keys;
+    static thread_local std::vector<PointType, Eigen::aligned_allocator<PointType>> points;
+
+    size_t n = in.size();
+    ijk.resize(3 * n);
+    kernels().voxel_coords(reinterpret_cast<const kernel_point*>(in.points.data()), n,
+                           1.0f / leaf, ijk.data());
+
+    // voxels numbered x-fastest from the bounding box corner, as pcl::VoxelGrid does, so the
+    // output comes out in the same order
+    std::int64_t min[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+    std::int64_t max[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+    for(size_t i = 0; i < n; i++) {
+        const PointType& p = in.points[i];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        for(int k = 0; k < 3; k++) {
+            min[k] = std::min<std::int64_t>(min[k], ijk[3 * i + k]);
+            max[k] = std::max<std::int64_t>(max[k], ijk[3 * i + k]);
+        }
+    }
+    std::uint64_t dx = max[0] - min[0] + 1, dxy = dx * (max[1] - min[1] + 1);
+
+    keys.clear();
+    keys.reserve(n);
+    for(size_t i = 0; i < n; i++) {
+        const PointType& p = in.points[i];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        std::uint64_t key = (ijk[3 * i] - min[0]) + (ijk[3 * i + 1] - min[1]) * dx +
+            (ijk[3 * i + 2] - min[2]) * dxy;
+        keys.emplace_back(key, std::uint32_t(i));
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // built aside, in may be out
+    points.clear();
+    for(size_t i = 0; i < keys.size();) {
+        size_t j = i;
+        double x = 0, y = 0, z = 0, intensity = 0, time = 0;
+        for(; j < keys.size() && keys[j].first == keys[i].first; j++) {
+            const PointType& p = in.points[keys[j].second];
+            x += p.x;
+            y += p.y;
+            z += p.z;
+            intensity += p.intensity;
+            time += p.time;
+        }
+
+        double count = double(j - i);
+        PointType p = in.points[keys[i].second]; // ring of the voxel's first point
+        p.x = float(x / count);
+        p.y = float(y / count);
+        p.z = float(z / count);
+        p.intensity = float(intensity / count);
+        p.time = time / count;
+        points.push_back(p);
+        i = j;
+    }
+
+    out.header = in.header;
+    out.points.assign(points.begin(), points.end()); // no larger than in, fits when in is out
+    out.width = out.points.size();
+    out.height = 1;
+    out.is_dense = true;
+}
+
+void downsample_surf2(const pcl::PointCloud<PointType>::Ptr& surface_points,
+                      pcl::PointCloud<PointType>::Ptr& downsampled_surface_points) {
+    voxel_downsample(*surface_points, 0.2f, *downsampled_surface_points);
+}
+
+feature_objects downsample(const feature_objects& input, float leaf) {
+    feature_objects result;
+    if(input.line_features != nullptr) {
+        result.line_features = acquire_cloud();
+        voxel_downsample(*input.line_features, leaf, *result.line_features);
+    }
+    if(input.plane_features != nullptr) {
+        result.plane_features = acquire_cloud();
+        voxel_downsample(*input.plane_features, leaf, *result.plane_features);
+    }
+    if(input.non_features != nullptr) {
+        result.non_features = acquire_cloud();
+        voxel_downsample(*input.non_features, leaf, *result.non_features);
+    }
+    return result;
+}
+
+feature_frame downsample(const feature_frame& input, float leaf) {
+    TRACE_SCOPE("registration.downsample");
+    feature_frame result;
+    result.velodyne_feature = downsample(input.velodyne_feature, leaf);
+    result.livox_feature = downsample(input.livox_feature, leaf);
+    return result;
+}
+
+Transform LM2(const feature_frame& this_features, const feature_frame& local_maps,
+              float degenerate_threshold, Transform initial, float* loss, int max_iterations) {
+    static auto& iterations = metrics_histogram("lm.iterations", { 1, 2, 3, 5, 8, 13, 21, 30 });
+
+    feature_adapter adap_velodyne(local_maps.velodyne_feature);
+    feature_adapter adap_livox(local_maps.livox_feature);
+
+    if(loss != nullptr) {
+        *loss = 0.0f;
+    }
+
+    newton N;
+    for(int i = 0; i < max_iterations; i++) {
+        TRACE_SCOPE("registration.lm2_iteration");
+
+        float __loss = 0.0f;
+        Ab({ { this_features.velodyne_feature, adap_velodyne },
+             { this_features.livox_feature, adap_livox } },
+           N, initial, &__loss);
+        if(loss != nullptr) {
+            *loss = __loss;
+        }
+
+        if(N.top < 5) {
+            if(loss != nullptr) {
+                *loss = 10000.0f;
+            }
+            iterations.observe(i + 1);
+            return initial;
+        }
+
+        Eigen::Matrix<double, 6, 6> ATA;
+        Eigen::Matrix<double, 6, 1> ATb;
+        normal_equations(N.A, N.b, N.top, ATA, ATb);
+
+        if(i == 0) {
+            remove_degenerate(ATA, degenerate_threshold);
+        }
+
+        Eigen::Matrix<double, 6, 1> delta = ATA.householderQr().solve(ATb);
+
+        Transform tr = initial;
+        tr.x += delta(0);
+        tr.y += delta(1);
+        tr.z += delta(2);
+        tr.roll += delta(3);
+        tr.pitch += delta(4);
+        tr.yaw += delta(5);
+
+        double delta_xyz = p2(delta(0)) + p2(delta(1)) + p2(delta(2));
+        double delta_rpy = p2(delta(3)) + p2(delta(4)) + p2(delta(5));
+
+        initial = tr;
+
+        if(delta_xyz < 1e-7 && delta_rpy < 1e-7) {
+            tr.pitch = tr.roll = 0.0;
+            iterations.observe(i + 1);
+            return tr;
+        }
+    }
+
+    iterations.observe(max_iterations);
+    return initial;
+}
+
+bool feature_ok(const feature_objects& object) {
+    if(object.line_features != nullptr && object.line_features->size() < 10)
+        return false;
+
+    if(object.plane_features != nullptr && object.plane_features->size() < 100)
+        return false;
+
+    if(object.non_features != nullptr && object.non_features->size() < 100)
+        return false;
+
+    return true;
+}
+
+// appends cloud, transformed by matrix, to out
+static void append_transformed(const pcl::PointCloud<PointType>::Ptr& cloud,
+                               const pcl::PointCloud<PointType>::Ptr& out,
+                               const Eigen::Matrix4d& matrix) {
+    size_t offset = out->points.size();
+    out->points.insert(out->points.end(), cloud->points.begin(), cloud->points.end());
+    transform_points(out->points.data() + offset, cloud->size(), matrix);
+}
+
+static void reserve_more(const pcl::PointCloud<PointType>::Ptr& cloud, size_t count) {
+    if(cloud != nullptr)
+        cloud->reserve(cloud->size() + count);
+}
+
+const feature_frame& local_map::get_local_map() {
+    if(local_map_dirty) {
+        TRACE_SCOPE("local_map.rebuild");
+        local_map = update_local_map();
+        local_map_dirty = false;
+
+        static auto& points = metrics_gauge("local_map.points");
+        points.set(size_of(local_map.velodyne_feature.line_features) +
+                   size_of(local_map.velodyne_feature.plane_features) +
+                   size_of(local_map.velodyne_feature.non_features) +
+                   size_of(local_map.livox_feature.line_features) +
+                   size_of(local_map.livox_feature.plane_features) +
+                   size_of(local_map.livox_feature.non_features));
+    }
+    return local_map;
+}
+
+feature_frame local_map::update_local_map() const {
+    assert(counters > 0);
+
+    feature_frame result;
+    concat(result.velodyne_feature, prev_frames[head].velodyne_feature);
+
+    concat(result.livox_feature, prev_frames[head].livox_feature);
+    Eigen::Matrix4d transform = prev_frame_location[head].inverse();
+
+    // size the merged clouds once, so the appends below never reallocate
+    size_t velodyne_line = 0, velodyne_plane = 0, livox_line = 0, livox_plane = 0, livox_non = 0;
+    for(size_t i = 0; i < counters; i++) {
+        velodyne_line += size_of(prev_frames[i].velodyne_feature.line_features);
+        velodyne_plane += size_of(prev_frames[i].velodyne_feature.plane_features);
+        livox_line += size_of(prev_frames[i].livox_feature.line_features);
+        livox_plane += size_of(prev_frames[i].livox_feature.plane_features);
+        livox_non += size_of(prev_frames[i].livox_feature.non_features);
+    }
+    // livox frames without enough edges have no line cloud, the head frame among them
+    if(livox_line > 0 && result.livox_feature.line_features == nullptr)
+        result.livox_feature.line_features = acquire_cloud();
+    reserve_more(result.velodyne_feature.line_features, velodyne_line);
+    reserve_more(result.velodyne_feature.plane_features, velodyne_plane);
+    reserve_more(result.livox_feature.line_features, livox_line);
+    reserve_more(result.livox_feature.plane_features, livox_plane);
+    reserve_more(result.livox_feature.non_features, livox_non);
+
+    for(size_t i = 0; i < counters; i++) {
+        Eigen::Matrix4d this_transform = transform * prev_frame_location[i];
+        if(prev_frames[i].velodyne_feature.line_features) {
+            append_transformed(prev_frames[i].velodyne_feature.line_features,
+                               result.velodyne_feature.line_features, this_transform);
+        }
+
+        if(prev_frames[i].velodyne_feature.plane_features) {
+            append_transformed(prev_frames[i].velodyne_feature.plane_features,
+                               result.velodyne_feature.plane_features, this_transform);
+        }
+
+        if(prev_frames[i].livox_feature.line_features) {
+            append_transformed(prev_frames[i].livox_feature.line_features,
+                               result.livox_feature.line_features, this_transform);
+        }
+
+        if(prev_frames[i].livox_feature.plane_features) {
+            append_transformed(prev_frames[i].livox_feature.plane_features,
+                               result.livox_feature.plane_features, this_transform);
+        }
+
+        if(prev_frames[i].livox_feature.non_features) {
+            append_transformed(prev_frames[i].livox_feature.non_features,
+                               result.livox_feature.non_features, this_transform);
+        }
+    }
+    if(result.velodyne_feature.line_features)
+        result.velodyne_feature.line_features->width =
+            result.velodyne_feature.line_features->points.size();
+    if(result.velodyne_feature.plane_features)
+        result.velodyne_feature.plane_features->width =
+            result.velodyne_feature.plane_features->points.size();
+
+    if(result.livox_feature.line_features)
+        result.livox_feature.line_features->width =
+            result.livox_feature.line_features->points.size();
+
+    if(result.livox_feature.plane_features)
+        result.livox_feature.plane_features->width =
+            result.livox_feature.plane_features->points.size();
+
+    if(result.livox_feature.non_features)
+        result.livox_feature.non_features->width =
+            result.livox_feature.non_features->points.size();
+    return downsample(result);
+}
+
+void local_map::push(const feature_frame& frame, const Eigen::Matrix4d& transform) {
+
+    head = (head + 1) % previous_frame_count;
+
+    if(counters < previous_frame_count)
+        counters++;
+    prev_frames[head] = frame;
+    prev_frame_location[head] = transform;
+    local_map_dirty = true;
+}
+
+void local_map::set(size_t back_index, const Eigen::Matrix4d& transform) {
+    assert(back_index <= counters);
+    if(back_index <= head + 1) {
+        prev_frame_location[head + 1 - back_index] = transform;
+    } else {
+        prev_frame_location[counters + head + 1 - back_index] = transform;
+    }
+}
+
+size_t local_map::window_footprint() const {
+    size_t bytes = 0;
+    for(auto&& frame: prev_frames) {
+        bytes += feature_bytes(frame);
+    }
+    return bytes;
+}
+
+size_t local_map::merged_footprint() const {
+    return feature_bytes(local_map);
+}
+
+geometry_msgs::Pose to_ros_pose(const Eigen::Matrix4d& transform) {
+    geometry_msgs::Pose pose;
+    pose.position.x = transform(0, 3);
+    pose.position.y = transform(1, 3);
+    pose.position.z = transform(2, 3);
+
+    Eigen::Matrix3d rot = transform.block<3, 3>(0, 0);
+    Eigen::Quaterniond qd(rot);
+
+    pose.orientation.x = qd.x();
+    pose.orientation.y = qd.y();
+    pose.orientation.z = qd.z();
+    pose.orientation.w = qd.w();
+
+    return pose;
+}
+
+Eigen::Matrix4d from_ros_pose(const geometry_msgs::Pose& pose) {
+    Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+    m.block<3, 3>(0, 0) = Eigen::Quaterniond(pose.orientation.w, pose.orientation.x,
+                                             pose.orientation.y, pose.orientation.z)
+                              .toRotationMatrix();
+    m(0, 3) = pose.position.x;
+    m(1, 3) = pose.position.y;
+    m(2, 3) = pose.position.z;
+    return m;
+}
+
+bool save_tum(const nav_msgs::Path& traces, const std::string& filename) {
+    FILE* fp = fopen(filename.c_str(), "w");
+    if(fp == nullptr)
+        return false;
+
+    for(auto&& tr: traces.poses) {
+        fprintf(fp, "%lf %lf %lf %lf %lf %lf %lf %lf\r\n", tr.header.stamp.toSec(),
+                tr.pose.position.x, tr.pose.position.y, tr.pose.position.z, tr.pose.orientation.x,
+                tr.pose.orientation.y, tr.pose.orientation.z, tr.pose.orientation.w);
+    }
+    fclose(fp);
+    return true;
+}
+
+visual_odom_v2::visual_odom_v2(const visual_odom_v2_config& _config): config(_config) {
+    loop.loop_counter = config.loop_initial_load;
+    loop.loop_reset = config.loop_reset;
+    loop.loop_max_loss = config.loop_loss;
+
+    final_path.header.frame_id = "map";
+    loop_markers.header.frame_id = "map";
+
+    loop_markers.type = visualization_msgs::Marker::LINE_LIST;
+    loop_markers.action = visualization_msgs::Marker::ADD;
+    loop_markers.ns = "loop_marker";
+    loop_markers.id = 0;
+    loop_markers.pose.orientation.w = 1.0;
+    loop_markers.color.r = 1.0;
+    loop_markers.color.g = 1.0;
+    loop_markers.color.b = 0.0;
+    loop_markers.color.a = 1.0;
+
+    loop_markers.scale.x = 0.1;
+    loop_markers.scale.y = 0.1;
+    loop_markers.scale.z = 0.1;
+
+    memset(&next_initial_guess, 0, sizeof(next_initial_guess));
+}
+
+result_of<Transform, std::string>
+visual_odom_v2::update_current_frame_LM2(const feature_frame& this_features,
+                                         const feature_frame& M) {
+    constexpr float loss_threshold = 0.03f;
+    float loss = 0.0f;
+    Transform Tr = LM2(this_features, M, degenerate_threshold, next_initial_guess, &loss,
+                       quality.lm_iterations);
+
+    static auto& final_loss = metrics_gauge("lm.final_loss");
+    static auto& loss_histogram = metrics_histogram(
+        "lm.final_loss", { 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0 });
+    final_loss.set(loss);
+    loss_histogram.observe(loss);
+    last_loss = loss;
+    /*if(loss > loss_threshold) {
+        // reset initial guess and try again
+        memset(&next_initial_guess, 0, sizeof(next_initial_guess));
+        Tr = LM2(this_features, M, degenerate_threshold, next_initial_guess, &loss);
+    }
+
+    if(loss > loss_threshold) {
+        char buffer[256];
+        sprintf(buffer, "LM loss too large, %f", loss);
+        return fail(buffer);
+    }*/
+
+    next_initial_guess = Tr;
+    return ok(Tr);
+}
+
+result_of<Transform, std::string>
+visual_odom_v2::update_current_frame_GTSAM(const feature_frame& this_features,
+                                           const feature_frame& M) {
+    if(this_features.velodyne_feature.plane_features == nullptr ||
+       this_features.livox_feature.plane_features == nullptr) {
+        HLOAM_WARN_ONCE("GTSAM-Method not available, using LM2-Method");
+        return update_current_frame_LM2(this_features, M);
+    }
+
+    HLOAM_INFO_ONCE("GTSAM-Method enabled");
+
+    float loss_M1 = 0.0f, loss_M2 = 0.0f;
+    Transform tr_livox =
+        LM(this_features.livox_feature, M.livox_feature, next_initial_guess, &loss_M1);
+    Transform tr_v =
+        LM(this_features.velodyne_feature, M.velodyne_feature, next_initial_guess, &loss_M2);
+    last_loss = std::min(loss_M1, loss_M2);
+
+    if(loss_M1 > 1.0f && loss_M2 < 1.0f) {
+        next_initial_guess = tr_v;
+        return ok(tr_v);
+    } else if(loss_M1 < 1.0f && loss_M2 > 1.0f) {
+        next_initial_guess = tr_livox;
+        return ok(tr_livox);
+    } else if(loss_M1 < 1.0f && loss_M2 < 1.0f) {
+        auto M = solve_GTSAM(to_eigen(tr_livox), to_eigen(tr_v), loss_M1, loss_M2);
+        next_initial_guess = from_eigen(M);
+        return ok(next_initial_guess);
+    }
+    static auto& dropped = metrics_counter("frames_dropped.lm_loss");
+    dropped.add();
+    return fail("LM loss too large");
+}
+
+result_of<Transform, std::string>
+visual_odom_v2::update_current_frame(const feature_frame& this_features) {
+    TRACE_SCOPE("registration.frame");
+
+    static auto& dropped_velodyne = metrics_counter("frames_dropped.velodyne_features");
+    static auto& dropped_livox = metrics_counter("frames_dropped.livox_features");
+
+    if(!feature_ok(this_features.velodyne_feature)) {
+        dropped_velodyne.add();
+        return fail("velodyne not enough features");
+    }
+
+    if(!feature_ok(this_features.livox_feature)) {
+        dropped_livox.add();
+        return fail("livox not enough features");
+    }
+
+    auto f_ds = downsample(this_features, quality.downsample_leaf);
+
+    if(local_maps.empty()) {
+        local_maps.push(this_features, initial_pose);
+        return ok(Transform{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 });
+    }
+
+    auto M = local_maps.get_local_map();
+    if(recorder != nullptr && recorder->enabled())
+        last_local_map = M;
+
+    if(config.method == 0)
+        return update_current_frame_LM2(f_ds, M);
+    else
+        return update_current_frame_GTSAM(f_ds, M);
+}
+
+Eigen::Matrix4d visual_odom_v2::loop_detection(const pcl::PointCloud<PointType>::Ptr& cloud,
+                                               const feature_objects& frame,
+                                               const Eigen::Matrix4d& transform, bool* has_loop) {
+    TRACE_SCOPE("loop.detect");
+    size_t result = loop.loop_detection(cloud, frame, transform, quality.loop_search);
+    if(result == NO_LOOP) {
+        if(has_loop != nullptr)
+            *has_loop = false;
+        return transform;
+    }
+
+    if(has_loop != nullptr)
+        *has_loop = true;
+
+    for(size_t i = 1; i <= local_maps.size(); i++) {
+        local_maps.set(i, loop.btr(i));
+    }
+
+    for(size_t i = result; i < final_path.poses.size(); i++) {
+        auto pose = to_ros_pose(loop.tr(i));
+        final_path.poses[i].pose = pose;
+    }
+
+    update_loop_markers();
+    return loop.btr(1);
+}
+
+void visual_odom_v2::update_loop_markers() {
+    loop_markers.points.clear();
+    for(auto&& r: loop.loop) {
+        geometry_msgs::Point p1, p2;
+        p1.x = loop.tr(r.source_frame_id)(0, 3);
+        p1.y = loop.tr(r.source_frame_id)(1, 3);
+        p1.z = loop.tr(r.source_frame_id)(2, 3);
+
+        p2.x = loop.tr(r.target_frame_id)(0, 3);
+        p2.y = loop.tr(r.target_frame_id)(1, 3);
+        p2.z = loop.tr(r.target_frame_id)(2, 3);
+
+        loop_markers.points.push_back(p1);
+        loop_markers.points.push_back(p2);
+    }
+}
+
+void visual_odom_v2::set_initial_pose(const Eigen::Matrix4d& pose) {
+    assert(local_maps.empty());
+    initial_pose = pose;
+    prev_transform = pose;
+    tracked_pose = pose;
+}
+
+std::optional<Eigen::Matrix4d> visual_odom_v2::track(const feature_objects& livox,
+                                                     ros::Time time) {
+    TRACE_SCOPE("registration.micro_sweep");
+    static auto& dropped = metrics_counter("frames_dropped.micro_sweep");
+
+    if(local_maps.empty() || livox.plane_features == nullptr || !feature_ok(livox)) {
+        dropped.add();
+        return std::nullopt;
+    }
+
+    feature_frame frame;
+    frame.livox_feature = downsample(livox, quality.downsample_leaf);
+
+    float loss = 0.0f;
+    Transform initial = from_eigen(local_maps.tr().inverse() * tracked_pose);
+    Transform Tr = LM2(frame, local_maps.get_local_map(), degenerate_threshold, initial, &loss,
+                       quality.lm_iterations);
+    // the same bound the two-sensor GTSAM fusion rejects a registration at
+    if(loss > 1.0f) {
+        dropped.add();
+        return std::nullopt;
+    }
+
+    tracked_pose = local_maps.tr() * to_eigen(Tr);
+    tracked_time = time;
+    return tracked_pose;
+}
+
+// a velodyne frame is stamped at the start of its sweep, so micro-sweeps of the same revolution
+// were tracked past it: those keep their pose, moved by what loop closure did to the frame's
+void visual_odom_v2::__update_tracked_pose(const Eigen::Matrix4d& registered,
+                                           const Eigen::Matrix4d& M, ros::Time time) {
+    if(time.toSec() < tracked_time.toSec()) {
+        tracked_pose = M * registered.inverse() * tracked_pose;
+        return;
+    }
+    tracked_pose = M;
+    tracked_time = time;
+}
+
+std::optional<Eigen::Matrix4d>
+visual_odom_v2::mapping(const pcl::PointCloud<PointType>::Ptr& velodyne_cloud,
+                        const feature_frame& frame, ros::Time time) {
+
+    last_loss = 0.0f;
+    auto Mr = update_current_frame(frame);
+    if(!Mr.ok()) {
+        static auto& dropped = metrics_counter("frames_dropped");
+        dropped.add();
+        HLOAM_INFO("Frame dropped : %s", Mr.error().c_str());
+        __record(time, frame, nullptr);
+        return std::nullopt;
+    }
+
+    auto Tr = Mr.value();
+    Eigen::Matrix4d M = local_maps.tr() * to_eigen(Tr);
+    Eigen::Matrix4d X = prev_transform.inverse() * M;
+    prev_transform = M;
+
+    Eigen::Matrix4d registered = M;
+    bool has_loop = false;
+    if(config.enable_loop) {
+        M = loop_detection(velodyne_cloud, frame.velodyne_feature, M, &has_loop);
+    }
+
+    // if transformation and rotation is too small, drop this frame
+    if(!has_loop && !local_maps.empty() && std::abs(Tr.x) < config.key_frame_distance_x &&
+       std::abs(Tr.y) < config.key_frame_distance_y &&
+       std::abs(Tr.z) < config.key_frame_distance_z &&
+       std::abs(Tr.roll) < config.key_frame_distance_roll &&
+       std::abs(Tr.pitch) < config.key_frame_distance_pitch &&
+       std::abs(Tr.yaw) < config.key_frame_distance_yaw) {
+        if(config.enable_loop)
+            loop.pop_back();
+        __update_tracked_pose(registered, M, time);
+        __record(time, frame, &M);
+        return M;
+    }
+
+    Transform M_tr = from_eigen(M);
+    HLOAM_INFO("Mapping: %lf %lf %lf %lf %lf %lf", M_tr.x, M_tr.y, M_tr.z, M_tr.roll,
+               M_tr.pitch, M_tr.yaw);
+    next_initial_guess = from_eigen(X);
+
+    if(config.enable_loop)
+        loop.keep_back(*velodyne_cloud);
+
+    {
+        TRACE_SCOPE("local_map.push");
+        local_maps.push(frame, M);
+    }
+
+    geometry_msgs::PoseStamped pose;
+    pose.header.frame_id = "map";
+    pose.header.stamp = time;
+    pose.pose = to_ros_pose(M);
+
+    final_path.poses.push_back(pose);
+    final_path.header.stamp = time;
+
+    static auto& keyframes = metrics_gauge("keyframes");
+    keyframes.set(final_path.poses.size());
+
+    loop_markers.header.stamp = time;
+
+    report_memory();
+    __update_tracked_pose(registered, M, time);
+    __record(time, frame, &M);
+    return M;
+}
+
+void visual_odom_v2::__record(ros::Time time, const feature_frame& frame,
+                              const Eigen::Matrix4d* pose) {
+    if(recorder == nullptr || !recorder->enabled())
+        return;
+
+    flight_record record;
+    record.time = time;
+    record.features = frame;
+    record.local_map = std::move(last_local_map);
+    record.pose = pose != nullptr ? *pose : Eigen::Matrix4d::Identity();
+    record.loss = last_loss;
+    record.dropped = pose == nullptr;
+    recorder->record(std::move(record));
+    last_local_map = {};
+}
+
+void visual_odom_v2::report_memory() {
+    static auto& loop_frames = metrics_gauge("memory.loop_frames_bytes");
+    static auto& scan_context = metrics_gauge("memory.scan_context_bytes");
+    static auto& window = metrics_gauge("memory.local_map_window_bytes");
+    static auto& merged = metrics_gauge("memory.local_map_merged_bytes");
+    static auto& path = metrics_gauge("memory.final_path_bytes");
+    static auto& markers = metrics_gauge("memory.loop_markers_bytes");
+
+    loop_frames.set(loop.frames_footprint());
+    scan_context.set(loop.sc_manager.memory_footprint());
+    window.set(local_maps.window_footprint());
+    merged.set(local_maps.merged_footprint());
+    path.set(final_path.poses.capacity() * sizeof(geometry_msgs::PoseStamped));
+    markers.set(loop_markers.points.capacity() * sizeof(geometry_msgs::Point) +
+                loop_markers.colors.capacity() * sizeof(std_msgs::ColorRGBA));
+}
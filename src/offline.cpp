@@ -0,0 +1,548 @@
+#include "offline.h"
+
+#include "alloc_tracker.h"
+#include "feature_cache.h"
+#include "scan_archive.h"
+#include "trace.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+
+struct scan_file {
+    std::filesystem::path path;
+    double stamp; // from the file name, NAN if it carries none
+};
+
+static double stamp_of(const std::filesystem::path& path) {
+    std::string stem = path.stem().string();
+    char* end = nullptr;
+    double value = strtod(stem.c_str(), &end);
+    if(end == stem.c_str() || *end != '\0')
+        return NAN;
+
+    // sequence numbers (000123) are not stamps; nanoseconds are
+    if(value > 1e14)
+        return value * 1e-9;
+    if(value > 1e5)
+        return value;
+    return NAN;
+}
+
+static double index_of(const std::filesystem::path& path) {
+    return strtod(path.stem().string().c_str(), nullptr);
+}
+
+static std::vector<scan_file> list_scans(const std::string& dir) {
+    std::vector<scan_file> files;
+    for(auto& p: std::filesystem::directory_iterator(dir)) {
+        auto ext = p.path().extension();
+        if(p.is_regular_file() && (ext == ".pcd" || ext == ".bin")) {
+            files.push_back({ p.path(), stamp_of(p.path()) });
+        }
+    }
+
+    std::sort(files.begin(), files.end(), [](const scan_file& a, const scan_file& b) {
+        double ia = index_of(a.path), ib = index_of(b.path);
+        if(ia != ib)
+            return ia < ib;
+        return a.path < b.path;
+    });
+    return files;
+}
+
+// KITTI scans carry neither ring nor per-point time, so derive both from the beam geometry
+static bool load_kitti(const std::string& filename, const offline_options& options,
+                       pcl::PointCloud<PointType>& cloud) {
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if(fp == nullptr)
+        return false;
+
+    cloud.clear();
+    float data[4];
+    const float fov = options.kitti_fov_up - options.kitti_fov_down;
+    while(fread(data, sizeof(float), 4, fp) == 4) {
+        PointType p;
+        p.x = data[0];
+        p.y = data[1];
+        p.z = data[2];
+        p.intensity = data[3];
+
+        float elevation = atan2f(p.z, sqrtf(p2(p.x) + p2(p.y))) * 180.0f / M_PI;
+        int ring = lroundf((options.kitti_fov_up - elevation) / fov * (options.kitti_rings - 1));
+        p.ring = std::clamp(ring, 0, options.kitti_rings - 1);
+
+        // HDL-64E spins counterclockwise, one revolution per 0.1s starting from behind
+        float azimuth = atan2f(p.y, p.x);
+        p.time = 0.1 * (azimuth + M_PI) / (2.0 * M_PI);
+        cloud.push_back(p);
+    }
+    fclose(fp);
+    return true;
+}
+
+static pcl::PointCloud<PointType>::Ptr load_scan(const std::filesystem::path& path,
+                                                 const offline_options& options) {
+    auto cloud = acquire_cloud();
+    bool loaded = path.extension() == ".bin"
+        ? load_kitti(path.string(), options, *cloud)
+        : pcl::io::loadPCDFile(path.string(), *cloud) == 0;
+    return loaded ? cloud : nullptr;
+}
+
+static std::vector<double> load_times(const std::filesystem::path& filename) {
+    std::vector<double> times;
+    FILE* fp = fopen(filename.c_str(), "r");
+    if(fp == nullptr)
+        return times;
+
+    double t;
+    while(fscanf(fp, "%lf", &t) == 1) {
+        times.push_back(t);
+    }
+    fclose(fp);
+    return times;
+}
+
+// a directory of PCD/KITTI files, or an archive packed by hloam_pack
+struct scan_source {
+    std::vector<scan_file> files;
+    std::vector<double> times; // KITTI times.txt next to the scan directory
+    scan_archive archive;
+    bool packed = false;
+
+    result_of<size_t, std::string> open(const std::string& path) {
+        if(std::filesystem::is_regular_file(path)) {
+            packed = true;
+            return archive.open(path);
+        }
+
+        if(!std::filesystem::is_directory(path))
+            return fail(path + " is neither a scan directory nor a scan archive");
+
+        files = list_scans(path);
+        times = load_times(std::filesystem::path(path).parent_path() / "times.txt");
+        return ok(files.size());
+    }
+
+    size_t size() const {
+        return packed ? archive.size() : files.size();
+    }
+
+    double stamp(size_t i, const offline_options& options) const {
+        if(packed)
+            return archive.stamp(i);
+
+        double stamp = files[i].stamp;
+        if(std::isnan(stamp))
+            stamp = i < times.size() ? times[i] : i * options.frame_period;
+        return stamp;
+    }
+
+    std::string name(size_t i) const {
+        return packed ? "frame " + std::to_string(i) : files[i].path.string();
+    }
+
+    pcl::PointCloud<PointType>::Ptr load(size_t i, const offline_options& options) const {
+        if(!packed)
+            return load_scan(files[i].path, options);
+
+        auto cloud = acquire_cloud();
+        archive.load(i, *cloud);
+        return cloud;
+    }
+};
+
+struct stamped_pose {
+    double time;
+    Eigen::Matrix4d pose;
+};
+
+static std::vector<stamped_pose> load_tum(const std::string& filename) {
+    std::vector<stamped_pose> poses;
+    FILE* fp = fopen(filename.c_str(), "r");
+    if(fp == nullptr)
+        return poses;
+
+    char line[512];
+    while(fgets(line, sizeof(line), fp) != nullptr) {
+        double t, x, y, z, qx, qy, qz, qw;
+        if(line[0] == '#' ||
+           sscanf(line, "%lf %lf %lf %lf %lf %lf %lf %lf", &t, &x, &y, &z, &qx, &qy, &qz, &qw) != 8)
+            continue;
+
+        Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+        pose.block<3, 3>(0, 0) = Eigen::Quaterniond(qw, qx, qy, qz).normalized().toRotationMatrix();
+        pose(0, 3) = x;
+        pose(1, 3) = y;
+        pose(2, 3) = z;
+        poses.push_back({ t, pose });
+    }
+    fclose(fp);
+
+    std::sort(poses.begin(), poses.end(),
+              [](const stamped_pose& a, const stamped_pose& b) { return a.time < b.time; });
+    return poses;
+}
+
+static latency_summary summarize(const char* stage, std::vector<double> samples) {
+    latency_summary s;
+    s.stage = stage;
+    s.count = samples.size();
+    if(samples.empty())
+        return s;
+
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double q) {
+        return samples[std::min(samples.size() - 1, size_t(q * samples.size()))];
+    };
+
+    double sum = 0.0;
+    for(double v: samples) {
+        sum += v;
+    }
+    s.mean = sum / samples.size();
+    s.p50 = at(0.5);
+    s.p90 = at(0.9);
+    s.p99 = at(0.99);
+    s.max = samples.back();
+    return s;
+}
+
+// ATE after a rigid (Umeyama) alignment of the positions; RPE between consecutive matched
+// keyframes, which does not depend on that alignment
+static void trajectory_error(const std::vector<stamped_pose>& estimate,
+                             const std::vector<stamped_pose>& truth, double max_dt,
+                             offline_report& report) {
+    std::vector<std::pair<Eigen::Matrix4d, Eigen::Matrix4d>> pairs;
+    for(auto&& e: estimate) {
+        auto it = std::lower_bound(
+            truth.begin(), truth.end(), e.time,
+            [](const stamped_pose& p, double t) { return p.time < t; });
+
+        const stamped_pose* best = nullptr;
+        if(it != truth.end())
+            best = &*it;
+        if(it != truth.begin() &&
+           (best == nullptr || e.time - (it - 1)->time < best->time - e.time))
+            best = &*(it - 1);
+
+        if(best != nullptr && std::abs(best->time - e.time) <= max_dt)
+            pairs.push_back({ e.pose, best->pose });
+    }
+
+    report.matched = pairs.size();
+    if(pairs.size() < 3)
+        return;
+
+    Eigen::Matrix3Xd src(3, pairs.size()), dst(3, pairs.size());
+    for(size_t i = 0; i < pairs.size(); i++) {
+        src.col(i) = pairs[i].first.block<3, 1>(0, 3);
+        dst.col(i) = pairs[i].second.block<3, 1>(0, 3);
+    }
+
+    Eigen::Matrix4d align = Eigen::umeyama(src, dst, false);
+    double ate = 0.0;
+    for(size_t i = 0; i < pairs.size(); i++) {
+        Eigen::Vector3d p = align.block<3, 3>(0, 0) * src.col(i) + align.block<3, 1>(0, 3);
+        ate += (p - dst.col(i)).squaredNorm();
+    }
+    report.ate = sqrt(ate / pairs.size());
+
+    double rpe_t = 0.0, rpe_r = 0.0;
+    for(size_t i = 1; i < pairs.size(); i++) {
+        Eigen::Matrix4d de = pairs[i - 1].first.inverse() * pairs[i].first;
+        Eigen::Matrix4d dg = pairs[i - 1].second.inverse() * pairs[i].second;
+        Eigen::Matrix4d error = dg.inverse() * de;
+
+        double c = std::clamp((error.block<3, 3>(0, 0).trace() - 1.0) / 2.0, -1.0, 1.0);
+        double angle = acos(c) * 180.0 / M_PI;
+        rpe_t += error.block<3, 1>(0, 3).squaredNorm();
+        rpe_r += angle * angle;
+    }
+    report.rpe_translation = sqrt(rpe_t / (pairs.size() - 1));
+    report.rpe_rotation = sqrt(rpe_r / (pairs.size() - 1));
+}
+
+using offline_clock = std::chrono::steady_clock;
+
+static double ms_since(offline_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(offline_clock::now() - begin).count();
+}
+
+// per-frame heap allocations by stage, between begin_frame and end_frame
+struct alloc_accumulator {
+    alloc_snapshot begin;
+    alloc_counts total[ALLOC_STAGE_COUNT];
+    uint64_t max_allocations[ALLOC_STAGE_COUNT] = {};
+    size_t frames = 0;
+
+    void begin_frame() {
+        begin = alloc_totals();
+    }
+
+    void end_frame() {
+        auto delta = alloc_totals() - begin;
+        for(int i = 0; i < ALLOC_STAGE_COUNT; i++) {
+            total[i].allocations += delta.stages[i].allocations;
+            total[i].bytes += delta.stages[i].bytes;
+            max_allocations[i] = std::max(max_allocations[i], delta.stages[i].allocations);
+        }
+        frames++;
+    }
+
+    void summarize(std::vector<alloc_summary>& out) const {
+        if(!alloc_tracking_available || frames == 0)
+            return;
+
+        for(int i = 0; i < ALLOC_STAGE_COUNT; i++) {
+            out.push_back({ alloc_stage_name(i), double(total[i].allocations) / frames,
+                            double(total[i].bytes) / frames, max_allocations[i] });
+        }
+    }
+};
+
+struct offline_samples {
+    std::vector<double> load_ms, feature_ms, mapping_ms, total_ms;
+    double busy_ms = 0.0;
+    alloc_accumulator allocations;
+};
+
+static result_of<bool, std::string> extract_and_map(const offline_options& options,
+                                                    visual_odom_v2& odom, offline_report& report,
+                                                    offline_samples& samples) {
+    if(options.velodyne_dir.empty())
+        return fail("no velodyne directory given");
+
+    scan_source velodyne, livox;
+    auto opened = velodyne.open(options.velodyne_dir);
+    if(!opened.ok())
+        return fail(opened.error());
+
+    if(!options.livox_dir.empty()) {
+        auto opened_livox = livox.open(options.livox_dir);
+        if(!opened_livox.ok())
+            return fail(opened_livox.error());
+    }
+
+    feature_config features = options.features;
+    features.use_livox = features.use_livox && !options.livox_dir.empty();
+    if(!features.use_livox && !features.use_velodyne)
+        return fail("neither velodyne nor livox features enabled");
+
+    size_t total = velodyne.size();
+    if(features.use_livox)
+        total = std::min(total, livox.size());
+    if(total == 0)
+        return fail("no scans found");
+
+    size_t first = std::min(options.first, total);
+    size_t last = first + std::min(options.count, total - first);
+
+    feature_cache_writer cache;
+    if(!options.feature_cache_output.empty() &&
+       !cache.open(options.feature_cache_output, options.cache_scans))
+        return fail("cannot write " + options.feature_cache_output);
+
+    for(size_t i = first; i < last; i++) {
+        auto begin = offline_clock::now();
+
+        synced_message msg;
+        msg.velodyne = velodyne.load(i, options);
+        if(msg.velodyne == nullptr)
+            return fail("cannot read velodyne " + velodyne.name(i));
+
+        if(features.use_livox) {
+            msg.livox = livox.load(i, options);
+            if(msg.livox == nullptr)
+                return fail("cannot read livox " + livox.name(i));
+        }
+
+        msg.time = ros::Time(velodyne.stamp(i, options));
+        samples.load_ms.push_back(ms_since(begin));
+
+        TRACE_FRAME(msg.time.toNSec());
+        auto work = offline_clock::now();
+        report.frames++;
+        samples.allocations.begin_frame();
+
+        auto fr = extract_features(msg, features);
+        samples.feature_ms.push_back(ms_since(work));
+        if(!fr.ok()) {
+            samples.allocations.end_frame();
+            report.dropped++;
+            samples.busy_ms += samples.feature_ms.back();
+            if(!options.feature_cache_output.empty() && !cache.append_dropped(msg.time))
+                return fail("cannot write " + options.feature_cache_output);
+            continue;
+        }
+
+        auto mapping_begin = offline_clock::now();
+        auto M = odom.mapping(msg.velodyne, fr.value(), msg.time);
+        samples.mapping_ms.push_back(ms_since(mapping_begin));
+        samples.total_ms.push_back(ms_since(work));
+        samples.busy_ms += samples.total_ms.back();
+        samples.allocations.end_frame();
+
+        if(!options.feature_cache_output.empty() &&
+           !cache.append(msg.time, fr.value(), msg.velodyne))
+            return fail("cannot write " + options.feature_cache_output);
+
+        if(!M.has_value())
+            report.dropped++;
+    }
+
+    if(!options.feature_cache_output.empty() && !cache.close())
+        return fail("cannot write " + options.feature_cache_output);
+    return ok(true);
+}
+
+// mapping over frames replayed from a feature cache; loading stands in for feature extraction
+static result_of<bool, std::string> replay_features(const offline_options& options,
+                                                    visual_odom_v2& odom, offline_report& report,
+                                                    offline_samples& samples) {
+    feature_cache_reader cache;
+    auto opened = cache.open(options.feature_cache);
+    if(!opened.ok())
+        return fail(opened.error());
+
+    if(odom.config.enable_loop && !cache.has_scans()) {
+        HLOAM_WARN("%s holds no scans, loop closure disabled", options.feature_cache.c_str());
+        odom.config.enable_loop = false;
+    }
+
+    size_t total = opened.value();
+    size_t first = std::min(options.first, total);
+    size_t last = first + std::min(options.count, total - first);
+
+    cached_frame frame;
+    for(size_t i = 0; i < last; i++) {
+        auto begin = offline_clock::now();
+        if(!cache.next(frame))
+            return fail(options.feature_cache + " is truncated");
+        if(i < first)
+            continue;
+        samples.load_ms.push_back(ms_since(begin));
+
+        TRACE_FRAME(frame.time.toNSec());
+        report.frames++;
+        if(frame.dropped) {
+            report.dropped++;
+            continue;
+        }
+
+        auto work = offline_clock::now();
+        samples.allocations.begin_frame();
+        auto M = odom.mapping(frame.scan, frame.features, frame.time);
+        samples.allocations.end_frame();
+        samples.mapping_ms.push_back(ms_since(work));
+        samples.total_ms.push_back(samples.mapping_ms.back());
+        samples.busy_ms += samples.total_ms.back();
+
+        if(!M.has_value())
+            report.dropped++;
+    }
+    return ok(true);
+}
+
+result_of<offline_report, std::string> run_offline(const offline_options& options) {
+    visual_odom_v2 odom(options.odom);
+    odom.degenerate_threshold = options.degenerate_threshold;
+
+    offline_report report;
+    offline_samples samples;
+
+    if(!options.feature_cache.empty()) {
+        auto replayed = replay_features(options, odom, report, samples);
+        if(!replayed.ok())
+            return fail(replayed.error());
+    } else {
+        auto extracted = extract_and_map(options, odom, report, samples);
+        if(!extracted.ok())
+            return fail(extracted.error());
+    }
+
+    report.keyframes = odom.final_path.poses.size();
+    report.loops = odom.loop.loop.size();
+    report.wall_seconds = samples.busy_ms / 1000.0;
+    report.fps = samples.busy_ms > 0.0 ? report.frames / report.wall_seconds : 0.0;
+
+    report.stages.push_back(summarize("load", samples.load_ms));
+    report.stages.push_back(summarize("feature", samples.feature_ms));
+    report.stages.push_back(summarize("mapping", samples.mapping_ms));
+    report.stages.push_back(summarize("total", samples.total_ms));
+    samples.allocations.summarize(report.allocations);
+
+    if(!options.trajectory_output.empty() && !save_tum(odom.final_path, options.trajectory_output))
+        return fail("cannot write " + options.trajectory_output);
+
+    if(!options.ground_truth.empty()) {
+        auto truth = load_tum(options.ground_truth);
+        if(truth.empty())
+            return fail("cannot read ground truth " + options.ground_truth);
+
+        std::vector<stamped_pose> estimate;
+        for(auto&& pose: odom.final_path.poses) {
+            estimate.push_back({ pose.header.stamp.toSec(), from_ros_pose(pose.pose) });
+        }
+        trajectory_error(estimate, truth, options.frame_period / 2, report);
+    }
+
+    return ok(report);
+}
+
+result_of<size_t, std::string> pack_scans(const std::string& dir, const offline_options& options,
+                                          const std::string& output) {
+    scan_source source;
+    auto opened = source.open(dir);
+    if(!opened.ok())
+        return fail(opened.error());
+    if(source.size() == 0)
+        return fail("no scans found in " + dir);
+
+    scan_archive_writer writer;
+    if(!writer.open(output))
+        return fail("cannot write " + output);
+
+    for(size_t i = 0; i < source.size(); i++) {
+        auto cloud = source.load(i, options);
+        if(cloud == nullptr)
+            return fail("cannot read " + source.name(i));
+
+        if(!writer.append(source.stamp(i, options), *cloud))
+            return fail("cannot write " + output);
+    }
+
+    size_t frames = writer.size();
+    if(!writer.close())
+        return fail("cannot write " + output);
+    return ok(frames);
+}
+
+void print_offline_report(FILE* fp, const offline_report& report) {
+    fprintf(fp, "frames: %zd, dropped: %zd, keyframes: %zd, loops: %zd\r\n", report.frames,
+            report.dropped, report.keyframes, report.loops);
+    fprintf(fp, "throughput: %.2f frames/s (%.2f s busy)\r\n", report.fps, report.wall_seconds);
+
+    fprintf(fp, "%-8s %8s %9s %9s %9s %9s %9s\r\n", "stage", "count", "mean ms", "p50", "p90",
+            "p99", "max");
+    for(auto&& s: report.stages) {
+        fprintf(fp, "%-8s %8zd %9.2f %9.2f %9.2f %9.2f %9.2f\r\n", s.stage.c_str(), s.count,
+                s.mean, s.p50, s.p90, s.p99, s.max);
+    }
+
+    if(!report.allocations.empty()) {
+        fprintf(fp, "%-13s %12s %12s %12s\r\n", "allocations", "per frame", "max", "KiB/frame");
+        for(auto&& a: report.allocations) {
+            fprintf(fp, "%-13s %12.1f %12llu %12.1f\r\n", a.stage.c_str(), a.allocations,
+                    (unsigned long long)a.max_allocations, a.bytes / 1024.0);
+        }
+    }
+
+    if(report.matched > 0) {
+        fprintf(fp, "matched: %zd, ATE: %.3f m, RPE: %.3f m / %.3f deg\r\n", report.matched,
+                report.ate, report.rpe_translation, report.rpe_rotation);
+    }
+}
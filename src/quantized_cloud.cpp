@@ -0,0 +1,105 @@
+#include "quantized_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+
+static_assert(sizeof(quantized_point) == 8, "quantized_point must stay 8 bytes");
+static_assert(sizeof(PointType) == sizeof(kernel_point), "kernels read XYZIRT points");
+
+quantized_cloud::quantized_cloud(const Eigen::Vector3f& origin, float resolution):
+    resolution(resolution) {
+    for(int i = 0; i < 3; i++)
+        this->origin[i] = origin[i];
+}
+
+quantized_cloud quantized_cloud::fit(const pcl::PointCloud<PointType>& cloud, float resolution) {
+    if(cloud.empty())
+        return quantized_cloud(Eigen::Vector3f::Zero(), resolution);
+
+    const auto& first = cloud.points[0];
+    Eigen::Vector3f min(first.x, first.y, first.z), max = min;
+    for(auto&& p: cloud) {
+        min = min.cwiseMin(Eigen::Vector3f(p.x, p.y, p.z));
+        max = max.cwiseMax(Eigen::Vector3f(p.x, p.y, p.z));
+    }
+
+    // half the extent has to be within 32767 steps
+    float extent = (max - min).maxCoeff();
+    resolution = std::max(resolution, extent / 65534.0f);
+
+    quantized_cloud result((min + max) * 0.5f, resolution);
+    result.append(cloud.points.data(), cloud.size());
+    return result;
+}
+
+void quantized_cloud::append(const PointType* begin, size_t count) {
+    size_t offset = points.size();
+    points.resize(offset + count);
+    kernels().quantize_points(reinterpret_cast<const kernel_point*>(begin), count, origin,
+                              1.0f / resolution, points.data() + offset);
+}
+
+void quantized_cloud::decode(const Eigen::Matrix4d& transform,
+                             pcl::PointCloud<PointType>& out) const {
+    double m[12];
+    for(int r = 0; r < 3; r++) {
+        for(int c = 0; c < 4; c++) {
+            m[r * 4 + c] = transform(r, c);
+        }
+    }
+
+    size_t offset = out.size();
+    out.points.resize(offset + points.size());
+    out.width = out.points.size();
+    out.height = 1;
+    kernels().dequantize_points(points.data(), points.size(), origin, resolution, m,
+                                reinterpret_cast<kernel_point*>(out.points.data() + offset));
+}
+
+void quantized_map::insert(const pcl::PointCloud<PointType>& cloud) {
+    // runs of consecutive points in the same tile are appended together
+    auto tile_of = [this](const PointType& p) {
+        return std::array<int, 3>{ int(std::floor(p.x / tile_size)),
+                                   int(std::floor(p.y / tile_size)),
+                                   int(std::floor(p.z / tile_size)) };
+    };
+
+    size_t begin = 0;
+    while(begin < cloud.size()) {
+        auto key = tile_of(cloud.points[begin]);
+        size_t end = begin + 1;
+        while(end < cloud.size() && tile_of(cloud.points[end]) == key)
+            end++;
+
+        auto tile = tiles.find(key);
+        if(tile == tiles.end()) {
+            Eigen::Vector3f centre(key[0] + 0.5f, key[1] + 0.5f, key[2] + 0.5f);
+            tile = tiles.emplace(key, quantized_cloud(centre * tile_size, resolution)).first;
+        }
+        tile->second.append(&cloud.points[begin], end - begin);
+        begin = end;
+    }
+}
+
+void quantized_map::decode(pcl::PointCloud<PointType>& out) const {
+    out.reserve(out.size() + size());
+    for(auto&& [key, tile]: tiles) {
+        tile.decode(Eigen::Matrix4d::Identity(), out);
+    }
+}
+
+size_t quantized_map::size() const {
+    size_t count = 0;
+    for(auto&& [key, tile]: tiles) {
+        count += tile.size();
+    }
+    return count;
+}
+
+size_t quantized_map::bytes() const {
+    size_t bytes = 0;
+    for(auto&& [key, tile]: tiles) {
+        bytes += tile.bytes();
+    }
+    return bytes;
+}
@@ -4,6 +4,9 @@
 #define __J_H__
 
 #include "comm.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "trace.h"
 
 #include <Eigen/Dense>
 
@@ -329,24 +332,26 @@ inline jacobian J(const coeff& c, const jacobian_g& g) {
     return j;
 }
 
-constexpr double NO_VALUE = -125689.123;
+// a livox scan can bring edges while the local map has none yet, no tree to search then
+static size_t corner_rows(const feature_objects& source, const feature_adapter& target) {
+    return target.corner.index != nullptr ? size_of(source.line_features) : 0;
+}
 
+// fills rows from first on of A and b, which have room for every source point; the value is the
+// number of rows filled
 static size_t Ab(const feature_objects& source, const feature_adapter& target, const Transform& t,
-                 Eigen::MatrixXd& A, Eigen::VectorXd& b, float* _loss) {
+                 Eigen::MatrixXd& A, Eigen::VectorXd& b, size_t first, float* _loss) {
     jacobian_g g;
     init_jacobian_g(g, t);
     Eigen::Matrix4d transform = to_eigen(t);
 
-    size_t corner_size = size_of(source.line_features);
+    size_t corner_size = corner_rows(source, target);
     size_t surf_size = size_of(source.plane_features);
     size_t non_size = size_of(source.non_features);
 
     size_t total_size = corner_size + surf_size + non_size;
 
-    A.resize(total_size, 6);
-    b.resize(total_size);
-
-    std::atomic<int> index = 0;
+    std::atomic<size_t> index = first;
     float loss = 0.0f;
 #pragma omp parallel for reduction(+ : loss)
     for(size_t i = 0; i < total_size; ++i) {
@@ -383,7 +388,7 @@ static size_t Ab(const feature_objects& source, const feature_adapter& target, c
         }
 
         jacobian j = J(c, g);
-        int idx = index.fetch_add(1);
+        size_t idx = index.fetch_add(1);
         A(idx, 0) = j.j[0];
         A(idx, 1) = j.j[1];
         A(idx, 2) = j.j[2];
@@ -398,43 +403,37 @@ static size_t Ab(const feature_objects& source, const feature_adapter& target, c
     if(_loss != nullptr) {
         *_loss += loss;
     }
-    A.conservativeResize(index, 6);
-    b.conservativeResize(index);
-    return index.load();
+    return index.load() - first;
 }
 
-newton Ab(std::initializer_list<feature_pair> pairs, const Transform& t, float* _loss) {
-
-    std::vector<newton> newtons(pairs.size());
+void Ab(std::initializer_list<feature_pair> pairs, newton& N, const Transform& t, float* _loss) {
+    PERF_SCOPE(PERF_KERNEL_AB);
 
-    size_t total_size = 0;
-    size_t index = 0;
+    // grown, never shrunk: a warmed-up iteration does not allocate
+    size_t rows = 0;
+    for(auto&& pair: pairs) {
+        rows += corner_rows(pair.first, pair.second) + size_of(pair.first.plane_features) +
+            size_of(pair.first.non_features);
+    }
+    if((size_t)N.A.rows() < rows) {
+        N.A.resize(rows, 6);
+        N.b.resize(rows);
+    }
 
     if(_loss != nullptr)
         *_loss = 0.0f;
 
+    size_t index = 0;
     for(auto&& pair: pairs) {
-        total_size += Ab(pair.first, pair.second, t, newtons[index].A, newtons[index].b, _loss);
-        index++;
-    }
-
-    newton N;
-    N.A.resize(total_size, 6);
-    N.b.resize(total_size);
-    index = 0;
-
-    for(auto&& n: newtons) {
-        for(size_t i = 0; i < n.b.rows(); ++i) {
-            if(n.b(i) != NO_VALUE) {
-                N.A.row(index) = n.A.row(i);
-                N.b(index) = n.b(i);
-                index++;
-            }
-        }
+        index += Ab(pair.first, pair.second, t, N.A, N.b, index, _loss);
     }
 
     N.top = index;
 
+    static auto& correspondences = metrics_histogram(
+        "ab.correspondences", { 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000 });
+    correspondences.observe(index);
+
     if(_loss != nullptr) {
         if(index == 0) {
             *_loss = 10000.0f;
@@ -442,7 +441,11 @@ newton Ab(std::initializer_list<feature_pair> pairs, const Transform& t, float*
             *_loss /= index;
         }
     }
+}
 
+newton Ab(std::initializer_list<feature_pair> pairs, const Transform& t, float* _loss) {
+    newton N;
+    Ab(pairs, N, t, _loss);
     return N;
 }
 
@@ -450,6 +453,7 @@ inline Transform __LM_iteration(const feature_objects& source, array_adaptor<Poi
                                 array_adaptor<PointType>& surf, array_adaptor<PointType>& non,
                                 Eigen::MatrixXd& A, Eigen::VectorXd& b,
                                 const Transform& initial_guess, float* loss = nullptr) {
+    TRACE_SCOPE("registration.lm_iteration");
 
     Eigen::Matrix4d transform = to_eigen(initial_guess);
     jacobian_g g;
@@ -457,7 +461,7 @@ inline Transform __LM_iteration(const feature_objects& source, array_adaptor<Poi
 
     std::atomic<int> index = 0;
 
-    size_t corner_size = size_of(source.line_features);
+    size_t corner_size = corner.index != nullptr ? size_of(source.line_features) : 0;
     size_t surf_size = size_of(source.plane_features);
     size_t non_size = size_of(source.non_features);
 
@@ -510,13 +514,14 @@ inline Transform __LM_iteration(const feature_objects& source, array_adaptor<Poi
     }
 
     if(index < 100) {
-        ROS_INFO("index(%d) < 100, loss set to 10000", index.load());
+        HLOAM_INFO("index(%d) < 100, loss set to 10000", index.load());
         loss[0] = 10000.00;
         return initial_guess;
     }
 
-    Eigen::Matrix<double, 6, 6> ATA = A.topRows(index).transpose() * A.topRows(index);
-    Eigen::Matrix<double, 6, 1> ATb = A.topRows(index).transpose() * b.topRows(index);
+    Eigen::Matrix<double, 6, 6> ATA;
+    Eigen::Matrix<double, 6, 1> ATb;
+    normal_equations(A, b, index, ATA, ATb);
     Eigen::Matrix<double, 6, 1> x = ATA.householderQr().solve(ATb);
 
     Transform delta;
@@ -550,7 +555,6 @@ Transform LM(const feature_objects& source, const feature_objects& target,
     Eigen::VectorXd b(total_size);
 
     Transform result = initial_guess;
-    auto start = std::chrono::high_resolution_clock::now();
     for(int iter = 0; iter < 30; ++iter) {
         Transform u = __LM_iteration(source, corner, surf, non, A, b, result, loss);
         float deltaR =
@@ -564,9 +568,6 @@ Transform LM(const feature_objects& source, const feature_objects& target,
         }
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> diff = end - start;
-
     return result;
 }
 
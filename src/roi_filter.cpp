@@ -0,0 +1,51 @@
+#include "roi_filter.h"
+
+#include "kernels.h"
+
+#include <cmath>
+
+static kernel_roi make_kernel_roi(const roi_config& config) {
+    kernel_roi roi = {};
+    roi.min_range2 = config.min_range * config.min_range;
+    roi.max_range2 = config.max_range > 0.0f ? config.max_range * config.max_range : INFINITY;
+    for(int i = 0; i < 3; i++) {
+        roi.box_min[i] = config.box.min[i];
+        roi.box_max[i] = config.box.max[i];
+    }
+
+    float span = config.azimuth_max - config.azimuth_min;
+    span -= 360.0f * std::floor(span / 360.0f);
+    if(config.azimuth_max - config.azimuth_min >= 360.0f || span == 0.0f) {
+        roi.sector_mode = 0;
+    } else {
+        float start = config.azimuth_min * float(M_PI) / 180.0f;
+        float end = config.azimuth_max * float(M_PI) / 180.0f;
+        roi.sector_start[0] = std::cos(start);
+        roi.sector_start[1] = std::sin(start);
+        roi.sector_end[0] = std::cos(end);
+        roi.sector_end[1] = std::sin(end);
+        roi.sector_mode = span <= 180.0f ? 1 : 2;
+    }
+
+    static_assert(sizeof(roi_box) == sizeof(float[6]), "roi_box is read as min xyz, max xyz");
+    roi.exclude = reinterpret_cast<const float(*)[6]>(config.exclude.data());
+    roi.exclude_count = config.exclude.size();
+    roi.stride = config.stride > 1 ? config.stride : 1;
+    return roi;
+}
+
+size_t roi_filter(const roi_config& config, pcl::PointCloud<PointType>& cloud) {
+    if(!config.enable || cloud.empty())
+        return 0;
+
+    kernel_roi roi = make_kernel_roi(config);
+    static_assert(sizeof(PointType) == sizeof(kernel_point), "kernels read XYZIRT points");
+    size_t before = cloud.size();
+    size_t kept = kernels().crop_points(reinterpret_cast<kernel_point*>(cloud.points.data()),
+                                        before, &roi);
+
+    cloud.points.resize(kept);
+    cloud.width = kept;
+    cloud.height = 1;
+    return before - kept;
+}
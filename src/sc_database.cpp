@@ -0,0 +1,271 @@
+#include "sc_database.h"
+
+#include "kernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char sc_database_magic[8] = "HLSCDB1";
+static constexpr std::uint32_t sc_database_version = 1;
+static constexpr std::uint64_t sc_database_alignment = 64;
+
+static std::uint64_t align_up(std::uint64_t offset) {
+    return (offset + sc_database_alignment - 1) / sc_database_alignment * sc_database_alignment;
+}
+
+// nanoflann dataset over the mapped ring keys
+struct sc_key_source {
+    const float* keys;
+    size_t count;
+    size_t dims;
+
+    size_t kdtree_get_point_count() const {
+        return count;
+    }
+
+    float kdtree_get_pt(size_t i, size_t dim) const {
+        return keys[i * dims + dim];
+    }
+
+    template<class BBOX>
+    bool kdtree_get_bbox(BBOX&) const {
+        return false;
+    }
+};
+
+struct sc_key_tree {
+    using index_type =
+        nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, sc_key_source>,
+                                            sc_key_source, -1, size_t>;
+
+    sc_key_source source;
+    index_type index;
+
+    sc_key_tree(const sc_key_source& source):
+        source(source),
+        index(source.dims, this->source, nanoflann::KDTreeSingleIndexAdaptorParams(10)) {
+        index.buildIndex();
+    }
+};
+
+static bool write_section(FILE* fp, std::uint64_t& offset, std::uint64_t at, const void* data,
+                          size_t bytes) {
+    static const char zeros[sc_database_alignment] = {};
+    size_t padding = at - offset;
+    if(padding > 0 && fwrite(zeros, 1, padding, fp) != padding)
+        return false;
+    if(bytes > 0 && fwrite(data, 1, bytes, fp) != bytes)
+        return false;
+    offset = at + bytes;
+    return true;
+}
+
+bool save_sc_database(const std::string& filename, const loop_var& loop) {
+    const auto& sc = loop.sc_manager;
+    size_t n = std::min(loop.frames.size(), sc.polarcontexts_.size());
+    size_t rows = sc.PC_NUM_RING, cols = sc.PC_NUM_SECTOR;
+
+    std::vector<double> poses(n * 16), sector_keys(n * cols), descriptors(n * rows * cols);
+    std::vector<float> ring_keys(n * rows);
+    for(size_t i = 0; i < n; i++) {
+        const auto& descriptor = sc.polarcontexts_[i];
+        if((size_t)descriptor.rows() != rows || (size_t)descriptor.cols() != cols)
+            return false;
+
+        std::copy_n(loop.frames[i].transform.data(), 16, &poses[i * 16]);
+        std::copy_n(sc.polarcontext_invkeys_mat_[i].data(), rows, &ring_keys[i * rows]);
+        std::copy_n(sc.polarcontext_vkeys_[i].data(), cols, &sector_keys[i * cols]);
+        std::copy_n(descriptor.data(), rows * cols, &descriptors[i * rows * cols]);
+    }
+
+    sc_database_header header = {};
+    memcpy(header.magic, sc_database_magic, sizeof(header.magic));
+    header.version = sc_database_version;
+    header.rows = rows;
+    header.cols = cols;
+    header.keyframes = n;
+    header.poses_offset = align_up(sizeof(header));
+    header.ring_keys_offset = align_up(header.poses_offset + poses.size() * sizeof(double));
+    header.sector_keys_offset =
+        align_up(header.ring_keys_offset + ring_keys.size() * sizeof(float));
+    header.descriptors_offset =
+        align_up(header.sector_keys_offset + sector_keys.size() * sizeof(double));
+
+    std::string temporary = filename + ".tmp";
+    FILE* fp = fopen(temporary.c_str(), "wb");
+    if(fp == nullptr)
+        return false;
+
+    std::uint64_t offset = 0;
+    bool written =
+        write_section(fp, offset, 0, &header, sizeof(header)) &&
+        write_section(fp, offset, header.poses_offset, poses.data(),
+                      poses.size() * sizeof(double)) &&
+        write_section(fp, offset, header.ring_keys_offset, ring_keys.data(),
+                      ring_keys.size() * sizeof(float)) &&
+        write_section(fp, offset, header.sector_keys_offset, sector_keys.data(),
+                      sector_keys.size() * sizeof(double)) &&
+        write_section(fp, offset, header.descriptors_offset, descriptors.data(),
+                      descriptors.size() * sizeof(double));
+
+    written = fclose(fp) == 0 && written;
+    return written && rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+sc_database::sc_database() = default;
+
+sc_database::~sc_database() {
+    close();
+}
+
+result_of<size_t, std::string> sc_database::open(const std::string& filename) {
+    close();
+
+    int file = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(file < 0)
+        return fail("cannot open " + filename);
+
+    struct stat st;
+    if(fstat(file, &st) != 0 || (size_t)st.st_size < sizeof(sc_database_header)) {
+        ::close(file);
+        return fail(filename + " is not a scan context database");
+    }
+
+    size_t file_length = st.st_size;
+    void* mapped = mmap(nullptr, file_length, PROT_READ, MAP_SHARED, file, 0);
+    if(mapped == MAP_FAILED) {
+        ::close(file);
+        return fail("cannot map " + filename);
+    }
+
+    fd = file;
+    base = static_cast<const std::uint8_t*>(mapped);
+    length = file_length;
+
+    auto header = reinterpret_cast<const sc_database_header*>(base);
+    if(memcmp(header->magic, sc_database_magic, sizeof(header->magic)) != 0 ||
+       header->version != sc_database_version) {
+        close();
+        return fail(filename + " is not a scan context database");
+    }
+
+    if(header->rows != (std::uint32_t)sc.PC_NUM_RING ||
+       header->cols != (std::uint32_t)sc.PC_NUM_SECTOR) {
+        close();
+        return fail(filename + " has scan contexts of another size");
+    }
+
+    size_t n = header->keyframes, r = header->rows, c = header->cols;
+    auto fits = [&](std::uint64_t offset, size_t bytes_per_keyframe) {
+        return offset % sc_database_alignment == 0 && offset <= length &&
+               n <= (length - offset) / bytes_per_keyframe;
+    };
+    if(!fits(header->poses_offset, 16 * sizeof(double)) ||
+       !fits(header->ring_keys_offset, r * sizeof(float)) ||
+       !fits(header->sector_keys_offset, c * sizeof(double)) ||
+       !fits(header->descriptors_offset, r * c * sizeof(double))) {
+        close();
+        return fail(filename + " is truncated");
+    }
+
+    keyframes = n;
+    rows = r;
+    cols = c;
+    poses = reinterpret_cast<const double*>(base + header->poses_offset);
+    ring_keys = reinterpret_cast<const float*>(base + header->ring_keys_offset);
+    sector_keys = reinterpret_cast<const double*>(base + header->sector_keys_offset);
+    descriptors = reinterpret_cast<const double*>(base + header->descriptors_offset);
+
+    if(keyframes > 0)
+        tree = std::make_unique<sc_key_tree>(sc_key_source{ ring_keys, keyframes, size_t(rows) });
+    return ok(keyframes);
+}
+
+void sc_database::close() {
+    tree.reset();
+    if(base != nullptr)
+        munmap(const_cast<std::uint8_t*>(base), length);
+    if(fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    base = nullptr;
+    length = 0;
+    keyframes = 0;
+    poses = nullptr;
+    ring_keys = nullptr;
+    sector_keys = nullptr;
+    descriptors = nullptr;
+}
+
+Eigen::Matrix4d sc_database::pose(size_t i) const {
+    return Eigen::Map<const Eigen::Matrix4d>(poses + i * 16);
+}
+
+Eigen::Map<const Eigen::MatrixXd> sc_database::descriptor(size_t i) const {
+    return Eigen::Map<const Eigen::MatrixXd>(descriptors + i * rows * cols, rows, cols);
+}
+
+std::optional<sc_match> sc_database::query(const Eigen::MatrixXd& query_sc) const {
+    if(tree == nullptr || query_sc.rows() != rows || query_sc.cols() != cols)
+        return std::nullopt;
+
+    std::vector<float> key = eig2stdvec(sc.makeRingkeyFromScancontext(query_sc));
+    Eigen::MatrixXd query_vkey = sc.makeSectorkeyFromScancontext(query_sc);
+
+    size_t k = std::min<size_t>(sc.NUM_CANDIDATES_FROM_TREE, keyframes);
+    std::vector<size_t> candidates(k);
+    std::vector<float> distances(k);
+    nanoflann::KNNResultSet<float> result(k);
+    result.init(candidates.data(), distances.data());
+    tree->index.findNeighbors(result, key.data(), nanoflann::SearchParams(10));
+
+    // SCManager::distanceBtnScanContext, reading the stored sector key and descriptor in place
+    const int search_radius = round(0.5 * sc.SEARCH_RATIO * cols);
+    sc_match best = { 0, 1e7, 0.0f };
+    int best_shift = 0;
+    for(size_t i = 0; i < result.size(); i++) {
+        size_t candidate = candidates[i];
+        Eigen::MatrixXd vkey = Eigen::Map<const Eigen::MatrixXd>(sector_keys + candidate * cols,
+                                                                 1, cols);
+        int aligned = sc.fastAlignUsingVkey(query_vkey, vkey);
+
+        const double* candidate_sc = descriptors + candidate * rows * cols;
+        for(int offset = -search_radius; offset <= search_radius; offset++) {
+            int shift = ((aligned + offset) % cols + cols) % cols;
+            double distance = kernels().sc_distance(query_sc.data(), candidate_sc, rows, cols,
+                                                    shift);
+            if(distance < best.distance) {
+                best.index = candidate;
+                best.distance = distance;
+                best_shift = shift;
+            }
+        }
+    }
+
+    if(best.distance >= sc.SC_DIST_THRES)
+        return std::nullopt;
+
+    best.yaw = deg2rad(best_shift * sc.PC_UNIT_SECTORANGLE);
+    return best;
+}
+
+std::optional<Eigen::Matrix4d> sc_database::relocalize(const pcl::PointCloud<PointType>& scan,
+                                                       sc_match* match) const {
+    auto found = query(sc.makeScancontext(scan));
+    if(!found.has_value())
+        return std::nullopt;
+
+    if(match != nullptr)
+        *match = *found;
+
+    // same convention as the loop closure's ICP seed (loop_icp)
+    float yaw = found->yaw > M_PI ? found->yaw - 2.0 * M_PI : found->yaw;
+    Eigen::Matrix4d turn = Eigen::Matrix4d::Identity();
+    turn.block<3, 3>(0, 0) = Eigen::AngleAxisd(-yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    return pose(found->index) * turn;
+}
@@ -0,0 +1,206 @@
+#include "scan_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char scan_archive_magic[8] = "HLSCAN1";
+static constexpr std::uint32_t scan_archive_version = 1;
+static constexpr std::uint64_t scan_archive_alignment = 64;
+
+scan_archive_writer::~scan_archive_writer() {
+    abort();
+}
+
+bool scan_archive_writer::open(const std::string& filename) {
+    abort();
+
+    std::string temporary = filename + ".tmp";
+    fp = fopen(temporary.c_str(), "wb");
+    if(fp == nullptr)
+        return false;
+
+    // rewritten with the final counts on close()
+    scan_archive_header header = {};
+    if(fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        fp = nullptr;
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    this->filename = filename;
+    offset = sizeof(header);
+    index.clear();
+    return true;
+}
+
+bool scan_archive_writer::append(double stamp, const PointType* points, size_t count) {
+    if(fp == nullptr)
+        return false;
+
+    static const char zeros[scan_archive_alignment] = {};
+    size_t padding = (scan_archive_alignment - offset % scan_archive_alignment) %
+                     scan_archive_alignment;
+    if(padding > 0 && fwrite(zeros, 1, padding, fp) != padding)
+        return false;
+    offset += padding;
+
+    if(count > 0 && fwrite(points, sizeof(PointType), count, fp) != count)
+        return false;
+
+    index.push_back({ stamp, offset, count });
+    offset += count * sizeof(PointType);
+    return true;
+}
+
+bool scan_archive_writer::close() {
+    if(fp == nullptr)
+        return false;
+
+    scan_archive_header header = {};
+    memcpy(header.magic, scan_archive_magic, sizeof(header.magic));
+    header.version = scan_archive_version;
+    header.record_size = sizeof(PointType);
+    header.frames = index.size();
+    header.index_offset = offset;
+
+    bool written =
+        fwrite(index.data(), sizeof(scan_archive_entry), index.size(), fp) == index.size() &&
+        fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    written = fclose(fp) == 0 && written;
+    fp = nullptr;
+    index.clear();
+
+    std::string temporary = filename + ".tmp";
+    if(written && rename(temporary.c_str(), filename.c_str()) == 0)
+        return true;
+
+    unlink(temporary.c_str());
+    return false;
+}
+
+void scan_archive_writer::abort() {
+    if(fp == nullptr)
+        return;
+
+    fclose(fp);
+    fp = nullptr;
+    index.clear();
+    unlink((filename + ".tmp").c_str());
+}
+
+scan_archive::~scan_archive() {
+    close();
+}
+
+result_of<size_t, std::string> scan_archive::open(const std::string& filename) {
+    close();
+
+    int file = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(file < 0)
+        return fail("cannot open " + filename);
+
+    struct stat st;
+    if(fstat(file, &st) != 0 || (size_t)st.st_size < sizeof(scan_archive_header)) {
+        ::close(file);
+        return fail(filename + " is not a scan archive");
+    }
+
+    size_t file_length = st.st_size;
+    void* mapped = mmap(nullptr, file_length, PROT_READ, MAP_SHARED, file, 0);
+    if(mapped == MAP_FAILED) {
+        ::close(file);
+        return fail("cannot map " + filename);
+    }
+
+    fd = file;
+    base = static_cast<const std::uint8_t*>(mapped);
+    length = file_length;
+
+    auto header = reinterpret_cast<const scan_archive_header*>(base);
+    if(memcmp(header->magic, scan_archive_magic, sizeof(header->magic)) != 0 ||
+       header->version != scan_archive_version) {
+        close();
+        return fail(filename + " is not a scan archive");
+    }
+
+    if(header->record_size != sizeof(PointType)) {
+        close();
+        return fail(filename + " was written with a different point layout");
+    }
+
+    if(header->index_offset > length ||
+       header->frames > (length - header->index_offset) / sizeof(scan_archive_entry)) {
+        close();
+        return fail(filename + " is truncated");
+    }
+
+    index = reinterpret_cast<const scan_archive_entry*>(base + header->index_offset);
+    for(size_t i = 0; i < header->frames; i++) {
+        const auto& entry = index[i];
+        if(entry.offset % alignof(PointType) != 0 || entry.offset > header->index_offset ||
+           entry.count > (header->index_offset - entry.offset) / sizeof(PointType)) {
+            close();
+            return fail(filename + " has a corrupt index");
+        }
+    }
+
+    frames = header->frames;
+    prefetched = 0;
+    return ok(frames);
+}
+
+void scan_archive::close() {
+    if(base != nullptr)
+        munmap(const_cast<std::uint8_t*>(base), length);
+    if(fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    base = nullptr;
+    length = 0;
+    index = nullptr;
+    frames = 0;
+    prefetched = 0;
+}
+
+scan_view scan_archive::frame(size_t i) const {
+    // keep the window a few frames ahead; a jump backwards restarts it
+    size_t from = i + 1;
+    if(from < prefetched && from + read_ahead * 2 >= prefetched)
+        from = prefetched;
+    size_t to = std::min(i + 1 + read_ahead, frames);
+    if(from < to) {
+        prefetch(from, to - from);
+        prefetched = to;
+    }
+
+    const auto& entry = index[i];
+    return { reinterpret_cast<const PointType*>(base + entry.offset), (size_t)entry.count,
+             entry.stamp };
+}
+
+void scan_archive::load(size_t i, pcl::PointCloud<PointType>& cloud) const {
+    auto view = frame(i);
+    cloud.points.assign(view.begin(), view.end());
+    cloud.width = view.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+void scan_archive::prefetch(size_t first, size_t count) const {
+    if(first >= frames || count == 0)
+        return;
+
+    size_t last = std::min(first + count, frames) - 1;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = index[first].offset / page * page;
+    size_t end = index[last].offset + index[last].count * sizeof(PointType);
+    if(end > begin)
+        madvise(const_cast<std::uint8_t*>(base) + begin, end - begin, MADV_WILLNEED);
+}
@@ -1,5 +1,13 @@
 #include "comm.h"
-
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "roi_filter.h"
+#include "thread_profile.h"
+#include "trace.h"
+#include "velodyne_stream.h"
+
+#include <algorithm>
 #include <mutex>
 #include <pcl/common/transforms.h>
 #include <pcl_conversions/pcl_conversions.h>
@@ -12,6 +20,7 @@
 struct stamped_velodyne {
     pcl::PointCloud<PointType>::Ptr cloud;
     double time;
+    feature_objects features; // from velodyne_stream, if on
 };
 
 static auto minmax_time(const stamped_velodyne& cloud) {
@@ -27,6 +36,44 @@ static auto minmax_time(const stamped_velodyne& cloud) {
     return std::make_pair(var.first->time + offset, var.second->time + offset);
 }
 
+// /hloam/roi/<sensor>/*, see config/default.yaml
+static roi_config get_roi_config(ros::NodeHandle* nh, const std::string& sensor) {
+    roi_config config;
+    std::string prefix = "/hloam/roi/" + sensor + "/";
+    nh->param<bool>(prefix + "enable", config.enable, false);
+    nh->param<float>(prefix + "min_range", config.min_range, 0.0f);
+    nh->param<float>(prefix + "max_range", config.max_range, 0.0f);
+    nh->param<float>(prefix + "azimuth_min", config.azimuth_min, -180.0f);
+    nh->param<float>(prefix + "azimuth_max", config.azimuth_max, 180.0f);
+    nh->param<int>(prefix + "stride", config.stride, 1);
+
+    auto to_box = [](const float* v) {
+        return roi_box{ { v[0], v[1], v[2] }, { v[3], v[4], v[5] } };
+    };
+
+    std::vector<float> box;
+    nh->param<std::vector<float>>(prefix + "box", box, {});
+    if(box.size() == 6)
+        config.box = to_box(box.data());
+    else if(!box.empty())
+        ROS_WARN("roi/%s/box must have 6 elements, %zd got", sensor.c_str(), box.size());
+
+    // flattened: 6 floats per box
+    std::vector<float> exclude;
+    nh->param<std::vector<float>>(prefix + "exclude", exclude, {});
+    if(exclude.size() % 6 != 0)
+        ROS_WARN("roi/%s/exclude must have 6 elements per box, %zd got", sensor.c_str(),
+                 exclude.size());
+    for(size_t i = 0; i + 6 <= exclude.size(); i += 6)
+        config.exclude.push_back(to_box(&exclude[i]));
+
+    if(config.enable)
+        ROS_INFO("%s roi: range %f-%f, azimuth %f-%f, %zd excluded boxes, stride %d",
+                 sensor.c_str(), config.min_range, config.max_range, config.azimuth_min,
+                 config.azimuth_max, config.exclude.size(), config.stride);
+    return config;
+}
+
 class Junk: public ros::NodeHandle {
     std::vector<PointType> livox_sequences;
     std::queue<stamped_velodyne> velodyne_sequences;
@@ -38,6 +85,14 @@ class Junk: public ros::NodeHandle {
 
     std::string livox_frame_id, velodyne_frame_id;
 
+    roi_config livox_roi, velodyne_roi;
+
+    // spinning thread only
+    std::unique_ptr<velodyne_stream> stream;
+
+    double micro_sweep = 0.0;     // s, livox micro-sweep length, 0: off
+    double micro_sweep_end = 0.0; // end of the last micro-sweep sent
+
     std::mutex mtx;
 
     ros::Publisher publish_combined;
@@ -50,13 +105,31 @@ public:
         param<std::string>("/hloam/velodyne_topic", velodyne_topic, "/u2102");
         // X,Y,Z,R,P,Y
 
+        livox_roi = get_roi_config(this, "livox");
+        velodyne_roi = get_roi_config(this, "velodyne");
+
+        bool use_livox = true;
+        param<bool>("/hloam/use_livox", use_livox, true);
+        param<double>("/hloam/livox_micro_sweep/duration", micro_sweep, 0.0);
+        if(micro_sweep > 0.0 && use_livox)
+            ROS_INFO("Livox micro-sweeps of %f s", micro_sweep);
+        else
+            micro_sweep = 0.0;
+
+        int sectors = 0;
+        param<int>("/hloam/velodyne_stream/sectors", sectors, 0);
+        if(sectors > 0) {
+            ROS_INFO("Velodyne sweeps arrive in %d parts", sectors);
+            stream = std::make_unique<velodyne_stream>(sectors);
+        }
+
         ROS_INFO("Subscribing to %s and %s", livox_topic.c_str(), velodyne_topic.c_str());
         sub_livox = subscribe(livox_topic, 100, &Junk::livox_callback, this);
         sub_velodyne = subscribe(velodyne_topic, 100, &Junk::velodyne_callback, this);
         publish_combined = advertise<sensor_msgs::PointCloud2>("/combined_cloud", 100);
 
         sync_frame_delegate.append([this](const synced_message& msg) {
-            if(publish_combined.getNumSubscribers() == 0) {
+            if(msg.livox_only || publish_combined.getNumSubscribers() == 0) {
                 return;
             }
             pcl::PointCloud<PointType> cloud;
@@ -74,8 +147,14 @@ public:
 
     void livox_callback(const sensor_msgs::PointCloud2ConstPtr& msg) {
 
-        pcl::PointCloud<PointType>::Ptr cloud(new pcl::PointCloud<PointType>);
-        pcl::fromROSMsg(*msg, *cloud);
+        auto cloud = acquire_cloud();
+        {
+            TRACE_SCOPE("decode.livox");
+            pcl::fromROSMsg(*msg, *cloud);
+
+            static auto& cropped = metrics_counter("roi.dropped.livox");
+            cropped.add(roi_filter(livox_roi, *cloud));
+        }
 
         if(cloud->empty()) {
             return;
@@ -85,18 +164,33 @@ public:
         livox_frame_id = msg->header.frame_id;
         livox_sequences.insert(livox_sequences.end(), cloud->points.begin(), cloud->points.end());
         try_combine_clouds();
+        send_micro_sweeps();
     }
 
     void velodyne_callback(const sensor_msgs::PointCloud2ConstPtr& msg) {
-        pcl::PointCloud<PointType>::Ptr cloud(new pcl::PointCloud<PointType>);
-        pcl::fromROSMsg(*msg, *cloud);
+        auto cloud = acquire_cloud();
+        {
+            TRACE_SCOPE("decode.velodyne");
+            pcl::fromROSMsg(*msg, *cloud);
+
+            static auto& cropped = metrics_counter("roi.dropped.velodyne");
+            cropped.add(roi_filter(velodyne_roi, *cloud));
+        }
         if(cloud->empty()) {
             return;
         }
 
+        stamped_velodyne sweep = { cloud, msg->header.stamp.toSec() };
+        if(stream != nullptr) {
+            auto streamed = stream->push(cloud, sweep.time);
+            if(!streamed.has_value())
+                return;
+            sweep = { streamed->cloud, streamed->time, streamed->features };
+        }
+
         std::lock_guard<std::mutex> lock(mtx);
         velodyne_frame_id = msg->header.frame_id;
-        velodyne_sequences.push({ cloud, msg->header.stamp.toSec() });
+        velodyne_sequences.push(sweep);
         try_combine_clouds();
     }
 
@@ -118,7 +212,7 @@ public:
             return true;
         };
 
-        pcl::PointCloud<PointType>::Ptr livox_cloud(new pcl::PointCloud<PointType>);
+        auto livox_cloud = acquire_cloud();
 
         size_t start_index = livox_index;
 
@@ -148,14 +242,14 @@ public:
                                    livox_sequences.begin() + end_index);
         livox_index = end_index;
 
-        call_features(livox_cloud, velodyne_sequences.front().cloud,
-                      ros::Time(velodyne_frame_start));
+        call_features(livox_cloud, velodyne_sequences.front(), ros::Time(velodyne_frame_start));
 
         velodyne_sequences.pop();
         return true;
     }
 
     void try_combine_clouds() {
+        TRACE_SCOPE("sync.combine");
         std::sort(livox_sequences.begin(), livox_sequences.end(),
                   [](const PointType& a, const PointType& b) { return a.time < b.time; });
 
@@ -169,8 +263,41 @@ public:
         }
     }
 
+    // every complete micro_sweep window of livox_sequences (sorted by try_combine_clouds) goes
+    // out on its own; the velodyne sync above still consumes the same points afterwards
+    void send_micro_sweeps() {
+        if(micro_sweep <= 0.0 || livox_sequences.empty())
+            return;
+
+        auto by_time = [](const PointType& p, double time) { return p.time < time; };
+        // first window, or the stream jumped past the last one
+        if(micro_sweep_end < livox_sequences.front().time)
+            micro_sweep_end = livox_sequences.front().time;
+
+        while(livox_sequences.back().time >= micro_sweep_end + micro_sweep) {
+            double start = micro_sweep_end;
+            micro_sweep_end += micro_sweep;
+
+            auto first = std::lower_bound(livox_sequences.begin(), livox_sequences.end(), start,
+                                          by_time);
+            auto last = std::lower_bound(first, livox_sequences.end(), micro_sweep_end, by_time);
+            // a gap in the stream, nothing to register
+            if(last - first < 100)
+                continue;
+
+            synced_message msg;
+            msg.livox = acquire_cloud();
+            msg.livox->points.assign(first, last);
+            msg.velodyne = acquire_cloud();
+            msg.time = ros::Time(start);
+            msg.livox_only = true;
+            sync_frame_delegate(msg);
+        }
+    }
+
     void call_features(pcl::PointCloud<PointType>::Ptr livox_cloud,
-                       pcl::PointCloud<PointType>::Ptr velodyne_cloud, ros::Time time) {
+                       const stamped_velodyne& velodyne, ros::Time time) {
+        const auto& velodyne_cloud = velodyne.cloud;
 
         if(livox_cloud->size() < 10000 || velodyne_cloud->size() < 10000) {
             ROS_INFO("livox_cloud->size(%zd) < 100 || velodyne_cloud->size(%zd) < 100",
@@ -181,23 +308,69 @@ public:
         msg.livox = livox_cloud;
         msg.velodyne = velodyne_cloud;
         msg.time = time;
+        msg.velodyne_features = velodyne.features;
         sync_frame_delegate(msg);
     }
 };
 
+// the core logs through log.h; in the node that goes to rosout
+static void ros_log_handler(log_level level, const char* message) {
+    switch(level) {
+    case LOG_LEVEL_INFO:
+        ROS_INFO("%s", message);
+        break;
+    case LOG_LEVEL_WARN:
+        ROS_WARN("%s", message);
+        break;
+    case LOG_LEVEL_ERROR:
+        ROS_ERROR("%s", message);
+        break;
+    }
+}
+
 int main(int argc, char** argv) {
     for(int i = 0; i < argc; i++) {
         ROS_INFO("argv[%d] : %s", i, argv[i]);
     }
 
     ros::init(argc, argv, "sync_node");
+    set_log_handler(ros_log_handler);
     Junk junk;
 
+    bool trace = false;
+    std::string trace_output;
+    junk.param<bool>("/hloam/trace/enable", trace, false);
+    junk.param<std::string>("/hloam/trace/output", trace_output, "/tmp/hloam_trace.json");
+    trace_enable(trace);
+
+    bool perf = false;
+    junk.param<bool>("/hloam/perf/enable", perf, false);
+    perf_counters_enable(perf);
+
     auto feature_thrd = create_feature_thread(&junk);
     auto mapping_Thrd = create_mapping_thread(&junk);
+    auto metrics_thrd = create_metrics_thread(&junk);
+
+    // the subscriber callbacks (decode + sync) run on the spinning thread; applied after the
+    // workers are spawned so they don't inherit its placement
+    apply_thread_profile(load_thread_profile(&junk, "sync"));
+
+    // kill -USR1 dumps the flight recorder
+    signal(SIGUSR1, [](int) { flight_recorder_signal(); });
 
     ros::spin();
 
+    feature_thrd.reset();
+    mapping_Thrd.reset();
+    metrics_thrd.reset();
+
+    if(trace) {
+        if(trace_export_chrome(trace_output))
+            printf("Trace written to %s\r\n", trace_output.c_str());
+        else
+            printf("Cannot write trace to %s\r\n", trace_output.c_str());
+    }
+
     printf("Exiting...");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include "synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+
+Eigen::Matrix4d synthetic_trajectory::pose(double t) const {
+    double x, y, yaw;
+    if(kind == TRAJECTORY_LOOP) {
+        double w = speed / radius;
+        x = radius * sin(w * t);
+        y = radius * (1.0 - cos(w * t));
+        yaw = w * t;
+    } else {
+        // 1.5m weave with a 16s period
+        constexpr double amplitude = 1.5, period = 16.0;
+        x = speed * t;
+        y = amplitude * sin(2.0 * M_PI * t / period);
+        yaw = atan2(amplitude * 2.0 * M_PI / period * cos(2.0 * M_PI * t / period), speed);
+    }
+
+    Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+    m.block<3, 3>(0, 0) = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    m(0, 3) = x;
+    m(1, 3) = y;
+    return m;
+}
+
+float synthetic_scene::cast(const Eigen::Vector3f& o, const Eigen::Vector3f& d,
+                            float max_range) const {
+    float best = max_range;
+
+    if(!std::isnan(ground) && d.z() < 0) {
+        float t = (ground - o.z()) / d.z();
+        if(t > 0 && t < best)
+            best = t;
+    }
+
+    if(!std::isnan(ceiling) && d.z() > 0) {
+        float t = (ceiling - o.z()) / d.z();
+        if(t > 0 && t < best)
+            best = t;
+    }
+
+    // slab test; rays starting inside a box do not hit it
+    for(auto&& b: boxes) {
+        float t_near = -INFINITY, t_far = INFINITY;
+        for(int i = 0; i < 3; i++) {
+            if(std::abs(d[i]) < 1e-9f) {
+                if(o[i] < b.min[i] || o[i] > b.max[i]) {
+                    t_near = INFINITY;
+                    break;
+                }
+                continue;
+            }
+            float t1 = (b.min[i] - o[i]) / d[i], t2 = (b.max[i] - o[i]) / d[i];
+            t_near = std::max(t_near, std::min(t1, t2));
+            t_far = std::min(t_far, std::max(t1, t2));
+        }
+        if(t_near <= t_far && t_near > 0 && t_near < best)
+            best = t_near;
+    }
+
+    // vertical cylinders, side surface only
+    float a = d.x() * d.x() + d.y() * d.y();
+    if(a > 1e-9f) {
+        for(auto&& p: poles) {
+            float fx = o.x() - p.x, fy = o.y() - p.y;
+            float b = 2 * (fx * d.x() + fy * d.y());
+            float c = fx * fx + fy * fy - p.radius * p.radius;
+            float disc = b * b - 4 * a * c;
+            if(disc < 0)
+                continue;
+
+            float t = (-b - sqrtf(disc)) / (2 * a);
+            float z = o.z() + t * d.z();
+            if(t > 0 && t < best && z >= p.bottom && z <= p.top)
+                best = t;
+        }
+    }
+
+    return best < max_range ? best : INFINITY;
+}
+
+synthetic_scene synthetic_scene::around(const Eigen::Vector3f& origin, float max_range) const {
+    synthetic_scene local;
+    local.ground = ground;
+    local.ceiling = ceiling;
+
+    for(auto&& b: boxes) {
+        float dx = std::max({ b.min.x() - origin.x(), 0.0f, origin.x() - b.max.x() });
+        float dy = std::max({ b.min.y() - origin.y(), 0.0f, origin.y() - b.max.y() });
+        if(dx * dx + dy * dy <= max_range * max_range)
+            local.boxes.push_back(b);
+    }
+
+    for(auto&& p: poles) {
+        float d = hypotf(p.x - origin.x(), p.y - origin.y()) - p.radius;
+        if(d <= max_range)
+            local.poles.push_back(p);
+    }
+    return local;
+}
+
+struct path_sample {
+    Eigen::Vector2f position;
+    Eigen::Vector2f tangent;
+    Eigen::Vector2f normal; // left of the tangent
+};
+
+// one sample every `step` meters; a loop is covered once
+static std::vector<path_sample> sample_path(const synthetic_trajectory& trajectory,
+                                            double duration, float step) {
+    if(trajectory.kind == TRAJECTORY_LOOP)
+        duration = std::min(duration, 2.0 * M_PI * trajectory.radius / trajectory.speed);
+
+    std::vector<path_sample> samples;
+    double dt = step / trajectory.speed;
+    for(double t = -2.0; t <= duration + 2.0; t += dt) {
+        Eigen::Matrix4d m = trajectory.pose(t);
+        path_sample s;
+        s.position = Eigen::Vector2f(m(0, 3), m(1, 3));
+        s.tangent = Eigen::Vector2f(m(0, 0), m(1, 0));
+        s.normal = Eigen::Vector2f(-s.tangent.y(), s.tangent.x());
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+// Axis aligned box with half extents `along` x `across` the path, pushed out to `side` (+1 left,
+// -1 right) until its nearest face is `clearance` away from the path.
+static void place_box(synthetic_scene& scene, const path_sample& s, int side, float clearance,
+                      float along, float across, float bottom, float top) {
+    bool x_major = std::abs(s.tangent.x()) >= std::abs(s.tangent.y());
+    float hx = x_major ? along : across, hy = x_major ? across : along;
+
+    float reach = std::abs(s.normal.x()) * hx + std::abs(s.normal.y()) * hy;
+    Eigen::Vector2f c = s.position + s.normal * side * (clearance + reach);
+    scene.boxes.push_back({ Eigen::Vector3f(c.x() - hx, c.y() - hy, bottom),
+                            Eigen::Vector3f(c.x() + hx, c.y() + hy, top) });
+}
+
+static void place_pole(synthetic_scene& scene, const path_sample& s, float offset, float radius,
+                       float bottom, float top) {
+    Eigen::Vector2f c = s.position + s.normal * offset;
+    scene.poles.push_back({ c.x(), c.y(), radius, bottom, top });
+}
+
+static void make_corridor(synthetic_scene& scene, const std::vector<path_sample>& path,
+                          std::mt19937& rng) {
+    // sensor 0.5m above the floor
+    scene.ground = -0.5f;
+    scene.ceiling = 2.3f;
+
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    for(int side: { -1, 1 }) {
+        int door = 0;
+        for(size_t i = 0; i < path.size(); i++) {
+            if(door > 0) {
+                // recess instead of a wall segment
+                door--;
+                place_box(scene, path[i], side, 2.4f, 0.25f, 0.25f, scene.ground, scene.ceiling);
+                continue;
+            }
+
+            if(u(rng) < 0.04f)
+                door = 2;
+
+            place_box(scene, path[i], side, 1.6f, 0.25f, 0.25f, scene.ground, scene.ceiling);
+            if(i % 16 == 0)
+                place_box(scene, path[i], side, 1.2f, 0.3f, 0.2f, scene.ground, scene.ceiling);
+        }
+    }
+}
+
+static void make_urban_canyon(synthetic_scene& scene, const std::vector<path_sample>& path,
+                              float step, std::mt19937& rng) {
+    scene.ground = -1.8f;
+
+    std::uniform_real_distribution<float> width(8.0f, 20.0f), gap(0.0f, 6.0f);
+    std::uniform_real_distribution<float> depth(8.0f, 14.0f), height(6.0f, 30.0f);
+    std::uniform_real_distribution<float> setback(0.0f, 2.0f), u(0.0f, 1.0f);
+
+    for(int side: { -1, 1 }) {
+        // buildings: walk along the path block by block
+        float next = 0.0f;
+        for(size_t i = 0; i < path.size(); i++) {
+            float s = i * step;
+            if(s >= next) {
+                float w = width(rng);
+                place_box(scene, path[i], side, 9.0f + setback(rng), w / 2, depth(rng) / 2,
+                          scene.ground, scene.ground + height(rng));
+                next = s + w + gap(rng);
+            }
+
+            if(i % size_t(15.0f / step) == 0)
+                place_pole(scene, path[i], side * 6.5f, 0.15f, scene.ground, scene.ground + 6.0f);
+
+            if(i % size_t(6.0f / step) == 0 && u(rng) < 0.3f)
+                place_box(scene, path[i], side, 3.5f, 2.2f, 0.9f, scene.ground, -0.3f);
+        }
+    }
+}
+
+static void make_open_field(synthetic_scene& scene, const std::vector<path_sample>& path,
+                            float step, std::mt19937& rng) {
+    scene.ground = -1.8f;
+
+    std::uniform_real_distribution<float> offset(4.0f, 60.0f), radius(0.2f, 0.5f);
+    std::uniform_real_distribution<float> top(3.0f, 10.0f), u(0.0f, 1.0f);
+    std::uniform_real_distribution<float> shed(1.5f, 3.0f), shed_height(2.5f, 4.0f);
+
+    for(size_t i = 0; i < path.size(); i++) {
+        for(int side: { -1, 1 }) {
+            if(u(rng) < 0.35f)
+                place_pole(scene, path[i], side * offset(rng), radius(rng), scene.ground, top(rng));
+        }
+
+        if(i % size_t(40.0f / step) == 0) {
+            float half = shed(rng);
+            place_box(scene, path[i], u(rng) < 0.5f ? -1 : 1, 15.0f + 25.0f * u(rng), half,
+                      half, scene.ground, scene.ground + shed_height(rng));
+        }
+    }
+}
+
+synthetic_scene make_scene(synthetic_scene_kind kind, const synthetic_trajectory& trajectory,
+                           double duration, unsigned seed) {
+    constexpr float step = 0.5f;
+    std::mt19937 rng(seed);
+    auto path = sample_path(trajectory, duration, step);
+
+    synthetic_scene scene;
+    switch(kind) {
+    case SCENE_CORRIDOR:
+        make_corridor(scene, path, rng);
+        break;
+    case SCENE_URBAN_CANYON:
+        make_urban_canyon(scene, path, step, rng);
+        break;
+    case SCENE_OPEN_FIELD:
+        make_open_field(scene, path, step, rng);
+        break;
+    }
+    return scene;
+}
+
+spinning_model make_spinning_model(int rings) {
+    spinning_model model;
+    model.rings = rings;
+    if(rings == 64) {
+        model.fov_up = 2.0f;
+        model.fov_down = -24.8f;
+        model.max_range = 120.0f;
+    } else if(rings == 32) {
+        model.fov_up = 10.67f;
+        model.fov_down = -30.67f;
+        model.max_range = 100.0f;
+    } else {
+        model.fov_up = 15.0f;
+        model.fov_down = -15.0f;
+        model.max_range = 100.0f;
+    }
+    return model;
+}
+
+static float intensity_of(float range) {
+    return 100.0f / (1.0f + 0.05f * range);
+}
+
+pcl::PointCloud<PointType>::Ptr scan_spinning(const synthetic_scene& scene,
+                                              const synthetic_trajectory& trajectory,
+                                              const spinning_model& model, double start,
+                                              std::mt19937& rng) {
+    std::normal_distribution<float> noise(0.0f, model.range_noise);
+
+    Eigen::Matrix4d begin = trajectory.pose(start);
+    float reach = model.max_range + trajectory.speed * model.period;
+    auto local = scene.around(begin.block<3, 1>(0, 3).cast<float>(), reach);
+
+    std::vector<Eigen::Vector3f> beams(model.rings);
+    float span = model.fov_up - model.fov_down;
+    for(int r = 0; r < model.rings; r++) {
+        float elevation = (model.fov_down + span * r / std::max(1, model.rings - 1)) * M_PI / 180.0;
+        beams[r] = Eigen::Vector3f(cosf(elevation), 0.0f, sinf(elevation));
+    }
+
+    auto cloud = acquire_cloud();
+    cloud->reserve(model.rings * model.columns);
+    for(int c = 0; c < model.columns; c++) {
+        double dt = model.period * c / model.columns;
+        Eigen::Matrix4f pose = trajectory.pose(start + dt).cast<float>();
+        Eigen::Matrix3f R = pose.block<3, 3>(0, 0);
+        Eigen::Vector3f origin = pose.block<3, 1>(0, 3);
+
+        float azimuth = 2.0 * M_PI * c / model.columns;
+        float ca = cosf(azimuth), sa = sinf(azimuth);
+
+        for(int r = 0; r < model.rings; r++) {
+            Eigen::Vector3f d(beams[r].x() * ca, beams[r].x() * sa, beams[r].z());
+            float range = local.cast(origin, R * d, model.max_range);
+            if(!std::isfinite(range) || range < model.min_range)
+                continue;
+
+            range += noise(rng);
+            PointType p;
+            p.x = d.x() * range;
+            p.y = d.y() * range;
+            p.z = d.z() * range;
+            p.intensity = intensity_of(range);
+            p.ring = r;
+            p.time = dt;
+            cloud->push_back(p);
+        }
+    }
+    return cloud;
+}
+
+pcl::PointCloud<PointType>::Ptr scan_livox(const synthetic_scene& scene,
+                                           const synthetic_trajectory& trajectory,
+                                           const livox_model& model, double start,
+                                           std::mt19937& rng) {
+    // incommensurate scan frequencies (Hz), so the figure drifts from frame to frame
+    constexpr double horizontal_hz = 97.13, vertical_hz = 211.71;
+
+    std::normal_distribution<float> noise(0.0f, model.range_noise);
+
+    Eigen::Matrix4d begin = trajectory.pose(start) * model.extrinsic;
+    float reach = model.max_range + trajectory.speed * model.period;
+    auto local = scene.around(begin.block<3, 1>(0, 3).cast<float>(), reach);
+
+    const float half_h = model.fov_horizontal / 2 * M_PI / 180.0;
+    const float half_v = model.fov_vertical / 2 * M_PI / 180.0;
+    const size_t per_beam = model.points / model.beams;
+
+    // beam after beam, so consecutive points are neighbours on one scan line as the livox
+    // feature extractor expects
+    auto cloud = acquire_cloud();
+    cloud->reserve(model.points);
+    for(int k = 0; k < model.beams; k++) {
+        double phase = 2.0 * M_PI * k / model.beams;
+        for(size_t i = 0; i < per_beam; i++) {
+            double dt = model.period * i / per_beam;
+            double t = start + dt;
+
+            float yaw = half_h * sin(2.0 * M_PI * horizontal_hz * t + phase);
+            float pitch = half_v * sin(2.0 * M_PI * vertical_hz * t + 1.7 * phase);
+            Eigen::Vector3f d(cosf(pitch) * cosf(yaw), cosf(pitch) * sinf(yaw), sinf(pitch));
+
+            Eigen::Matrix4f pose = (trajectory.pose(t) * model.extrinsic).cast<float>();
+            float range = local.cast(pose.block<3, 1>(0, 3), pose.block<3, 3>(0, 0) * d,
+                                     model.max_range);
+            if(!std::isfinite(range) || range < model.min_range)
+                continue;
+
+            range += noise(rng);
+            PointType p;
+            p.x = d.x() * range;
+            p.y = d.y() * range;
+            p.z = d.z() * range;
+            p.intensity = intensity_of(range);
+            p.ring = k;
+            p.time = dt;
+            cloud->push_back(p);
+        }
+    }
+    return cloud;
+}
@@ -0,0 +1,123 @@
+#include "thread_profile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int policy_of(const std::string& name) {
+    if(name == "fifo")
+        return SCHED_FIFO;
+    if(name == "rr")
+        return SCHED_RR;
+    return SCHED_OTHER;
+}
+
+static const char* policy_name(int policy) {
+    switch(policy) {
+    case SCHED_FIFO:
+        return "fifo";
+    case SCHED_RR:
+        return "rr";
+    case SCHED_OTHER:
+        return "other";
+    }
+    return "unknown";
+}
+
+thread_profile load_thread_profile(ros::NodeHandle* nh, const std::string& name) {
+    thread_profile profile;
+    profile.name = name;
+
+    std::string prefix = "/hloam/threads/" + name;
+    nh->param<std::vector<int>>(prefix + "/cpus", profile.cpus, {});
+    nh->param<std::string>(prefix + "/policy", profile.policy, "other");
+    nh->param<int>(prefix + "/priority", profile.priority, 0);
+    nh->param<int>(prefix + "/nice", profile.nice, 0);
+
+    if(profile.policy != "other" && profile.policy != "fifo" && profile.policy != "rr") {
+        ROS_WARN("thread %s: unknown policy %s, using other", name.c_str(),
+                 profile.policy.c_str());
+        profile.policy = "other";
+    }
+    return profile;
+}
+
+static void report_thread_placement(const std::string& name) {
+    pthread_t self = pthread_self();
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::string cpus;
+    if(pthread_getaffinity_np(self, sizeof(set), &set) == 0) {
+        int count = 0;
+        for(int i = 0; i < CPU_SETSIZE; i++) {
+            if(CPU_ISSET(i, &set)) {
+                cpus += (count++ == 0 ? "" : ",") + std::to_string(i);
+            }
+        }
+    }
+
+    int policy = SCHED_OTHER;
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    pthread_getschedparam(self, &policy, &param);
+
+    pid_t tid = syscall(SYS_gettid);
+    int nice = getpriority(PRIO_PROCESS, tid);
+
+    ROS_INFO("thread %s: tid %d, policy %s, priority %d, nice %d, cpus [%s], running on %d",
+             name.c_str(), (int)tid, policy_name(policy), param.sched_priority, nice, cpus.c_str(),
+             sched_getcpu());
+}
+
+void apply_thread_profile(const thread_profile& profile) {
+    pthread_t self = pthread_self();
+
+    // kernel limit is 16 bytes including the terminator
+    std::string short_name = "hloam_" + profile.name;
+    short_name.resize(std::min<size_t>(short_name.size(), 15));
+    pthread_setname_np(self, short_name.c_str());
+
+    if(!profile.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu: profile.cpus) {
+            if(cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+
+        int err = pthread_setaffinity_np(self, sizeof(set), &set);
+        if(err != 0) {
+            ROS_WARN("thread %s: cannot set cpu affinity: %s", profile.name.c_str(),
+                     strerror(err));
+        }
+    }
+
+    int policy = policy_of(profile.policy);
+    if(policy != SCHED_OTHER) {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = std::clamp(profile.priority, sched_get_priority_min(policy),
+                                          sched_get_priority_max(policy));
+
+        int err = pthread_setschedparam(self, policy, &param);
+        if(err != 0) {
+            ROS_WARN("thread %s: cannot switch to %s (needs CAP_SYS_NICE or rtprio limit): %s",
+                     profile.name.c_str(), profile.policy.c_str(), strerror(err));
+        }
+    } else if(profile.nice != 0) {
+        // on linux nice values are per-thread when addressed by tid
+        pid_t tid = syscall(SYS_gettid);
+        if(setpriority(PRIO_PROCESS, tid, profile.nice) != 0) {
+            ROS_WARN("thread %s: cannot set nice %d: %s", profile.name.c_str(), profile.nice,
+                     strerror(errno));
+        }
+    }
+
+    report_thread_placement(profile.name);
+}
@@ -0,0 +1,76 @@
+#include "velodyne_stream.h"
+
+#include "metrics.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+velodyne_stream::velodyne_stream(int sectors): sectors(sectors > 0 ? sectors : 1) {
+    __reset();
+}
+
+void velodyne_stream::__reset() {
+    received = 0;
+    pending.cloud = acquire_cloud();
+    pending.features.line_features = acquire_cloud();
+    pending.features.plane_features = acquire_cloud();
+    pending.features.non_features.reset();
+    pending.time = 0.0;
+}
+
+std::optional<velodyne_sweep> velodyne_stream::push(const pcl::PointCloud<PointType>::Ptr& part,
+                                                    double stamp) {
+    TRACE_SCOPE("feature.velodyne_sector");
+    static auto& lost = metrics_counter("frames_dropped.velodyne_stream");
+
+    // the part's first firing tells where in the revolution it starts
+    auto first = std::min_element(part->begin(), part->end(), [](auto&& a, auto&& b) {
+        return a.time < b.time;
+    });
+    if(first == part->end())
+        return std::nullopt;
+
+    double azimuth = std::atan2(first->y, first->x);
+    if(std::isnan(start_azimuth))
+        start_azimuth = azimuth;
+    double offset_from_start = std::abs(std::remainder(azimuth - start_azimuth, 2.0 * M_PI));
+    bool starts_sweep = offset_from_start < M_PI / sectors;
+
+    if(starts_sweep && received > 0) {
+        dropped_sweeps++;
+        lost.add();
+        __reset();
+    }
+    // the rest of a sweep whose start was lost
+    if(!starts_sweep && received == 0)
+        return std::nullopt;
+
+    if(received == 0)
+        pending.time = stamp;
+
+    // same slices per ring as a whole sweep, at least one per part
+    // the extractor needs the 5 neighbours either side of a point
+    if(part->size() > 11) {
+        feature_objects features;
+        feature_velodyne(part, features, std::max(1, 6 / sectors));
+        concat(pending.features.line_features, features.line_features);
+        concat(pending.features.plane_features, features.plane_features);
+    }
+
+    // point times relative to the part's stamp are made absolute, since the parts have
+    // different stamps; relative the way minmax_time in sync_node tells them apart
+    size_t offset = pending.cloud->size();
+    pending.cloud->insert(pending.cloud->end(), part->begin(), part->end());
+    if(first->time < 1.0) {
+        for(size_t i = offset; i < pending.cloud->size(); i++)
+            pending.cloud->points[i].time += stamp;
+    }
+
+    if(++received < sectors)
+        return std::nullopt;
+
+    velodyne_sweep sweep = pending;
+    __reset();
+    return sweep;
+}
@@ -0,0 +1,85 @@
+#include "alloc_tracker.h"
+#include "odometry.h"
+#include "residual.h"
+#include "test_util.h"
+
+#include <cstdio>
+#include <random>
+
+// Zero-allocation budgets of the per-frame hot paths: after one warm-up call with the same
+// inputs, none of them may touch the heap. Needs HLOAM_ENABLE_ALLOC_TRACKING, without it every
+// budget reads 0 and the test only checks that the paths run.
+
+template<typename F>
+static void expect_no_allocations(const char* name, F&& run) {
+    run(); // warm-up: scratch buffers, kd-tree pools, metrics registration
+    alloc_budget budget;
+    run();
+    uint64_t used = budget.used();
+    printf("%-32s %llu allocations\r\n", name, (unsigned long long)used);
+    check(used == 0, name);
+}
+
+// a floor and a wall, seen from pose
+static pcl::PointCloud<PointType>::Ptr make_scene(const Eigen::Matrix4d& pose) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> side(-20.0f, 20.0f), height(0.0f, 4.0f);
+    pcl::PointCloud<PointType> world;
+    for(int i = 0; i < 20000; i++) {
+        PointType p = {};
+        p.x = side(rng);
+        p.y = i % 2 ? side(rng) : 8.0f;
+        p.z = i % 2 ? -1.5f : height(rng) - 1.5f;
+        world.push_back(p);
+    }
+
+    auto cloud = acquire_cloud();
+    *cloud = world;
+    transform_points(cloud->points.data(), cloud->size(), pose.inverse());
+    return cloud;
+}
+
+int main() {
+    if(!alloc_tracking_available)
+        printf("built without HLOAM_ENABLE_ALLOC_TRACKING, budgets are not measured\r\n");
+
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose(0, 3) = 0.2;
+    auto scan = make_scene(pose);
+    auto map = make_scene(Eigen::Matrix4d::Identity());
+
+    expect_no_allocations("transform_points", [&]() {
+        transform_points(scan->points.data(), scan->size(), Eigen::Matrix4d::Identity());
+    });
+
+    pcl::PointCloud<PointType> downsampled;
+    expect_no_allocations("voxel_downsample", [&]() {
+        voxel_downsample(*scan, 0.2f, downsampled);
+    });
+
+    // one LM2 iteration against a fixed map: the kd-trees are built once per frame, outside
+    feature_frame source, target;
+    source.livox_feature.plane_features = scan;
+    source.livox_feature.non_features = scan;
+    target.livox_feature.plane_features = map;
+    target.livox_feature.non_features = map;
+    feature_adapter adap_velodyne(target.velodyne_feature);
+    feature_adapter adap_livox(target.livox_feature);
+    newton N;
+    expect_no_allocations("registration.Ab", [&]() {
+        float loss = 0.0f;
+        Ab({ { source.velodyne_feature, adap_velodyne }, { source.livox_feature, adap_livox } }, N,
+           Transform(), &loss);
+    });
+
+    Eigen::Matrix<double, 6, 6> ATA;
+    Eigen::Matrix<double, 6, 1> ATb;
+    expect_no_allocations("registration.normal_equations",
+                          [&]() { normal_equations(N.A, N.b, N.top, ATA, ATb); });
+
+    if(failed > 0) {
+        printf("%d path(s) allocated\r\n", failed);
+        return 1;
+    }
+    return 0;
+}
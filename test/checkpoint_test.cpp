@@ -0,0 +1,286 @@
+#include "checkpoint.h"
+#include "odometry.h"
+#include "test_util.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+// Writes a checkpoint of a small made-up map, restores it into a fresh odometry and compares,
+// then restores from truncated and corrupted copies, each of which has to fail and leave the
+// odometry as fresh as it was. Exits non-zero on the first mismatch.
+
+static int rejected = 0;
+
+static Eigen::Matrix4d pose_at(double x, double yaw) {
+    Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+    pose.block<3, 3>(0, 0) = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    pose(0, 3) = x;
+    pose(1, 3) = 0.5 * x;
+    return pose;
+}
+
+// three keyframes, one loop constraint, a partly filled window and a path
+static void make_map(visual_odom_v2& odom) {
+    std::mt19937 engine(7);
+    for(int i = 0; i < 3; i++) {
+        auto scan = random_cloud(engine, 500, 20.0f);
+        pcl::PointCloud<SCPointType> sc_scan;
+        for(auto&& p: *scan) {
+            sc_scan.push_back(p);
+        }
+        odom.loop.sc_manager.saveScancontextAndKeys(odom.loop.sc_manager.makeScancontext(sc_scan));
+        odom.loop.frames.push_back(
+            { std::make_shared<const quantized_cloud>(quantized_cloud::fit(*scan)),
+              pose_at(i, 0.1 * i) });
+    }
+    Eigen::Matrix4d relative = pose_at(0.2, 0.05);
+    odom.loop.loop.push_back({ 2, 0,
+                               gtsam::Pose3(gtsam::Rot3(relative.block<3, 3>(0, 0)),
+                                            gtsam::Point3(relative(0, 3), relative(1, 3),
+                                                          relative(2, 3))) });
+    odom.loop.loop_counter = 3;
+    odom.loop.min_constriant_node = 1;
+
+    for(int i = 0; i < 4; i++) {
+        feature_frame frame;
+        frame.velodyne_feature.line_features = random_cloud(engine, 50, 20.0f);
+        frame.velodyne_feature.plane_features = random_cloud(engine, 200, 20.0f);
+        frame.livox_feature.plane_features = random_cloud(engine, 100, 20.0f);
+        if(i % 2 == 0)
+            frame.livox_feature.line_features = random_cloud(engine, 20, 20.0f);
+        odom.local_maps.push(frame, pose_at(i, 0.02 * i));
+    }
+
+    for(int i = 0; i < 5; i++) {
+        geometry_msgs::PoseStamped pose;
+        pose.header.frame_id = "map";
+        pose.header.stamp = ros::Time(100.0 + i);
+        pose.pose = to_ros_pose(pose_at(0.3 * i, 0.0));
+        odom.final_path.poses.push_back(pose);
+    }
+    odom.prev_transform = pose_at(1.2, 0.0);
+    odom.next_initial_guess = { 0.1, 0.0, 0.0, 0.0, 0.0, 0.01 };
+}
+
+static bool same_cloud(const pcl::PointCloud<PointType>::Ptr& a,
+                       const pcl::PointCloud<PointType>::Ptr& b) {
+    if(a == nullptr || b == nullptr)
+        return (a == nullptr || a->empty()) && (b == nullptr || b->empty());
+    if(a->size() != b->size())
+        return false;
+    for(size_t i = 0; i < a->size(); i++) {
+        const auto &p = a->points[i], &q = b->points[i];
+        if(p.x != q.x || p.y != q.y || p.z != q.z || p.intensity != q.intensity)
+            return false;
+    }
+    return true;
+}
+
+static bool same_features(const feature_objects& a, const feature_objects& b) {
+    return same_cloud(a.line_features, b.line_features) &&
+           same_cloud(a.plane_features, b.plane_features) &&
+           same_cloud(a.non_features, b.non_features);
+}
+
+static void compare(const visual_odom_v2& saved, const visual_odom_v2& restored) {
+    check(restored.final_path.poses.size() == saved.final_path.poses.size(), "path length");
+    for(size_t i = 0; i < saved.final_path.poses.size(); i++) {
+        const auto &a = saved.final_path.poses[i], &b = restored.final_path.poses[i];
+        check(a.header.stamp.toSec() == b.header.stamp.toSec() &&
+                  a.pose.position.x == b.pose.position.x &&
+                  a.pose.orientation.w == b.pose.orientation.w,
+              "path pose");
+    }
+
+    const auto &window = saved.local_maps, &restored_window = restored.local_maps;
+    check(restored_window.head == window.head && restored_window.counters == window.counters,
+          "window head and size");
+    for(size_t i = 0; i < window.counters; i++) {
+        check(restored_window.prev_frame_location[i] == window.prev_frame_location[i],
+              "window pose");
+        check(same_features(window.prev_frames[i].velodyne_feature,
+                            restored_window.prev_frames[i].velodyne_feature) &&
+                  same_features(window.prev_frames[i].livox_feature,
+                                restored_window.prev_frames[i].livox_feature),
+              "window clouds");
+    }
+
+    const auto &loop = saved.loop, &restored_loop = restored.loop;
+    check(restored_loop.frames.size() == loop.frames.size(), "keyframe count");
+    check(restored_loop.sc_manager.polarcontexts_.size() == loop.frames.size(),
+          "descriptor count");
+    for(size_t i = 0; i < loop.frames.size() && i < restored_loop.frames.size(); i++) {
+        check(restored_loop.frames[i].transform == loop.frames[i].transform, "keyframe pose");
+        check(restored_loop.sc_manager.polarcontexts_[i] == loop.sc_manager.polarcontexts_[i],
+              "keyframe descriptor");
+
+        // the log keeps the quantized points, so they come back bit for bit
+        const auto &a = *loop.frames[i].velodyne_cloud,
+                   &b = *restored_loop.frames[i].velodyne_cloud;
+        bool same = memcmp(a.origin, b.origin, sizeof(a.origin)) == 0 &&
+                    a.resolution == b.resolution && a.size() == b.size();
+        same = same &&
+               memcmp(a.points.data(), b.points.data(), a.size() * sizeof(quantized_point)) == 0;
+        check(same, "keyframe scan");
+    }
+
+    check(restored_loop.loop.size() == loop.loop.size(), "constraint count");
+    for(size_t i = 0; i < loop.loop.size() && i < restored_loop.loop.size(); i++) {
+        check(restored_loop.loop[i].source_frame_id == loop.loop[i].source_frame_id &&
+                  restored_loop.loop[i].target_frame_id == loop.loop[i].target_frame_id &&
+                  (restored_loop.loop[i].transform.matrix() - loop.loop[i].transform.matrix())
+                          .norm() < 1e-9,
+              "constraint");
+    }
+    check(restored_loop.loop_counter == loop.loop_counter &&
+              restored_loop.min_constriant_node == loop.min_constriant_node,
+          "loop counters");
+    check(restored.prev_transform == saved.prev_transform, "prev_transform");
+    check(restored.next_initial_guess.yaw == saved.next_initial_guess.yaw, "next_initial_guess");
+}
+
+static std::string read_file(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& filename, const std::string& bytes) {
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+// restores from files that have to be rejected, and checks the odometry stayed fresh
+static void expect_rejected(const char* name, const std::string& directory,
+                            const visual_odom_v2_config& config) {
+    visual_odom_v2 odom(config);
+    checkpointer checkpoints({ directory, 10.0, true });
+    auto restored = checkpoints.restore(odom);
+    if(restored.ok()) {
+        printf("%s: restored\r\n", name);
+        failed++;
+        return;
+    }
+    printf("%s: %s\r\n", name, restored.error().c_str());
+    rejected++;
+    check(odom.final_path.poses.empty() && odom.local_maps.empty() && odom.loop.frames.empty() &&
+              odom.loop.loop.empty() && odom.loop.sc_manager.polarcontexts_.empty(),
+          "rejected checkpoint touched the odometry");
+}
+
+int main() {
+    char directory_template[] = "/tmp/hloam_checkpoint_test.XXXXXX";
+    if(mkdtemp(directory_template) == nullptr) {
+        printf("cannot create a temporary directory\r\n");
+        return 1;
+    }
+    std::string directory = directory_template;
+    std::string state_name = directory + "/state", log_name = directory + "/keyframes";
+
+    visual_odom_v2_config config;
+    config.enable_loop = true;
+    visual_odom_v2 saved(config);
+    make_map(saved);
+    {
+        checkpointer checkpoints({ directory, 10.0, false });
+        checkpoints.update(ros::Time(104.0), saved, true);
+    }
+
+    {
+        visual_odom_v2 restored(config);
+        checkpointer checkpoints({ directory, 10.0, true });
+        auto result = checkpoints.restore(restored);
+        check(result.ok(), "round trip not restored");
+        if(result.ok()) {
+            check(result.value() == saved.loop.frames.size(), "restored keyframe count");
+            compare(saved, restored);
+        }
+    }
+
+    // each case below damages one file; put_back restores both first
+    std::string state = read_file(state_name), log = read_file(log_name);
+    auto put_back = [&] {
+        write_file(state_name, state);
+        write_file(log_name, log);
+    };
+
+    // where the state file's sections start
+    size_t keyframes_at = sizeof(checkpoint_header) +
+                          saved.final_path.poses.size() * sizeof(checkpoint_pose);
+    size_t constraints_at = keyframes_at + saved.loop.frames.size() * sizeof(checkpoint_keyframe);
+    size_t window_at = constraints_at + saved.loop.loop.size() * sizeof(checkpoint_constraint);
+
+    // replaces the 64-bit field at offset of the state file
+    auto write_corrupt = [&](size_t offset, std::uint64_t value) {
+        std::string corrupt = state;
+        corrupt.replace(offset, sizeof(value), reinterpret_cast<const char*>(&value),
+                        sizeof(value));
+        write_file(state_name, corrupt);
+    };
+
+    // the window clouds come last, so most cuts only show once everything before them was read
+    for(size_t length: { size_t(100), keyframes_at - 2 * sizeof(checkpoint_pose),
+                         state.size() / 2, state.size() - 1 }) {
+        put_back();
+        write_file(state_name, state.substr(0, length));
+        expect_rejected("truncated state", directory, config);
+    }
+
+    put_back();
+    write_file(log_name, log.substr(0, log.size() - 1));
+    expect_rejected("truncated keyframe log", directory, config);
+
+    // the last keyframe's record pointing past the end of the log
+    put_back();
+    write_corrupt(constraints_at - sizeof(checkpoint_keyframe) +
+                      offsetof(checkpoint_keyframe, offset),
+                  log.size() - 8);
+    expect_rejected("corrupt keyframe index", directory, config);
+
+    // the first keyframe's scan with no resolution
+    put_back();
+    std::uint64_t record;
+    memcpy(&record, state.data() + keyframes_at + offsetof(checkpoint_keyframe, offset),
+           sizeof(record));
+    size_t resolution_at = record + SCManager::PC_NUM_RING * SCManager::PC_NUM_SECTOR *
+                                        sizeof(double) + offsetof(keyframe_scan, resolution);
+    std::string corrupt_log = log;
+    corrupt_log.replace(resolution_at, sizeof(float), sizeof(float), '\0');
+    write_file(log_name, corrupt_log);
+    expect_rejected("corrupt keyframe scan", directory, config);
+
+    // a constraint to a keyframe that does not exist
+    put_back();
+    write_corrupt(constraints_at + offsetof(checkpoint_constraint, source),
+                  saved.loop.frames.size());
+    expect_rejected("corrupt loop constraint", directory, config);
+
+    // counts far past the end of the file, which must be refused before anything is sized by them
+    for(size_t field: { offsetof(checkpoint_header, path), offsetof(checkpoint_header, keyframes),
+                        offsetof(checkpoint_header, constraints) }) {
+        put_back();
+        write_corrupt(field, std::uint64_t(1) << 60);
+        expect_rejected("corrupt record count", directory, config);
+    }
+    put_back();
+    write_corrupt(window_at + 16 * sizeof(double), std::uint64_t(1) << 60);
+    expect_rejected("corrupt window cloud size", directory, config);
+
+    put_back();
+    unlink(state_name.c_str());
+    unlink(log_name.c_str());
+    rmdir(directory.c_str());
+
+    if(failed > 0) {
+        printf("%d checks failed\r\n", failed);
+        return 1;
+    }
+    printf("checkpoint round trip and %d rejected checkpoints ok\r\n", rejected);
+    return 0;
+}
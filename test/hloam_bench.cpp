@@ -0,0 +1,263 @@
+#include "comm.h"
+#include "loop.h"
+#include "odometry.h"
+#include "residual.h"
+#include "synthetic.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+// Micro-benchmarks for the per-frame kernels.
+//
+//   hloam_bench --benchmark_out=bench.json --benchmark_out_format=json
+//
+// Every kernel runs on synthetic urban canyon scans (include/synthetic.h; 16/32/64 rings, plus
+// Livox frames scaled with the ring count) and, when HLOAM_BENCH_DATA names a directory holding
+// velodyne_0.pcd, velodyne_1.pcd, livox_0.pcd and livox_1.pcd, on those recorded frames too.
+// Frame 1 is registered against a local map built from frame 0, as the mapping thread would.
+// HLOAM_ISA=default|avx2|avx512 pins the kernel variant (include/kernels.h) for comparing them.
+
+struct bench_input {
+    pcl::PointCloud<PointType>::Ptr velodyne[2];
+    pcl::PointCloud<PointType>::Ptr livox[2];
+
+    feature_frame features[2];
+    feature_frame downsampled; // frame 1, as passed to LM2
+    feature_frame map;         // local map holding frame 0
+};
+
+static pcl::PointCloud<PointType>::Ptr load_pcd(const std::string& filename) {
+    auto cloud = acquire_cloud();
+    if(pcl::io::loadPCDFile(filename, *cloud) != 0)
+        return nullptr;
+    return cloud;
+}
+
+static void prepare(bench_input& input) {
+    for(int i = 0; i < 2; i++) {
+        feature_velodyne(input.velodyne[i], input.features[i].velodyne_feature);
+        feature_livox(input.livox[i], input.features[i].livox_feature);
+    }
+
+    local_map map;
+    map.push(input.features[0], Eigen::Matrix4d::Identity());
+    input.map = map.get_local_map();
+    input.downsampled = downsample(input.features[1]);
+}
+
+// "recorded" or "synthetic<rings>"; nullptr if the recorded frames are not available
+static const bench_input* get_input(const std::string& key) {
+    static std::map<std::string, std::unique_ptr<bench_input>> inputs;
+
+    auto it = inputs.find(key);
+    if(it != inputs.end())
+        return it->second.get();
+
+    std::unique_ptr<bench_input> input(new bench_input());
+    if(key == "recorded") {
+        const char* dir = getenv("HLOAM_BENCH_DATA");
+        if(dir == nullptr)
+            return nullptr;
+
+        for(int i = 0; i < 2; i++) {
+            std::string base = std::string(dir) + "/";
+            input->velodyne[i] = load_pcd(base + "velodyne_" + std::to_string(i) + ".pcd");
+            input->livox[i] = load_pcd(base + "livox_" + std::to_string(i) + ".pcd");
+            if(input->velodyne[i] == nullptr || input->livox[i] == nullptr)
+                return nullptr;
+        }
+    } else {
+        int rings = atoi(key.c_str() + strlen("synthetic"));
+        synthetic_trajectory trajectory;
+        auto scene = make_scene(SCENE_URBAN_CANYON, trajectory, 1.0, 1);
+
+        livox_model livox;
+        livox.points = rings * 1500;
+
+        spinning_model velodyne = make_spinning_model(rings);
+
+        std::mt19937 rng(1);
+        for(int i = 0; i < 2; i++) {
+            double t = 0.1 * i;
+            input->velodyne[i] = scan_spinning(scene, trajectory, velodyne, t, rng);
+            input->livox[i] = scan_livox(scene, trajectory, livox, t, rng);
+        }
+    }
+
+    prepare(*input);
+    return (inputs[key] = std::move(input)).get();
+}
+
+static void bench_feature_velodyne(benchmark::State& state, const bench_input& input) {
+    feature_objects features;
+    for(auto _: state) {
+        feature_velodyne(input.velodyne[1], features);
+        benchmark::DoNotOptimize(features.plane_features->points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * input.velodyne[1]->size());
+}
+
+static void bench_feature_livox(benchmark::State& state, const bench_input& input) {
+    feature_objects features;
+    for(auto _: state) {
+        feature_livox(input.livox[1], features);
+        benchmark::DoNotOptimize(features.plane_features->points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * input.livox[1]->size());
+}
+
+static void bench_downsample_surf2(benchmark::State& state, const bench_input& input) {
+    auto output = acquire_cloud();
+    for(auto _: state) {
+        downsample_surf2(input.velodyne[1], output);
+        benchmark::DoNotOptimize(output->points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * input.velodyne[1]->size());
+}
+
+static void bench_update_local_map(benchmark::State& state, const bench_input& input) {
+    local_map map;
+    for(size_t i = 0; i < local_map::previous_frame_count; i++) {
+        Eigen::Matrix4d tr = Eigen::Matrix4d::Identity();
+        tr(0, 3) = 0.3 * i;
+        map.push(input.features[i % 2], tr);
+    }
+
+    for(auto _: state) {
+        auto result = map.update_local_map();
+        benchmark::DoNotOptimize(result.velodyne_feature.plane_features->points.data());
+    }
+}
+
+static void bench_Ab(benchmark::State& state, const bench_input& input) {
+    feature_adapter adap_velodyne(input.map.velodyne_feature);
+    feature_adapter adap_livox(input.map.livox_feature);
+
+    for(auto _: state) {
+        float loss = 0.0f;
+        auto N = Ab({ { input.downsampled.velodyne_feature, adap_velodyne },
+                      { input.downsampled.livox_feature, adap_livox } },
+                    Transform(), &loss);
+        benchmark::DoNotOptimize(N.top);
+    }
+}
+
+static void bench_LM2(benchmark::State& state, const bench_input& input) {
+    for(auto _: state) {
+        float loss = 0.0f;
+        auto tr = LM2(input.downsampled, input.map, 10.0f, Transform(), &loss);
+        benchmark::DoNotOptimize(tr);
+    }
+}
+
+static void bench_LM(benchmark::State& state, const bench_input& input) {
+    for(auto _: state) {
+        float loss = 0.0f;
+        auto tr =
+            LM(input.downsampled.velodyne_feature, input.map.velodyne_feature, Transform(), &loss);
+        benchmark::DoNotOptimize(tr);
+    }
+}
+
+static void bench_make_scancontext(benchmark::State& state, const bench_input& input) {
+    SCManager sc;
+    for(auto _: state) {
+        auto desc = sc.makeScancontext(*input.velodyne[1]);
+        benchmark::DoNotOptimize(desc.data());
+    }
+    state.SetItemsProcessed(state.iterations() * input.velodyne[1]->size());
+}
+
+static void bench_distance_scancontext(benchmark::State& state, const bench_input& input) {
+    SCManager sc;
+    auto desc0 = sc.makeScancontext(*input.velodyne[0]);
+    auto desc1 = sc.makeScancontext(*input.velodyne[1]);
+    for(auto _: state) {
+        auto result = sc.distanceBtnScanContext(desc1, desc0);
+        benchmark::DoNotOptimize(result);
+    }
+}
+
+// database of state.range(0) keyframes; the query is always the newest one, the kd-tree is
+// rebuilt on the SCManager's own schedule
+static void bench_detect_loop(benchmark::State& state, const bench_input& input) {
+    SCManager sc;
+    for(int64_t i = 0; i < state.range(0); i++) {
+        sc.makeAndSaveScancontextAndKeys(*input.velodyne[i % 2]);
+    }
+
+    for(auto _: state) {
+        auto result = sc.detectLoopClosureID();
+        benchmark::DoNotOptimize(result);
+    }
+}
+
+static void bench_loop_icp(benchmark::State& state, const bench_input& input) {
+    auto source = acquire_cloud();
+    auto target = acquire_cloud();
+    downsample_surf2(input.velodyne[1], source);
+    downsample_surf2(input.velodyne[0], target);
+
+    for(auto _: state) {
+        float loss = 0.0f;
+        auto tr = loop_icp(source, target, 0.0f, &loss);
+        benchmark::DoNotOptimize(tr);
+    }
+}
+
+using bench_function = void (*)(benchmark::State&, const bench_input&);
+
+static void register_benchmarks(const std::string& key) {
+    const std::pair<const char*, bench_function> kernels[] = {
+        { "feature_velodyne", bench_feature_velodyne },
+        { "feature_livox", bench_feature_livox },
+        { "downsample_surf2", bench_downsample_surf2 },
+        { "update_local_map", bench_update_local_map },
+        { "Ab", bench_Ab },
+        { "LM2", bench_LM2 },
+        { "LM", bench_LM },
+        { "makeScancontext", bench_make_scancontext },
+        { "distanceBtnScanContext", bench_distance_scancontext },
+        { "loop_icp", bench_loop_icp },
+    };
+
+    for(auto&& [name, fn]: kernels) {
+        std::string full = std::string(name) + "/" + key;
+        benchmark::RegisterBenchmark(full.c_str(),
+                                     [key, fn = fn](benchmark::State& state) {
+                                         fn(state, *get_input(key));
+                                     })
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    std::string full = "detectLoopClosureID/" + key;
+    benchmark::RegisterBenchmark(full.c_str(),
+                                 [key](benchmark::State& state) {
+                                     bench_detect_loop(state, *get_input(key));
+                                 })
+        ->Arg(100)
+        ->Arg(1000)
+        ->Unit(benchmark::kMicrosecond);
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    if(get_input("recorded") != nullptr) {
+        register_benchmarks("recorded");
+    } else {
+        printf("HLOAM_BENCH_DATA not set or incomplete, running synthetic inputs only\r\n");
+    }
+
+    for(const char* key: { "synthetic16", "synthetic32", "synthetic64" }) {
+        register_benchmarks(key);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
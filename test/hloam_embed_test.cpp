@@ -0,0 +1,64 @@
+#include "hloam.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Drives hloam_odometry the way an embedding process would, from a plain main() without
+// ros::init. Linked without roscpp (CMakeLists.txt), so a ROS library call creeping into the core
+// fails the build here. Exits non-zero when a frame is neither posed nor dropped.
+
+// a 16-ring sweep of a 20 x 12 x 4 m room, the sensor moved x metres along it
+static hloam_odometry::cloud_ptr room_sweep(double x) {
+    auto cloud = acquire_cloud();
+    cloud->clear();
+    for(int ring = 0; ring < 16; ring++) {
+        double elevation = (-15.0 + 2.0 * ring) * M_PI / 180.0;
+        for(int column = 0; column < 1800; column++) {
+            double azimuth = column * 2.0 * M_PI / 1800.0;
+            double dx = cos(elevation) * cos(azimuth), dy = cos(elevation) * sin(azimuth),
+                   dz = sin(elevation);
+            // the nearest wall, floor or ceiling along the beam
+            double t = INFINITY;
+            if(dx != 0.0)
+                t = std::min(t, ((dx > 0.0 ? 10.0 : -10.0) - x) / dx);
+            if(dy != 0.0)
+                t = std::min(t, (dy > 0.0 ? 6.0 : -6.0) / dy);
+            if(dz != 0.0)
+                t = std::min(t, (dz > 0.0 ? 3.0 : -1.0) / dz);
+
+            XYZIRT p = {};
+            p.x = t * dx;
+            p.y = t * dy;
+            p.z = t * dz;
+            p.intensity = 10.0f * (ring % 4);
+            p.ring = ring;
+            p.time = column * 0.1 / 1800.0;
+            cloud->push_back(p);
+        }
+    }
+    return cloud;
+}
+
+int main() {
+    hloam_config config;
+    config.features.use_livox = false;
+    config.odometry.enable_loop = false;
+    hloam_odometry odom(config);
+
+    int posed = 0, dropped = 0;
+    odom.on_pose = [&](double, const Eigen::Matrix4d&, bool) { posed++; };
+    odom.on_dropped = [&](double, const std::string&) { dropped++; };
+
+    constexpr int frames = 5;
+    for(int i = 0; i < frames; i++) {
+        odom.push_frame(100.0 + 0.1 * i, room_sweep(0.1 * i), nullptr);
+    }
+
+    if(posed + dropped != frames) {
+        printf("%d frames pushed, %d posed and %d dropped\r\n", frames, posed, dropped);
+        return 1;
+    }
+    printf("hloam without roscpp: %d frames posed, %d dropped\r\n", posed, dropped);
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "loop.h"
+#include "scan_archive.h"
 
 #include <filesystem>
+#include <functional>
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl_conversions/pcl_conversions.h>
@@ -85,7 +87,10 @@ static bool sort_cmp(const std::filesystem::path& a, const std::filesystem::path
     return fid < tid;
 }
 
-int run_loop(LMCacheTable& cache, std::vector<std::filesystem::path>& clouds) {
+// loads frame i into the cloud, printing its name every 10 frames
+using frame_loader = std::function<void(size_t, pcl::PointCloud<XYZIRT>&)>;
+
+int run_loop(LMCacheTable& cache, size_t frames, const frame_loader& load) {
 
     ros::NodeHandle nh;
     ros::Publisher global_map = nh.advertise<sensor_msgs::PointCloud2>("/global_map", 100);
@@ -99,17 +104,14 @@ int run_loop(LMCacheTable& cache, std::vector<std::filesystem::path>& clouds) {
     std::vector<Eigen::Matrix4d> final_traces;
 
     Eigen::Matrix4d corr = Eigen::Matrix4d::Identity();
-    size_t index = 0;
-    for(auto var: clouds) {
-        if(++index % 10 == 0) {
-            printf("running %s\r\n", var.string().c_str());
-        }
+    for(size_t i = 0; i < frames; i++) {
+        size_t index = i + 1;
         if(index < 500 || index > 1000 && index < 6000) {
             cache.next();
             continue;
         }
 
-        pcl::io::loadPCDFile(var.string(), *cloud);
+        load(i, *cloud);
 
         feature_velodyne(cloud, features);
 
@@ -136,6 +138,7 @@ int run_loop(LMCacheTable& cache, std::vector<std::filesystem::path>& clouds) {
         br.sendTransform(st);
 
         size_t id = vars.loop_detection(cloud, features, this_tr);
+        vars.keep_back(*cloud);
         if(id == 0)
             continue;
 
@@ -157,11 +160,34 @@ int run_loop(LMCacheTable& cache, std::vector<std::filesystem::path>& clouds) {
 
 int main(int argc, const char* const* argv) {
     if(argc < 3) {
-        printf("Usage: %s <LMCacheTable> <velodyne_clouds>\r\n", argv[0]);
+        printf("Usage: %s <LMCacheTable> <velodyne_clouds|velodyne.scans>\r\n", argv[0]);
         return 0;
     }
     LMCacheTable cache(argv[1]);
 
+    // archives from hloam_pack hold exactly the frames of the cache table
+    if(std::filesystem::is_regular_file(argv[2])) {
+        scan_archive archive;
+        auto opened = archive.open(argv[2]);
+        if(!opened.ok()) {
+            printf("%s\r\n", opened.error().c_str());
+            return 0;
+        }
+
+        if(archive.size() != cache.items.size()) {
+            printf("archive.size() != cache.items.size()\r\n");
+            return 0;
+        }
+
+        ros::init(argc, (char**)argv, "loop_test");
+        return run_loop(cache, archive.size(), [&](size_t i, pcl::PointCloud<XYZIRT>& cloud) {
+            if((i + 1) % 10 == 0) {
+                printf("running frame %zd\r\n", i);
+            }
+            archive.load(i, cloud);
+        });
+    }
+
     auto files = list_all_files(argv[2]);
     std::sort(files.begin(), files.end(), sort_cmp);
 
@@ -174,5 +200,10 @@ int main(int argc, const char* const* argv) {
     }
 
     ros::init(argc, (char**)argv, "loop_test");
-    return run_loop(cache, files);
+    return run_loop(cache, files.size(), [&](size_t i, pcl::PointCloud<XYZIRT>& cloud) {
+        if((i + 1) % 10 == 0) {
+            printf("running %s\r\n", files[i].string().c_str());
+        }
+        pcl::io::loadPCDFile(files[i].string(), cloud);
+    });
 }
@@ -0,0 +1,366 @@
+#include "offline.h"
+#include "scan_archive.h"
+#include "synthetic.h"
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/utsname.h>
+
+// Runs a fixed synthetic dataset through run_offline and, if given, the kernel benchmarks, then
+// compares per-stage latency and throughput with a checked-in baseline. Exits non-zero when any
+// metric is worse than its baseline by more than the tolerance.
+//
+// Baseline lines are `<metric> <value> [tolerance]`, '#' starts a comment. Latencies are in ms
+// for offline.* and us of CPU time for bench.*; offline.fps is the only higher-is-better metric.
+// Built with HLOAM_ENABLE_ALLOC_TRACKING, alloc.<stage>.max is the most heap allocations any
+// frame made in that stage. Those are budgets: exceeded at all unless the line gives a tolerance,
+// so `alloc.decode.max 0` holds decoding allocation-free.
+//
+// offline.* are wall-clock times of a whole run and vary with the machine's load, so they are only
+// gated where their baseline line gives a tolerance; bench.* (CPU time medians) and alloc.* are
+// gated with the default one.
+
+static void usage(const char* name) {
+    printf("Usage: %s --baseline <file> [options]\r\n"
+           "  --data <dir>         synthetic dataset, generated once (perf_gate_data)\r\n"
+           "  --bench <path>       hloam_bench, whose synthetic16 kernels are gated too\r\n"
+           "  --tolerance <ratio>  allowed slowdown for metrics without their own (0.2)\r\n"
+           "  --update             record the current numbers as the new baseline\r\n",
+           name);
+}
+
+struct baseline_entry {
+    double value = 0.0;
+    double tolerance = NAN; // NAN: use the global one
+};
+
+static bool load_baseline(const std::string& filename, std::map<std::string, baseline_entry>& out) {
+    std::ifstream in(filename);
+    if(!in)
+        return false;
+
+    std::string line;
+    while(std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string metric;
+        baseline_entry entry;
+        if(!(fields >> metric >> entry.value))
+            continue;
+        if(!(fields >> entry.tolerance))
+            entry.tolerance = NAN;
+        out[metric] = entry;
+    }
+    return true;
+}
+
+static bool is_budget(const std::string& metric) {
+    return metric.rfind("alloc.", 0) == 0;
+}
+
+static bool is_wall_clock(const std::string& metric) {
+    return metric.rfind("offline.", 0) == 0;
+}
+
+static std::string cpu_model() {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.rfind("model name", 0) == 0)
+            return line.substr(line.find(':') + 2);
+    }
+    return "unknown cpu";
+}
+
+static bool save_baseline(const std::string& filename,
+                          const std::map<std::string, baseline_entry>& previous,
+                          const std::map<std::string, double>& current) {
+    FILE* fp = fopen(filename.c_str(), "w");
+    if(fp == nullptr)
+        return false;
+
+    utsname host;
+    uname(&host);
+    fprintf(fp, "# hloam perf baseline, written by hloam_perf_gate --update\n");
+    fprintf(fp, "# <metric> <value> [tolerance]; offline.* in ms (fps in frames/s), "
+                "bench.* in us\n");
+    fprintf(fp, "# offline.* are wall clock, gated only where a tolerance is given\n");
+    fprintf(fp, "# recorded on %s, %s %s\n", cpu_model().c_str(), host.sysname, host.release);
+    for(auto&& [metric, measured]: current) {
+        // budgets are set by hand and survive an update; new ones start at what was measured
+        auto it = previous.find(metric);
+        double value = it != previous.end() && is_budget(metric) ? it->second.value : measured;
+        if(it != previous.end() && !std::isnan(it->second.tolerance))
+            fprintf(fp, "%s %.4f %.2f\n", metric.c_str(), value, it->second.tolerance);
+        else
+            fprintf(fp, "%s %.4f\n", metric.c_str(), value);
+    }
+    return fclose(fp) == 0;
+}
+
+// 100 frames of the urban canyon with a 16 ring velodyne and a livox, packed once
+static result_of<bool, std::string> make_dataset(const std::string& dir) {
+    std::string velodyne_file = dir + "/velodyne.scans", livox_file = dir + "/livox.scans";
+    if(std::filesystem::exists(velodyne_file) && std::filesystem::exists(livox_file))
+        return ok(true);
+
+    printf("generating the perf gate dataset in %s\r\n", dir.c_str());
+    std::filesystem::create_directories(dir);
+
+    synthetic_trajectory trajectory;
+    spinning_model velodyne_model = make_spinning_model(16);
+    livox_model livox_model;
+    constexpr int frames = 100;
+    auto scene = make_scene(SCENE_URBAN_CANYON, trajectory, frames * velodyne_model.period, 1);
+
+    // the writers only rename their .tmp files into place on close(), so an interrupted run does
+    // not leave a partial dataset
+    scan_archive_writer velodyne, livox;
+    if(!velodyne.open(velodyne_file) || !livox.open(livox_file))
+        return fail("cannot write to " + dir);
+
+    std::mt19937 rng(1);
+    for(int i = 0; i < frames; i++) {
+        double t = i * velodyne_model.period;
+        double stamp = 1600000000.0 + t;
+        auto velodyne_cloud = scan_spinning(scene, trajectory, velodyne_model, t, rng);
+        auto livox_cloud = scan_livox(scene, trajectory, livox_model, t, rng);
+        if(!velodyne.append(stamp, *velodyne_cloud) || !livox.append(stamp, *livox_cloud))
+            return fail("cannot write to " + dir);
+    }
+
+    if(!velodyne.close() || !livox.close())
+        return fail("cannot write to " + dir);
+    return ok(true);
+}
+
+static result_of<bool, std::string> measure_offline(const std::string& dir,
+                                                    std::map<std::string, double>& metrics) {
+    offline_options options;
+    options.velodyne_dir = dir + "/velodyne.scans";
+    options.livox_dir = dir + "/livox.scans";
+
+    auto result = run_offline(options);
+    if(!result.ok())
+        return fail(result.error());
+
+    auto report = result.value();
+    metrics["offline.fps"] = report.fps;
+    for(auto&& stage: report.stages) {
+        // loading is dominated by the page cache, not by our code
+        if(stage.stage == "load" || stage.count == 0)
+            continue;
+        metrics["offline." + stage.stage + ".p50"] = stage.p50;
+        metrics["offline." + stage.stage + ".p90"] = stage.p90;
+    }
+
+    for(auto&& stage: report.allocations) {
+        metrics["alloc." + stage.stage + ".max"] = stage.max_allocations;
+    }
+    return ok(true);
+}
+
+static std::vector<std::string> split_csv(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for(char c: line) {
+        if(c == '"') {
+            quoted = !quoted;
+        } else if(c == ',' && !quoted) {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+// medians over repetitions, in us of CPU time
+static result_of<bool, std::string> measure_bench(const std::string& bench, const std::string& dir,
+                                                  std::map<std::string, double>& metrics) {
+    std::string csv = dir + "/bench.csv";
+    std::string command = "\"" + bench + "\" --benchmark_filter=synthetic16" +
+                          " --benchmark_repetitions=5 --benchmark_report_aggregates_only=true" +
+                          " --benchmark_out_format=csv --benchmark_out=\"" + csv + "\" > /dev/null";
+    if(std::system(command.c_str()) != 0)
+        return fail("running " + bench + " failed");
+
+    std::ifstream in(csv);
+    std::string line;
+    std::vector<std::string> header;
+    while(std::getline(in, line)) {
+        auto fields = split_csv(line);
+        if(header.empty()) {
+            if(!fields.empty() && fields[0] == "name")
+                header = fields;
+            continue;
+        }
+
+        std::map<std::string, std::string> row;
+        for(size_t i = 0; i < fields.size() && i < header.size(); i++) {
+            row[header[i]] = fields[i];
+        }
+
+        const std::string suffix = "_median";
+        auto& name = row["name"];
+        if(name.size() <= suffix.size() ||
+           name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0 ||
+           row["error_occurred"] == "true")
+            continue;
+
+        double scale = row["time_unit"] == "ns" ? 1e-3 : row["time_unit"] == "ms" ? 1e3 : 1.0;
+        metrics["bench." + name.substr(0, name.size() - suffix.size())] =
+            atof(row["cpu_time"].c_str()) * scale;
+    }
+
+    if(header.empty())
+        return fail("no benchmark results in " + csv);
+    return ok(true);
+}
+
+static bool higher_is_better(const std::string& metric) {
+    return metric == "offline.fps";
+}
+
+// prints the comparison table; the value is the number of regressions
+static size_t compare(const std::map<std::string, baseline_entry>& baseline,
+                      const std::map<std::string, double>& current, double tolerance) {
+    size_t regressions = 0;
+    printf("%-48s %12s %12s %9s\r\n", "metric", "baseline", "current", "change");
+    for(auto&& [metric, value]: current) {
+        auto it = baseline.find(metric);
+        if(it == baseline.end()) {
+            printf("%-48s %12s %12.3f %9s  new, not gated\r\n", metric.c_str(), "-", value, "");
+            continue;
+        }
+
+        if(is_wall_clock(metric) && std::isnan(it->second.tolerance)) {
+            printf("%-48s %12.3f %12.3f %9s  wall clock, not gated without a tolerance\r\n",
+                   metric.c_str(), it->second.value, value, "");
+            continue;
+        }
+
+        double base = it->second.value;
+        double limit = std::isnan(it->second.tolerance) ? tolerance : it->second.tolerance;
+        double change = base != 0.0 ? (value - base) / base : 0.0;
+        double worse = higher_is_better(metric) ? -change : change;
+
+        if(is_budget(metric)) {
+            double budget = base * (1.0 + (std::isnan(it->second.tolerance) ? 0.0 : limit));
+            bool over = value > budget;
+            printf("%-48s %12.0f %12.0f %9s  %s\r\n", metric.c_str(), base, value, "",
+                   over ? "OVER BUDGET" : "");
+            regressions += over;
+            continue;
+        }
+
+        const char* verdict = "";
+        if(worse > limit) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if(-worse > limit) {
+            verdict = "faster, consider --update";
+        }
+
+        printf("%-48s %12.3f %12.3f %+8.1f%%  %s\r\n", metric.c_str(), base, value, change * 100,
+               verdict);
+        if(worse > limit)
+            printf("%-48s %12s %12s %9s  limit %+.0f%%\r\n", "", "", "", "",
+                   (higher_is_better(metric) ? -limit : limit) * 100);
+    }
+
+    for(auto&& [metric, entry]: baseline) {
+        if(current.count(metric) == 0)
+            printf("%-48s %12.3f %12s %9s  not measured\r\n", metric.c_str(), entry.value, "-",
+                   "");
+    }
+    return regressions;
+}
+
+int main(int argc, const char* const* argv) {
+    std::string baseline_file, data = "perf_gate_data", bench;
+    double tolerance = 0.2;
+    bool update = false;
+
+    for(int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if(strcmp(arg, "--update") == 0) {
+            update = true;
+            continue;
+        }
+
+        if(i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        if(strcmp(arg, "--baseline") == 0) {
+            baseline_file = value;
+        } else if(strcmp(arg, "--data") == 0) {
+            data = value;
+        } else if(strcmp(arg, "--bench") == 0) {
+            bench = value;
+        } else if(strcmp(arg, "--tolerance") == 0) {
+            tolerance = atof(value);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(baseline_file.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::map<std::string, baseline_entry> baseline;
+    if(!load_baseline(baseline_file, baseline) && !update) {
+        printf("cannot read baseline %s\r\n", baseline_file.c_str());
+        return 1;
+    }
+
+    std::map<std::string, double> current;
+    auto dataset = make_dataset(data);
+    if(!dataset.ok()) {
+        printf("%s\r\n", dataset.error().c_str());
+        return 1;
+    }
+
+    auto offline = measure_offline(data, current);
+    if(!offline.ok()) {
+        printf("offline run failed: %s\r\n", offline.error().c_str());
+        return 1;
+    }
+
+    if(!bench.empty()) {
+        auto kernels = measure_bench(bench, data, current);
+        if(!kernels.ok()) {
+            printf("%s\r\n", kernels.error().c_str());
+            return 1;
+        }
+    }
+
+    if(update) {
+        if(!save_baseline(baseline_file, baseline, current)) {
+            printf("cannot write baseline %s\r\n", baseline_file.c_str());
+            return 1;
+        }
+        printf("%zu metrics recorded in %s\r\n", current.size(), baseline_file.c_str());
+        return 0;
+    }
+
+    size_t regressions = compare(baseline, current, tolerance);
+    if(regressions > 0) {
+        printf("perf gate FAILED: %zu metric(s) regressed against %s\r\n", regressions,
+               baseline_file.c_str());
+        return 1;
+    }
+
+    printf("perf gate passed\r\n");
+    return 0;
+}
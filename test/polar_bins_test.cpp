@@ -0,0 +1,117 @@
+#include "Scancontext.h"
+#include "polar_bins.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// Checks the polar_bins tables against the formulas they replaced, on both sides of every bin
+// edge and on random points. Exits non-zero on the first mismatch.
+
+// feature_velodyne's get_features before the table
+static int reference_column(float x, float y) {
+    constexpr int H_SCAN = 1800;
+    float angle = std::atan2(x, y) * 180.0f / M_PI;
+    int column = -round((angle - 90.0f) / (360.0f / H_SCAN)) + H_SCAN / 2;
+    if(column >= H_SCAN)
+        column -= H_SCAN;
+    if(column < 0 || column >= H_SCAN)
+        column = 0;
+    return column;
+}
+
+// SCManager::makeScancontext before the tables
+static int reference_sector(float x, float y) {
+    int sector = ceil((xy2theta(x, y) / 360.0) * SCManager::PC_NUM_SECTOR);
+    return std::max(std::min(SCManager::PC_NUM_SECTOR, sector), 1) - 1;
+}
+
+static int reference_ring(float x, float y) {
+    float range = sqrt(x * x + y * y);
+    if(range > SCManager::PC_MAX_RADIUS)
+        return -1;
+    int ring = ceil((range / SCManager::PC_MAX_RADIUS) * SCManager::PC_NUM_RING);
+    return std::max(std::min(SCManager::PC_NUM_RING, ring), 1) - 1;
+}
+
+static constexpr azimuth_bins<1800> columns(-180.0 / 1800, 900);
+static constexpr azimuth_bins<SCManager::PC_NUM_SECTOR> sectors(0.0, 0);
+static constexpr range_bins<SCManager::PC_NUM_RING> rings(SCManager::PC_MAX_RADIUS);
+
+static size_t checked = 0, failed = 0, skipped = 0;
+
+// within margin of width * k + offset, in double precision
+static bool near_edge(double value, double width, double offset, double margin) {
+    double phase = fmod(value - offset, width);
+    if(phase < 0.0)
+        phase += width;
+    return phase < margin || width - phase < margin;
+}
+
+static void check(const char* name, int expected, int actual, float x, float y) {
+    checked++;
+    if(expected == actual)
+        return;
+    if(failed++ < 10)
+        printf("%s(%.9g, %.9g): %d, expected %d\r\n", name, x, y, actual, expected);
+}
+
+static void check_point(float x, float y) {
+    check("column", reference_column(x, y), columns(x, y), x, y);
+    check("sector", reference_sector(x, y), sectors(x, y), x, y);
+    check("ring", reference_ring(x, y), rings(x * x + y * y), x, y);
+}
+
+int main() {
+    // both sides of every column and sector edge, well outside float rounding of the angle
+    constexpr double margin = 1e-3; // deg
+    for(double range: { 0.5, 7.0, 43.0, 79.0 }) {
+        for(int edge = 0; edge < 1800; edge++) {
+            double angle = (edge * 0.2 - 0.1) * M_PI / 180.0;
+            for(double side: { -margin, margin }) {
+                double a = angle + side * M_PI / 180.0;
+                check_point(range * cos(a), range * sin(a));
+            }
+        }
+        for(int edge = 0; edge < SCManager::PC_NUM_SECTOR; edge++) {
+            double angle = edge * SCManager::PC_UNIT_SECTORANGLE * M_PI / 180.0;
+            for(double side: { -margin, margin }) {
+                double a = angle + side * M_PI / 180.0;
+                check_point(range * cos(a), range * sin(a));
+            }
+        }
+    }
+
+    // both sides of every ring edge, and the axes
+    for(int edge = 1; edge <= SCManager::PC_NUM_RING; edge++) {
+        for(double side: { -1e-4, 1e-4 }) {
+            double range = edge * SCManager::PC_UNIT_RINGGAP + side;
+            for(int i = 0; i < 16; i++)
+                check_point(range * cos(i * 0.4), range * sin(i * 0.4));
+        }
+    }
+    for(float v: { 0.25f, 3.0f, 50.0f }) {
+        check("ring", reference_ring(v, 0.0f), rings(v * v), v, 0.0f);
+        check("ring", reference_ring(0.0f, -v), rings(v * v), 0.0f, -v);
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+    for(int i = 0; i < 1000000; i++) {
+        float x = coordinate(rng), y = coordinate(rng);
+        // the reference's own float atan2 and sqrt decide these differently from double
+        double angle = atan2(double(y), double(x)) * 180.0 / M_PI;
+        double range = sqrt(double(x) * x + double(y) * y);
+        if(near_edge(angle, 0.2, 0.1, margin) ||
+           near_edge(angle, SCManager::PC_UNIT_SECTORANGLE, 0.0, margin) ||
+           near_edge(range, SCManager::PC_UNIT_RINGGAP, 0.0, 1e-4)) {
+            skipped++;
+            continue;
+        }
+        check_point(x, y);
+    }
+
+    printf("%zu checks, %zu failed, %zu random points skipped at an edge\r\n", checked, failed,
+           skipped);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+#include "kernels.h"
+#include "quantized_cloud.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Checks quantized_cloud against what quantized_cloud.h promises: round trips within half the
+// resolution, clamping at 32767 steps, fit() coarsening for a wide cloud, intensity saturated to
+// 0-255, and the same bits from every kernel variant the CPU runs. Exits non-zero on a failure.
+
+extern const kernel_table kernels_default;
+#ifdef HLOAM_KERNELS_X86
+extern const kernel_table kernels_avx2;
+extern const kernel_table kernels_avx512;
+#endif
+
+// away from the map origin, as keyframes are
+static pcl::PointCloud<PointType> far_cloud(std::mt19937& engine, size_t count, float extent) {
+    return *random_cloud(engine, count, extent, Eigen::Vector3f(1000.0f, 0.0f, 0.0f));
+}
+
+// the largest error of any axis after a round trip, in resolutions
+static float round_trip_error(const pcl::PointCloud<PointType>& cloud,
+                              const quantized_cloud& quantized) {
+    pcl::PointCloud<PointType> decoded;
+    quantized.decode(Eigen::Matrix4d::Identity(), decoded);
+    if(decoded.size() != cloud.size())
+        return INFINITY;
+
+    float error = 0.0f;
+    for(size_t i = 0; i < cloud.size(); i++) {
+        error = std::max({ error, std::abs(decoded[i].x - cloud[i].x),
+                           std::abs(decoded[i].y - cloud[i].y),
+                           std::abs(decoded[i].z - cloud[i].z) });
+    }
+    return error / quantized.resolution;
+}
+
+// float offsets from an origin 1 km out carry about 1e-4 m of rounding of their own
+static constexpr float slack = 0.01f;
+
+static void check_round_trip() {
+    std::mt19937 engine(11);
+    auto cloud = far_cloud(engine, 100000, 300.0f);
+    auto quantized = quantized_cloud::fit(cloud);
+    check(quantized.resolution == 0.01f, "a 600 m cloud keeps the 1 cm resolution");
+    check(round_trip_error(cloud, quantized) <= 0.5f + slack,
+          "round trip error over half the resolution");
+
+    // the points come back moved by the transform
+    Eigen::Matrix4d transform = Eigen::Matrix4d::Identity();
+    transform.block<3, 3>(0, 0) =
+        Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+    transform(0, 3) = -20.0;
+    pcl::PointCloud<PointType> moved;
+    quantized.decode(transform, moved);
+    bool close = moved.size() == cloud.size();
+    for(size_t i = 0; close && i < cloud.size(); i++) {
+        Eigen::Vector4d expected = transform * Eigen::Vector4d(cloud[i].x, cloud[i].y,
+                                                               cloud[i].z, 1.0);
+        close = std::abs(moved[i].x - expected.x()) < 0.01 &&
+                std::abs(moved[i].y - expected.y()) < 0.01 &&
+                std::abs(moved[i].z - expected.z()) < 0.01;
+    }
+    check(close, "decode with a transform");
+}
+
+static void check_clamping() {
+    quantized_cloud quantized(Eigen::Vector3f::Zero(), 0.01f);
+    PointType points[4] = {};
+    points[0].x = 400.0f;    // 40000 steps
+    points[1].x = -400.0f;   // -40000 steps
+    points[2].y = 327.67f;   // the last step in range
+    points[3].z = -327.674f; // rounds to -32767
+    quantized.append(points, 4);
+
+    check(quantized.points[0].x == 32767, "x clamped to 32767");
+    check(quantized.points[1].x == -32767, "x clamped to -32767");
+    check(quantized.points[2].y == 32767, "y at 32767 steps");
+    check(quantized.points[3].z == -32767, "z at -32767 steps");
+
+    pcl::PointCloud<PointType> decoded;
+    quantized.decode(Eigen::Matrix4d::Identity(), decoded);
+    check(std::abs(decoded[0].x - 327.67f) < 1e-3f, "clamped onto the boundary");
+    check(std::abs(decoded[1].x + 327.67f) < 1e-3f, "clamped onto the negative boundary");
+}
+
+static void check_fit_coarsening() {
+    std::mt19937 engine(13);
+    auto cloud = far_cloud(engine, 20000, 1000.0f);
+    // the extremes of the cloud, on the axis that sets its extent
+    cloud[0].x = 0.0f;
+    cloud[1].x = 2000.0f;
+    auto quantized = quantized_cloud::fit(cloud);
+
+    check(quantized.resolution > 0.01f, "fit() coarsens a 2 km cloud");
+    check(quantized.resolution <= 2000.0f / 65534.0f * 1.0001f,
+          "fit() coarsens no more than it needs");
+    check(round_trip_error(cloud, quantized) <= 0.5f + slack,
+          "coarsened round trip error over half the resolution");
+}
+
+static void check_intensity() {
+    quantized_cloud quantized(Eigen::Vector3f::Zero(), 0.01f);
+    const float intensities[] = { -5.0f, 0.4f, 12.5f, 254.6f, 255.0f, 300.0f, 1e6f };
+    const int expected[] = { 0, 0, 13, 255, 255, 255, 255 };
+    constexpr size_t count = sizeof(intensities) / sizeof(intensities[0]);
+
+    PointType points[count] = {};
+    for(size_t i = 0; i < count; i++) {
+        points[i].intensity = intensities[i];
+    }
+    quantized.append(points, count);
+
+    pcl::PointCloud<PointType> decoded;
+    quantized.decode(Eigen::Matrix4d::Identity(), decoded);
+    for(size_t i = 0; i < count; i++) {
+        check(quantized.points[i].intensity == expected[i], "intensity rounded and saturated");
+        check(decoded[i].intensity == float(expected[i]), "intensity decoded");
+        check(decoded[i].ring == 0 && decoded[i].time == 0.0, "ring and time zeroed");
+    }
+}
+
+static void check_variants() {
+    std::vector<const kernel_table*> tables = { &kernels_default };
+#ifdef HLOAM_KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        tables.push_back(&kernels_avx2);
+    if(tables.size() == 2 && __builtin_cpu_supports("avx512f") &&
+       __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl") &&
+       __builtin_cpu_supports("avx512bw"))
+        tables.push_back(&kernels_avx512);
+#endif
+
+    // an odd count, so every variant also runs its scalar tail; some points out of range
+    std::mt19937 engine(17);
+    auto cloud = far_cloud(engine, 4099, 400.0f);
+    const float origin[3] = { 1000.0f, 0.0f, 0.0f };
+    const double m[12] = { 0.8, -0.6, 0.0, 5.0, 0.6, 0.8, 0.0, -3.0, 0.0, 0.0, 1.0, 0.5 };
+    auto input = reinterpret_cast<const kernel_point*>(cloud.points.data());
+
+    std::vector<quantized_point> reference(cloud.size()), quantized(cloud.size());
+    std::vector<kernel_point> reference_decoded(cloud.size()), decoded(cloud.size());
+    kernels_default.quantize_points(input, cloud.size(), origin, 100.0f, reference.data());
+    kernels_default.dequantize_points(reference.data(), reference.size(), origin, 0.01f, m,
+                                      reference_decoded.data());
+
+    for(auto table: tables) {
+        table->quantize_points(input, cloud.size(), origin, 100.0f, quantized.data());
+        table->dequantize_points(quantized.data(), quantized.size(), origin, 0.01f, m,
+                                 decoded.data());
+        bool same = memcmp(quantized.data(), reference.data(),
+                           reference.size() * sizeof(quantized_point)) == 0;
+        for(size_t i = 0; same && i < decoded.size(); i++) {
+            same = memcmp(&decoded[i], &reference_decoded[i], 4 * sizeof(float)) == 0 &&
+                   decoded[i].intensity == reference_decoded[i].intensity;
+        }
+        if(!same)
+            printf("%s: ", table->isa);
+        check(same, "kernel variant differs from the default one");
+    }
+    printf("compared %zu kernel variants\r\n", tables.size());
+}
+
+int main() {
+    check_round_trip();
+    check_clamping();
+    check_fit_coarsening();
+    check_intensity();
+    check_variants();
+
+    if(failed > 0) {
+        printf("%d checks failed\r\n", failed);
+        return 1;
+    }
+    printf("quantized_cloud ok\r\n");
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+// Shared by the test executables: a failure count with check(), which main() turns into the exit
+// code, and random clouds to feed the code under test.
+
+#include "cloud.h"
+
+#include <cstdio>
+#include <random>
+
+inline int failed = 0;
+
+inline void check(bool condition, const char* what) {
+    if(condition)
+        return;
+    printf("%s\r\n", what);
+    failed++;
+}
+
+// count points within extent of offset on x and y and a tenth of it on z, intensity 0-255
+inline pcl::PointCloud<PointType>::Ptr
+random_cloud(std::mt19937& engine, size_t count, float extent,
+             const Eigen::Vector3f& offset = Eigen::Vector3f::Zero()) {
+    std::uniform_real_distribution<float> coordinate(-extent, extent), intensity(0.0f, 255.0f);
+    auto cloud = acquire_cloud();
+    cloud->clear();
+    for(size_t i = 0; i < count; i++) {
+        PointType p = {};
+        p.x = coordinate(engine) + offset.x();
+        p.y = coordinate(engine) + offset.y();
+        p.z = coordinate(engine) * 0.1f + offset.z();
+        p.intensity = intensity(engine);
+        cloud->push_back(p);
+    }
+    return cloud;
+}
+
+#endif